@@ -1,11 +1,18 @@
 #!/bin/sh
 
 if ! (type gcc > /dev/null); then
-  apk add gcc libc-dev cunit cunit-dev
+  apk add gcc libc-dev cunit cunit-dev zlib-dev
 fi
 
 rm -f libcsv.so || true
-gcc -shared -o libcsv.so -fPIC libcsv.c libcsv_util.c
+gcc -shared -o libcsv.so -fPIC libcsv.c libcsv_util.c libcsv_scan.c libcsv_sink.c libcsv_query.c libcsv_sort.c libcsv_group.c libcsv_index.c libcsv_columnar.c libcsv_stream.c -pthread -lz
 
 rm -f libcsv_unit_test || true
-gcc libcsv_unit_tests.c libcsv.c libcsv_util.c -o libcsv_unit_tests -lcunit
+gcc libcsv_unit_tests.c libcsv.c libcsv_util.c libcsv_scan.c libcsv_sink.c libcsv_query.c libcsv_sort.c libcsv_group.c libcsv_index.c libcsv_columnar.c libcsv_stream.c -o libcsv_unit_tests -lcunit -pthread -lz
+
+rm -f libcsv_stress || true
+gcc -O2 libcsv_stress.c libcsv.c libcsv_util.c libcsv_scan.c libcsv_sink.c libcsv_query.c libcsv_sort.c libcsv_group.c libcsv_index.c libcsv_columnar.c libcsv_stream.c -o libcsv_stress -pthread -lz
+
+rm -f libcsv_bench || true
+gcc -O2 libcsv_bench.c libcsv.c libcsv_util.c libcsv_scan.c libcsv_sink.c libcsv_query.c libcsv_sort.c libcsv_group.c libcsv_index.c libcsv_columnar.c libcsv_stream.c -o libcsv_bench -pthread -lz \
+  -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=strdup,--wrap=strndup
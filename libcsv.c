@@ -2,381 +2,2466 @@
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <pthread.h>
 
+#include "libcsv.h"
 #include "libcsv_util.h"
+#include "libcsv_scan.h"
+#include "libcsv_query.h"
+#include "libcsv_index.h"
+#include "libcsv_columnar.h"
+#include "libcsv_stream.h"
+
+#define PARALLEL_CHUNK_SIZE (4 << 20)
+#define PARALLEL_CHUNKS_PER_WORKER 4
+#define QUOTED_CELL_BUFFER_SIZE 256
+
+typedef struct
+{
+  // Rows which pass the filters still to be skipped
+  size_t offset;
+  // Rows still to be written, SIZE_MAX when unlimited
+  size_t count;
+} RowLimit;
+
+typedef struct
+{
+  const char *data;
+  size_t length;
+  char *output;
+  size_t outputLength;
+  size_t rowCount;
+  bool isDone;
+} CsvChunk;
+
+typedef struct
+{
+  const Csv *csv;
+  const FilterPlan *filterPlan;
+  CsvStats *stats;
+  // Most rows a chunk needs to print, SIZE_MAX when unlimited
+  size_t chunkRowLimit;
+  // Receives the partial groups of the workers, NULL when rows are printed
+  CsvAggregator *aggregator;
+  CsvChunk *chunks;
+  size_t chunkCount;
+  size_t nextChunk;
+  size_t writtenChunks;
+  size_t maxChunksAhead;
+  pthread_mutex_t lock;
+  pthread_cond_t chunkDone;
+  pthread_cond_t chunkWritten;
+} ParallelCsv;
+
+struct CsvReader
+{
+  CsvQuery *query;
+  const char *data;
+  size_t length;
+  size_t position;
+  CsvScanner scanner;
+  void *mapping;
+  size_t mappingLength;
+  InputStream *stream;
+  CellView *cells;
+  CellView *fields;
+  CellView *headers;
+  size_t *selectedColumns;
+  size_t selectedCount;
+  RowLimit rowLimit;
+};
+
+typedef struct
+{
+  const ColumnarFile *file;
+  size_t row;
+  // Verdict of each column filter on each dictionary value, -1 until validated,
+  // NULL for filters which are validated cell by cell
+  signed char **verdicts;
+} ColumnarScan;
 
 /**
- * Exit program and print error message for header not found.
+ * Compare a cell with the value of a typed filter, parsing the cell in the type of
+ * the filter.
  *
- * @param header The header that was not found.
+ * @param cell View of the cell to be compared.
+ * @param rowFilter The filter.
+ * @param comparison Will be set to a negative, zero or positive value if the cell
+ * is less, equal or greater than the value of the filter.
+ * @return bool Whether the cell is valid for the type of the filter.
  */
-static void headerNotFound(const char header[])
+static bool compareTypedCell(const CellView *cell, const RowFilter *rowFilter, int *comparison)
 {
-  fprintf(stderr, "Header '%s' not found in CSV file/string\n", header);
+  long long integerValue;
+  double floatValue;
+
+  switch (rowFilter->type)
+  {
+  case INTEGER:
+    if (!parseInteger(cell, &integerValue))
+      return false;
+    *comparison = (integerValue > rowFilter->integerValue) -
+                  (integerValue < rowFilter->integerValue);
+    return true;
+  case DATE:
+    if (!parseDate(cell, &integerValue))
+      return false;
+    *comparison = (integerValue > rowFilter->integerValue) -
+                  (integerValue < rowFilter->integerValue);
+    return true;
+  case FLOAT:
+    if (!parseFloat(cell, &floatValue))
+      return false;
+    *comparison = (floatValue > rowFilter->floatValue) -
+                  (floatValue < rowFilter->floatValue);
+    return true;
+  default:
+    *comparison = compareCell(cell, rowFilter->value, rowFilter->valueLength);
+    return true;
+  }
 }
 
 /**
- * Select specific columns from a string with columns, adding a column in the CSV
- * structure for each header with isSelected set.
+ * Compare a cell with the cell of another column of the same row, parsing both in
+ * the type of the filter. The other cell is unquoted if needed.
  *
- * @param csvHeaders String with the columns to select from.
- * @param selectedColumns String with the columns which will be selected.
- * @param csv The CSV structure in which the columns will be allocated.
- * @param success Will be set as true if the operation was successful.
+ * @param cell View of the cell to be compared, already unquoted.
+ * @param otherCell View of the cell it is compared with.
+ * @param type The type of the filter.
+ * @param comparison Will be set to a negative, zero or positive value if the cell
+ * is less, equal or greater than the other cell.
+ * @return bool Whether both cells are valid for the type.
  */
-static void addColumns(
-    char csvHeaders[],
-    const char selectedColumns[],
-    Csv *csv,
-    bool *success)
+static bool compareColumnCells(
+    const CellView *cell,
+    const CellView *otherCell,
+    enum cellType type,
+    int *comparison)
 {
-  if (*selectedColumns)
-    for (char *selectedHeader = strtok(strdup(selectedColumns), VALUE_SEPARATOR);
-         selectedHeader != NULL;
-         selectedHeader = strtok(NULL, VALUE_SEPARATOR))
-      if (!strstr(csvHeaders, selectedHeader))
-      {
-        headerNotFound(selectedHeader);
-        *success = false;
-        return;
-      }
+  char buffer[QUOTED_CELL_BUFFER_SIZE];
+  char *value = NULL;
+  CellView other = *otherCell;
+
+  if (other.length && *other.value == *QUOTE)
+  {
+    value = other.length <= sizeof(buffer) ? buffer : (char *)malloc(other.length);
+    other.length = unquoteCell(otherCell, value);
+    other.value = value;
+  }
+
+  long long integerValue = 0, otherIntegerValue = 0;
+  double floatValue = 0, otherFloatValue = 0;
+  bool isValid;
+
+  switch (type)
+  {
+  case INTEGER:
+    isValid = parseInteger(cell, &integerValue) && parseInteger(&other, &otherIntegerValue);
+    *comparison = (integerValue > otherIntegerValue) - (integerValue < otherIntegerValue);
+    break;
+  case DATE:
+    isValid = parseDate(cell, &integerValue) && parseDate(&other, &otherIntegerValue);
+    *comparison = (integerValue > otherIntegerValue) - (integerValue < otherIntegerValue);
+    break;
+  case FLOAT:
+    isValid = parseFloat(cell, &floatValue) && parseFloat(&other, &otherFloatValue);
+    *comparison = (floatValue > otherFloatValue) - (floatValue < otherFloatValue);
+    break;
+  default:
+    isValid = true;
+    *comparison = compareCell(cell, other.value, other.length);
+  }
 
-  for (char *header = strtok(csvHeaders, VALUE_SEPARATOR);
-       header != NULL;
-       header = strtok(NULL, VALUE_SEPARATOR))
-    addColumn(csv, header, !*selectedColumns || strstr(selectedColumns, header));
+  if (value != buffer)
+    free(value);
 
-  *success = true;
+  return isValid;
 }
 
 /**
- * Search a CSV structure for a column with a specificied header.
+ * Validate whether a given cell respects a single row filter.
+ *
+ * Typed filters never accept cells which are not valid for their type. Filters
+ * comparing two columns treat missing cells of the other column as empty.
  *
- * @param csv The CSV structure to search in.
- * @param header The header to be searched for.
- * @param success Will be set as true if the operation was successful.
- * @return size_t The column index of the column containing the header.
+ * @param cell View of the cell with the value to be validated.
+ * @param cells Array with one view per cell of the row.
+ * @param cellCount How many cells the row has.
+ * @param rowFilter The filter.
+ * @return bool Whether the cell is valid for the filter or not.
  */
-static size_t getColumn(const Csv *csv, const char header[], bool *success)
+static bool validateFilter(
+    const CellView *cell,
+    const CellView cells[],
+    size_t cellCount,
+    const RowFilter *rowFilter)
 {
-  for (size_t i = 0; i < csv->colCount; i++)
-    if (strcmp(csv->columns[i]->header, header) == 0)
+  int comparison;
+  bool isFound;
+
+  if (rowFilter->valueSet != NULL)
+    return findValue(rowFilter->valueSet, cell, &isFound) &&
+           isFound == (rowFilter->op == IN);
+
+  if (rowFilter->otherColumn != NO_CELL)
+  {
+    CellView empty = {"", 0};
+    const CellView *otherCell = rowFilter->otherColumn < cellCount
+                                    ? &cells[rowFilter->otherColumn]
+                                    : &empty;
+
+    if (!compareColumnCells(cell, otherCell, rowFilter->type, &comparison))
+      return false;
+  }
+  else if (rowFilter->type == TEXT)
+    switch (rowFilter->op)
     {
-      *success = true;
-      return i;
+    case EQUAL:
+      return cell->length == rowFilter->valueLength &&
+             memcmp(cell->value, rowFilter->value, cell->length) == 0;
+    case NOT_EQUAL:
+      return cell->length != rowFilter->valueLength ||
+             memcmp(cell->value, rowFilter->value, cell->length) != 0;
+    default:
+      comparison = compareCell(cell, rowFilter->value, rowFilter->valueLength);
     }
+  else if (!compareTypedCell(cell, rowFilter, &comparison))
+    return false;
 
-  *success = false;
-  headerNotFound(header);
-  return 0;
+  switch (rowFilter->op)
+  {
+  case EQUAL:
+    return comparison == 0;
+  case NOT_EQUAL:
+    return comparison != 0;
+  case LESS:
+    return comparison < 0;
+  case GREATER:
+    return comparison > 0;
+  case LESS_EQUAL:
+    return comparison <= 0;
+  case GREATER_EQUAL:
+    return comparison >= 0;
+  default:
+    return false;
+  }
 }
 
 /**
- * Create RowFilter structures from a definitions string.
+ * Validate whether a given value respects any of the filters for its column.
  *
- * @param rowFilterDefinitions A string containing one or more row filter definitions.
- * @param csv The CSV structure containing the columns which will be filtered.
- * @param rowFilters Array which will contain the constructed structures.
- * @param success Will be set as true if the operation was successful.
- * @return size_t How many filters were constructed.
+ * @param cell View of the value to be validated.
+ * @param cells Array with one view per cell of the row.
+ * @param cellCount How many cells the row has.
+ * @param columnFilter The filters of the value's column.
+ * @return bool Whether the value is valid for the filters or not.
  */
-static size_t defineRowFilters(
-    const char rowFilterDefinitions[],
-    const Csv *csv,
-    RowFilter *rowFilters[],
-    bool *success)
+static bool validateColumnValue(
+    const CellView *cell,
+    const CellView cells[],
+    size_t cellCount,
+    const ColumnFilter *columnFilter)
+{
+  for (size_t i = 0; i < columnFilter->totalRowFilters; i++)
+    if (validateFilter(cell, cells, cellCount, columnFilter->rowFilters[i]))
+      return true;
+
+  return false;
+}
+
+/**
+ * Validate whether the cell of a column respects the filters for the column.
+ *
+ * If there are multiple filters for the same column, and any of them are true, it
+ * is considered a successful validation. Quoted cells are compared by their value.
+ *
+ * @param cells Array with one view per cell of the row.
+ * @param cellCount How many cells the row has.
+ * @param columnFilter The filters of the column.
+ * @return bool Whether the cell of the column is valid for the filters or not.
+ */
+static bool validateColumnFilter(
+    const CellView cells[],
+    size_t cellCount,
+    const ColumnFilter *columnFilter)
+{
+  const CellView *cell = &cells[columnFilter->column];
+
+  if (!cell->length || *cell->value != *QUOTE)
+    return validateColumnValue(cell, cells, cellCount, columnFilter);
+
+  char buffer[QUOTED_CELL_BUFFER_SIZE];
+  char *value = cell->length <= sizeof(buffer) ? buffer : (char *)malloc(cell->length);
+  CellView unquoted = {value, unquoteCell(cell, value)};
+  bool isValid = validateColumnValue(&unquoted, cells, cellCount, columnFilter);
+
+  if (value != buffer)
+    free(value);
+
+  return isValid;
+}
+
+/**
+ * Validate whether a row respects a filter plan, stopping at the first column
+ * whose filters reject it. Missing cells are not validated.
+ *
+ * @param cells Array with one view per cell of the row.
+ * @param cellCount How many cells the row has.
+ * @param filterPlan The compiled filters.
+ * @return size_t The index of the column filter which rejects the row, or the
+ * number of column filters if the row is valid.
+ */
+static size_t validateRow(
+    const CellView cells[],
+    size_t cellCount,
+    const FilterPlan *filterPlan)
 {
-  size_t totalRowFilters = 0;
+  size_t i = 0;
 
-  for (char *rowFilterDefinition = strtok(strdup(rowFilterDefinitions), LINE_SEPARATOR);
-       rowFilterDefinition != NULL;
-       rowFilterDefinition = strtok(NULL, LINE_SEPARATOR))
+  for (; i < filterPlan->totalColumnFilters; i++)
   {
-    enum operator op;
-    for (size_t i = strlen(rowFilterDefinition) - 1; i > 0; --i)
-    {
-      switch (rowFilterDefinition[i])
-      {
-      case '=':
-        switch (rowFilterDefinition[i - 1])
-        {
-        case '!':
-          op = NOT_EQUAL;
-          break;
-        case '<':
-          op = LESS_EQUAL;
-          break;
-        case '>':
-          op = GREATER_EQUAL;
-          break;
-        default:
-          op = EQUAL;
-        }
-        if (op != EQUAL)
-          rowFilterDefinition[i - 1] = '\0';
-        break;
-      case '<':
-        op = LESS;
-        break;
-      case '>':
-        op = GREATER;
-        break;
-      default:
-        op = 0;
-      }
+    const ColumnFilter *columnFilter = &filterPlan->columnFilters[i];
 
-      if (op)
-      {
-        rowFilterDefinition[i] = '\0';
+    if (columnFilter->column < cellCount &&
+        !validateColumnFilter(cells, cellCount, columnFilter))
+      break;
+  }
 
-        size_t col = getColumn(csv, rowFilterDefinition, success);
+  return i;
+}
 
-        if (!*success)
-          return 0;
+/**
+ * Split the next row of a scanned buffer into cell views. Once the leading columns
+ * which are needed have been split, the rest of the row is skipped without
+ * looking at its cells.
+ *
+ * @param scanner The scanner over the buffer, positioned at the start of the row.
+ * @param position Offset of the start of the row, will be set to the start of the
+ * next row.
+ * @param cells Array which will contain one view per cell of the row.
+ * @param scanColumns How many leading columns to split.
+ * @return size_t How many cells of the row were split, 0 for empty rows.
+ */
+static size_t scanRow(
+    CsvScanner *scanner,
+    size_t *position,
+    CellView cells[],
+    size_t scanColumns)
+{
+  const char *data = scanner->data;
+  size_t rowStart = *position;
+  size_t cellStart = rowStart;
+  size_t cellCount = 0;
 
-        rowFilters[totalRowFilters++] = createRowFilter(
-            col,
-            op,
-            &rowFilterDefinition[i + 1]);
-        break;
-      }
+  while (true)
+  {
+    size_t cellEnd = nextStructural(scanner);
+    bool isRowEnd = cellEnd == scanner->length || data[cellEnd] == *LINE_SEPARATOR;
+
+    // The carriage return of CRLF line separators is not part of the last cell
+    size_t valueEnd = isRowEnd && cellEnd > cellStart && data[cellEnd - 1] == '\r'
+                          ? cellEnd - 1
+                          : cellEnd;
+
+    if (cellCount < scanColumns)
+    {
+      cells[cellCount].value = &data[cellStart];
+      cells[cellCount].length = valueEnd - cellStart;
+      cellCount++;
     }
 
-    if (!op)
+    if (isRowEnd)
     {
-      fprintf(stderr, "Invalid filter: '%s'\n", rowFilterDefinition);
-      *success = false;
-      return 0;
+      *position = cellEnd + 1;
+      return valueEnd > rowStart ? cellCount : 0;
+    }
+
+    if (cellCount == scanColumns)
+    {
+      *position = skipLine(scanner, cellEnd + 1) + 1;
+      return cellCount;
     }
-  }
 
-  return totalRowFilters;
+    cellStart = cellEnd + 1;
+  }
 }
 
 /**
- * Validate whether a given cell respects the filter for its column.
- *
- * If there are multiple filters for the same column, and any of them are true, it
- * is considered a successful validation.
+ * Count a row rejected by a column filter, past the overflow counter when the
+ * column is first filtered beyond the per-filter counters.
  *
- * Also, if no filters were found for the column, it is considered successful.
+ * @param stats The counters.
+ * @param columnFilter The column filter which rejected the row.
+ */
+static void countRejection(CsvStats *stats, const ColumnFilter *columnFilter)
+{
+  if (columnFilter->firstRowFilter < CSV_STATS_MAX_FILTERS)
+    stats->rowsRejected[columnFilter->firstRowFilter]++;
+  else
+    stats->rowsRejectedPastMaxFilters++;
+}
+
+/**
+ * Split the rows of a scanned buffer until one passes the filters.
  *
- * @param cell The cell with the value to be validated.
- * @param rowFilters Array with the filters to the CSV.
- * @param totalRowFilters How many row filters there are in the array.
- * @param col The column which is being verified
- * @return bool Whether the column is valid for the filters or not.
+ * @param scanner The scanner over the buffer, positioned at the start of a row.
+ * @param position Offset of the start of the row, will be set to the start of the
+ * row after the one which passed.
+ * @param cells Array which will contain one view per cell of the row.
+ * @param filterPlan The compiled filters.
+ * @param stats Counters of the scanned and filtered rows, NULL to not count them.
+ * @return size_t How many cells the row which passed has, 0 when there are no
+ * rows left.
  */
-static bool validateFilters(
-    const char cell[],
-    RowFilter *rowFilters[],
-    size_t totalRowFilters,
-    size_t col)
+static size_t nextFilteredRow(
+    CsvScanner *scanner,
+    size_t *position,
+    CellView cells[],
+    const FilterPlan *filterPlan,
+    CsvStats *stats)
 {
-  bool hasFilter = false;
-  for (size_t i = 0; i < totalRowFilters; i++)
-    if (rowFilters[i]->column == col)
+  while (*position < scanner->length)
+  {
+    uint64_t ticks = stats != NULL ? readTicks() : 0;
+    size_t cellCount = scanRow(scanner, position, cells, filterPlan->scanColumns);
+
+    if (!cellCount)
+      continue;
+
+    if (stats == NULL)
     {
-      hasFilter = true;
-      int comparison = strcmp(cell, rowFilters[i]->value);
-      switch (rowFilters[i]->op)
-      {
-      case EQUAL:
-        if (comparison == 0)
-          return true;
-        break;
-      case LESS:
-        if (comparison < 0)
-          return true;
-        break;
-      case GREATER:
-        if (comparison > 0)
-          return true;
-        break;
-      case NOT_EQUAL:
-        if (comparison != 0)
-          return true;
-        break;
-      case LESS_EQUAL:
-        if (comparison <= 0)
-          return true;
-        break;
-      case GREATER_EQUAL:
-        if (comparison >= 0)
-          return true;
-        break;
-      }
+      if (validateRow(cells, cellCount, filterPlan) == filterPlan->totalColumnFilters)
+        return cellCount;
+      continue;
+    }
+
+    stats->rowsScanned++;
+    ticks = lapTicks(&stats->scanTicks, ticks);
+
+    size_t rejectingFilter = validateRow(cells, cellCount, filterPlan);
+    bool isValid = rejectingFilter == filterPlan->totalColumnFilters;
+    if (!isValid)
+      countRejection(stats, &filterPlan->columnFilters[rejectingFilter]);
+
+    lapTicks(&stats->filterTicks, ticks);
+
+    if (isValid)
+    {
+      stats->rowsPassed++;
+      return cellCount;
     }
-  return !hasFilter;
+  }
+
+  return 0;
 }
 
 /**
- * Add cells from a row string to a CSV structure, considering row filters.
+ * Start filtering the rows of a columnar file.
  *
- * @param csvRow The CSV row string.
- * @param resultCsv The resulting CSV structure.
- * @param rowFilters Array of filters to be validated for each row.
- * @param totalRowFilters How many row filters there are in the array.
+ * @param scan The scan to be set up.
+ * @param file The columnar file.
+ * @param filterPlan The compiled filters, with their types resolved.
  */
-static void addFilteredRow(
-    char csvRow[],
-    Csv *csv,
-    RowFilter *rowFilters[],
-    size_t totalRowFilters)
+static void initColumnarScan(
+    ColumnarScan *scan,
+    const ColumnarFile *file,
+    const FilterPlan *filterPlan)
 {
-  addRow(csv);
-  size_t col = 0;
+  scan->file = file;
+  scan->row = 0;
+  scan->verdicts = (signed char **)calloc(
+      filterPlan->totalColumnFilters + 1,
+      sizeof(signed char *));
 
-  char *cell = csvRow;
-  char *cellEnd;
-  do
+  for (size_t i = 0; i < filterPlan->totalColumnFilters; i++)
+  {
+    const ColumnFilter *columnFilter = &filterPlan->columnFilters[i];
+    const ColumnarColumn *column = &file->columns[columnFilter->column];
+
+    if (column->encoding != DICTIONARY_ENCODING)
+      continue;
+
+    // Filters comparing two columns depend on more than the value of their cell
+    bool isSingleColumn = true;
+    for (size_t j = 0; j < columnFilter->totalRowFilters; j++)
+      isSingleColumn &= columnFilter->rowFilters[j]->otherColumn == NO_CELL;
+
+    if (!isSingleColumn)
+      continue;
+
+    scan->verdicts[i] = (signed char *)malloc(column->entryCount + 1);
+    memset(scan->verdicts[i], -1, column->entryCount + 1);
+  }
+}
+
+/**
+ * Free the memory of a columnar scan.
+ *
+ * @param scan The scan.
+ * @param filterPlan The compiled filters the scan was set up with.
+ */
+static void freeColumnarScan(ColumnarScan *scan, const FilterPlan *filterPlan)
+{
+  for (size_t i = 0; i < filterPlan->totalColumnFilters; i++)
+    free(scan->verdicts[i]);
+
+  free(scan->verdicts);
+}
+
+/**
+ * Validate whether the cell of a row of a columnar file respects the filters of its
+ * column. On dictionary encoded columns, each distinct value is only validated
+ * once.
+ *
+ * @param scan The scan, positioned on the row.
+ * @param filter Index of the column filter in the filter plan.
+ * @param cells Array with one view per cell of the row.
+ * @param cellCount How many cells the row has.
+ * @param columnFilter The filters of the column.
+ * @return bool Whether the cell of the column is valid for the filters or not.
+ */
+static bool validateColumnarFilter(
+    ColumnarScan *scan,
+    size_t filter,
+    const CellView cells[],
+    size_t cellCount,
+    const ColumnFilter *columnFilter)
+{
+  signed char *verdicts = scan->verdicts[filter];
+
+  if (verdicts == NULL)
+    return validateColumnFilter(cells, cellCount, columnFilter);
+
+  signed char *verdict = &verdicts[getColumnarCode(
+      scan->file,
+      &scan->file->columns[columnFilter->column],
+      scan->row)];
+
+  if (*verdict < 0)
+    *verdict = validateColumnFilter(cells, cellCount, columnFilter);
+
+  return *verdict;
+}
+
+/**
+ * Get the rows of a columnar file until one passes the filters, counting them like
+ * nextFilteredRow does.
+ *
+ * @param scan The scan, positioned on the next row, then moved past the one which
+ * passed.
+ * @param cells Array which will contain one view per cell of the row.
+ * @param filterPlan The compiled filters.
+ * @param stats Counters of the scanned and filtered rows, NULL to not count them.
+ * @return size_t How many cells the row which passed has, 0 when there are no
+ * rows left.
+ */
+static size_t nextColumnarRow(
+    ColumnarScan *scan,
+    CellView cells[],
+    const FilterPlan *filterPlan,
+    CsvStats *stats)
+{
+  for (; scan->row < scan->file->header->rowCount; scan->row++)
   {
-    cellEnd = strchr(cell, *VALUE_SEPARATOR);
-    if (cellEnd != NULL)
-      *cellEnd = '\0';
+    uint64_t ticks = stats != NULL ? readTicks() : 0;
+    size_t cellCount = getColumnarRow(scan->file, scan->row, cells, filterPlan->scanColumns);
+
+    if (!cellCount)
+      continue;
 
-    if (!validateFilters(cell, rowFilters, totalRowFilters, col))
+    if (stats != NULL)
     {
-      deleteRow(csv, csv->rowCount - 1);
-      break;
+      stats->rowsScanned++;
+      ticks = lapTicks(&stats->scanTicks, ticks);
+    }
+
+    size_t i = 0;
+    for (; i < filterPlan->totalColumnFilters; i++)
+    {
+      const ColumnFilter *columnFilter = &filterPlan->columnFilters[i];
+
+      if (columnFilter->column < cellCount &&
+          !validateColumnarFilter(scan, i, cells, cellCount, columnFilter))
+        break;
     }
 
-    if (csv->columns[col]->isSelected)
-      setCell(csv, csv->rowCount - 1, col, cell);
+    bool isValid = i == filterPlan->totalColumnFilters;
+
+    if (stats != NULL)
+    {
+      if (!isValid)
+        countRejection(stats, &filterPlan->columnFilters[i]);
+
+      lapTicks(&stats->filterTicks, ticks);
+      stats->rowsPassed += isValid;
+    }
 
-    col++;
+    if (isValid)
+    {
+      scan->row++;
+      return cellCount;
+    }
+  }
 
-    if (cellEnd != NULL)
-      cell = cellEnd + 1;
-  } while (cellEnd != NULL);
+  return 0;
 }
 
-void processCsv(
-    const char csv[],
-    const char selectedColumns[],
-    const char rowFilterDefinitions[])
+/**
+ * Check whether a column filter has filters declared with the auto type.
+ *
+ * @param columnFilter The filters of the column.
+ * @return bool Whether the type of some filter is still to be inferred.
+ */
+static bool isAutoColumnFilter(const ColumnFilter *columnFilter)
 {
-  Csv *resultCsv = createCsv();
-  bool success;
+  for (size_t i = 0; i < columnFilter->totalRowFilters; i++)
+    if (columnFilter->rowFilters[i]->type == AUTO)
+      return true;
+
+  return false;
+}
 
-  char *csvHeaders = strtok(strdup(csv), LINE_SEPARATOR);
-  addColumns(csvHeaders, selectedColumns, resultCsv, &success);
+/**
+ * Add a cell to the samples a column type is inferred from.
+ *
+ * @param samples Array with room for INFER_SAMPLE_ROWS samples.
+ * @param sampleCount How many samples there are, incremented.
+ * @param cell View of the cell, as it appears in the CSV.
+ */
+static void addInferSample(CellView samples[], size_t *sampleCount, const CellView *cell)
+{
+  CellView *sample = &samples[(*sampleCount)++];
+  *sample = *cell;
 
-  if (!success)
+  // Escaped quotes never appear in values of the other types
+  if (sample->length >= 2 &&
+      sample->value[0] == *QUOTE &&
+      sample->value[sample->length - 1] == *QUOTE)
   {
-    freeCsv(resultCsv);
-    return;
+    sample->value++;
+    sample->length -= 2;
   }
+}
+
+/**
+ * Set the type of the auto filters of a column to the type inferred from samples
+ * of its cells. Filters whose value is not valid for that type compare as text.
+ *
+ * @param columnFilter The filters of the column.
+ * @param samples The samples of the column.
+ * @param sampleCount How many samples there are.
+ */
+static void setAutoFilterTypes(
+    ColumnFilter *columnFilter,
+    const CellView samples[],
+    size_t sampleCount)
+{
+  enum cellType type = inferCellType(samples, sampleCount);
+
+  for (size_t i = 0; i < columnFilter->totalRowFilters; i++)
+    if (columnFilter->rowFilters[i]->type == AUTO &&
+        !setRowFilterType(columnFilter->rowFilters[i], type))
+      columnFilter->rowFilters[i]->type = TEXT;
+}
 
-  RowFilter *rowFilters[MAX_CSV_COLS] = {NULL};
-  size_t totalRowFilters = defineRowFilters(
-      rowFilterDefinitions,
-      resultCsv,
-      rowFilters,
-      &success);
+/**
+ * Resolve the type of the filters declared with the auto type, inferring the type
+ * of their columns from the first INFER_SAMPLE_ROWS rows of the data. Filters whose
+ * value is not valid for the inferred type compare as text.
+ *
+ * @param filterPlan The compiled filters.
+ * @param sample Pointer to the first row, not NUL-terminated.
+ * @param length The length of the sample.
+ * @param colCount How many columns the CSV has.
+ */
+static void inferFilterTypes(
+    FilterPlan *filterPlan,
+    const char *sample,
+    size_t length,
+    size_t colCount)
+{
+  CellView *cells = (CellView *)malloc(colCount * sizeof(CellView));
+  CellView samples[INFER_SAMPLE_ROWS];
 
-  if (!success)
+  for (size_t i = 0; i < filterPlan->totalColumnFilters; i++)
   {
-    freeCsv(resultCsv);
-    return;
-  }
+    ColumnFilter *columnFilter = &filterPlan->columnFilters[i];
+
+    if (!isAutoColumnFilter(columnFilter))
+      continue;
+
+    CsvScanner scanner;
+    initScanner(&scanner, sample, length);
 
-  strtok(strdup(csv), LINE_SEPARATOR); // Ignore header row
-  for (char *csvRow = strtok(NULL, LINE_SEPARATOR);
-       csvRow != NULL;
-       csvRow = strtok(NULL, LINE_SEPARATOR))
-    addFilteredRow(csvRow, resultCsv, rowFilters, totalRowFilters);
+    size_t position = 0, sampleCount = 0;
+    for (size_t row = 0; row < INFER_SAMPLE_ROWS && position < length; row++)
+      if (scanRow(&scanner, &position, cells, filterPlan->scanColumns) > columnFilter->column)
+        addInferSample(samples, &sampleCount, &cells[columnFilter->column]);
 
-  printCsv(resultCsv);
+    setAutoFilterTypes(columnFilter, samples, sampleCount);
+  }
 
-  for (size_t i = 0; i < totalRowFilters; i++)
-    free(rowFilters[i]);
-  freeCsv(resultCsv);
+  free(cells);
 }
 
-void processCsvFile(
-    const char csvFilePath[],
-    const char selectedColumns[],
-    const char rowFilterDefinitions[])
+/**
+ * Resolve the type of the filters declared with the auto type from the first
+ * INFER_SAMPLE_ROWS rows of a columnar file, like inferFilterTypes does for text.
+ *
+ * @param filterPlan The compiled filters.
+ * @param file The columnar file.
+ * @param colCount How many columns the CSV has.
+ */
+static void inferColumnarFilterTypes(
+    FilterPlan *filterPlan,
+    const ColumnarFile *file,
+    size_t colCount)
 {
-  Csv *resultCsv = createCsv();
-  bool success;
+  CellView *cells = (CellView *)malloc(colCount * sizeof(CellView));
+  CellView samples[INFER_SAMPLE_ROWS];
 
-  FILE *csvFile = fopen(csvFilePath, "r");
-  char buffer[BUFSIZ];
-  size_t currLen = 0, addLen;
-
-  if (!csvFile)
+  for (size_t i = 0; i < filterPlan->totalColumnFilters; i++)
   {
-    freeCsv(resultCsv);
-    return;
+    ColumnFilter *columnFilter = &filterPlan->columnFilters[i];
+
+    if (!isAutoColumnFilter(columnFilter))
+      continue;
+
+    size_t sampleCount = 0;
+    for (size_t row = 0; row < INFER_SAMPLE_ROWS && row < file->header->rowCount; row++)
+      if (getColumnarRow(file, row, cells, filterPlan->scanColumns) > columnFilter->column)
+        addInferSample(samples, &sampleCount, &cells[columnFilter->column]);
+
+    setAutoFilterTypes(columnFilter, samples, sampleCount);
   }
 
-  char rowPattern[5] = "%s";
-  strcat(rowPattern, LINE_SEPARATOR);
+  free(cells);
+}
 
-  char *csvHeaders = (char *)malloc(0);
-  do
+/**
+ * Store the selected cells of the rows of a buffer which pass the filters. Filters
+ * are checked on views into the buffer, so nothing is copied or allocated for
+ * rejected rows.
+ *
+ * @param data Pointer to the first row, not NUL-terminated.
+ * @param length The length of the buffer.
+ * @param csv The CSV structure in which the rows will be stored.
+ * @param cells Array with room for one cell view per column of the CSV.
+ * @param filterPlan The compiled filters.
+ * @param rowLimit The rows to skip and to store, updated as rows are stored.
+ * @param stats The counters to be added to, NULL to not count anything.
+ */
+static void addFilteredRows(
+    const char *data,
+    size_t length,
+    Csv *csv,
+    CellView cells[],
+    const FilterPlan *filterPlan,
+    RowLimit *rowLimit,
+    CsvStats *stats)
+{
+  CsvScanner scanner;
+  initScanner(&scanner, data, length);
+
+  size_t position = 0, cellCount;
+  while (rowLimit->count &&
+         (cellCount = nextFilteredRow(&scanner, &position, cells, filterPlan, stats)))
   {
-    fgets(buffer, BUFSIZ, csvFile);
-    addLen = strlen(buffer);
-    csvHeaders = (char *)realloc(csvHeaders, currLen + addLen);
-    strcpy(&csvHeaders[currLen], buffer);
-    currLen += addLen;
-  } while (csvHeaders[currLen - 1] != '\n');
-  csvHeaders[currLen - 1] = '\0';
+    if (rowLimit->offset)
+    {
+      rowLimit->offset--;
+      continue;
+    }
+
+    rowLimit->count--;
+    uint64_t ticks = stats != NULL ? readTicks() : 0;
 
-  addColumns(csvHeaders, selectedColumns, resultCsv, &success);
+    addRow(csv);
+    for (size_t col = 0; col < cellCount; col++)
+      if (csv->columns[col]->isSelected)
+        setCellView(csv, csv->rowCount - 1, col, &cells[col]);
 
-  if (!success)
+    if (stats != NULL)
+      lapTicks(&stats->outputTicks, ticks);
+  }
+}
+
+/**
+ * Print the rows of a buffer which pass the filters, without storing them. Once
+ * the row limit is reached, the rest of the buffer is not scanned.
+ *
+ * @param data Pointer to the first row, not NUL-terminated.
+ * @param length The length of the buffer.
+ * @param csv The CSV structure containing the columns.
+ * @param cells Array with room for one cell view per column of the CSV.
+ * @param filterPlan The compiled filters.
+ * @param sink The sink the rows are written to.
+ * @param rowLimit The rows to skip and to print, updated as rows are printed.
+ * @param stats The counters to be added to, NULL to not count anything.
+ * @return size_t How many rows were printed.
+ */
+static size_t printFilteredRows(
+    const char *data,
+    size_t length,
+    const Csv *csv,
+    CellView cells[],
+    const FilterPlan *filterPlan,
+    CsvSink *sink,
+    RowLimit *rowLimit,
+    CsvStats *stats)
+{
+  CsvScanner scanner;
+  initScanner(&scanner, data, length);
+
+  size_t position = 0, cellCount, rowCount = 0;
+  while (rowLimit->count &&
+         (cellCount = nextFilteredRow(&scanner, &position, cells, filterPlan, stats)))
   {
-    freeCsv(resultCsv);
-    return;
+    if (rowLimit->offset)
+    {
+      rowLimit->offset--;
+      continue;
+    }
+
+    rowLimit->count--;
+    rowCount++;
+    uint64_t ticks = stats != NULL ? readTicks() : 0;
+
+    for (size_t col = cellCount; col < csv->colCount; col++)
+    {
+      cells[col].value = "";
+      cells[col].length = 0;
+    }
+
+    printRow(csv, cells, sink);
+
+    if (stats != NULL)
+      lapTicks(&stats->outputTicks, ticks);
   }
 
-  free(csvHeaders);
+  return rowCount;
+}
 
-  RowFilter *rowFilters[MAX_CSV_COLS] = {NULL};
-  size_t totalRowFilters = defineRowFilters(
-      rowFilterDefinitions,
-      resultCsv,
-      rowFilters,
-      &success);
+/**
+ * Add the rows of a buffer which pass the filters to a sorter.
+ *
+ * @param data Pointer to the first row, not NUL-terminated.
+ * @param length The length of the buffer.
+ * @param cells Array with room for one cell view per column of the CSV.
+ * @param filterPlan The compiled filters.
+ * @param sorter The sorter the rows are added to.
+ * @param stats The counters to be added to, NULL to not count anything.
+ */
+static void sortFilteredRows(
+    const char *data,
+    size_t length,
+    CellView cells[],
+    const FilterPlan *filterPlan,
+    CsvSorter *sorter,
+    CsvStats *stats)
+{
+  CsvScanner scanner;
+  initScanner(&scanner, data, length);
 
-  if (!success)
+  size_t position = 0, cellCount;
+  while ((cellCount = nextFilteredRow(&scanner, &position, cells, filterPlan, stats)))
   {
-    freeCsv(resultCsv);
-    return;
+    uint64_t ticks = stats != NULL ? readTicks() : 0;
+
+    addSortedRow(sorter, cells, cellCount);
+
+    if (stats != NULL)
+      lapTicks(&stats->outputTicks, ticks);
   }
+}
 
-  bool eof = false;
-  while (!eof)
-  {
-    char *csvRow = (char *)malloc(0);
-    currLen = 0;
-    do
-    {
-      if ((eof = !fgets(buffer, BUFSIZ, csvFile)))
-        break;
+/**
+ * Add the rows of a buffer which pass the filters to their groups.
+ *
+ * @param data Pointer to the first row, not NUL-terminated.
+ * @param length The length of the buffer.
+ * @param cells Array with room for one cell view per column of the CSV.
+ * @param filterPlan The compiled filters.
+ * @param aggregator The aggregator the rows are added to.
+ * @param row Position of the next row in the input, incremented for each row added.
+ * @param stats The counters to be added to, NULL to not count anything.
+ */
+static void aggregateFilteredRows(
+    const char *data,
+    size_t length,
+    CellView cells[],
+    const FilterPlan *filterPlan,
+    CsvAggregator *aggregator,
+    uint64_t *row,
+    CsvStats *stats)
+{
+  CsvScanner scanner;
+  initScanner(&scanner, data, length);
 
-      addLen = strlen(buffer);
-      csvRow = (char *)realloc(csvRow, currLen + addLen);
-      strcpy(&csvRow[currLen], buffer);
-      currLen += addLen;
-    } while (csvRow[currLen - 1] != '\n');
-    csvRow[currLen - 1] = '\0';
+  size_t position = 0, cellCount;
+  while ((cellCount = nextFilteredRow(&scanner, &position, cells, filterPlan, stats)))
+  {
+    uint64_t ticks = stats != NULL ? readTicks() : 0;
 
-    if (!eof)
-      addFilteredRow(csvRow, resultCsv, rowFilters, totalRowFilters);
+    addAggregatedRow(aggregator, cells, cellCount, (*row)++);
 
-    free(csvRow);
+    if (stats != NULL)
+      lapTicks(&stats->outputTicks, ticks);
   }
+}
+
+/**
+ * Create the aggregator of a bound query.
+ *
+ * @param query The bound query.
+ * @return CsvAggregator* The aggregator, or NULL if the query is not aggregated.
+ */
+static CsvAggregator *createQueryAggregator(const CsvQuery *query)
+{
+  if (!isAggregatedQuery(query))
+    return NULL;
+
+  return createAggregator(
+      query->groupColumns,
+      query->totalGroupColumns,
+      query->aggregates,
+      query->totalAggregates);
+}
 
-  printCsv(resultCsv);
+/**
+ * Write the groups of an aggregator to a sink and free it.
+ *
+ * @param aggregator The aggregator.
+ * @param query The bound query of the aggregator.
+ * @param sink The sink the groups are written to.
+ * @param stats The counters to be added to, NULL to not count anything.
+ */
+static void printAggregator(
+    CsvAggregator *aggregator,
+    const CsvQuery *query,
+    CsvSink *sink,
+    CsvStats *stats)
+{
+  uint64_t ticks = stats != NULL ? readTicks() : 0;
 
-  for (size_t i = 0; i < totalRowFilters; i++)
-    free(rowFilters[i]);
-  freeCsv(resultCsv);
+  printAggregatedRows(
+      aggregator,
+      query->csv,
+      query->aggregateLabels,
+      query->offset,
+      query->limit,
+      sink);
+  freeAggregator(aggregator);
 
-  fclose(csvFile);
+  if (stats != NULL)
+    lapTicks(&stats->outputTicks, ticks);
+}
+
+/**
+ * Get the rows to skip and to write of an unordered query.
+ *
+ * @param query The query.
+ * @return RowLimit The offset and limit of the query.
+ */
+static RowLimit getRowLimit(const CsvQuery *query)
+{
+  RowLimit rowLimit = {query->offset, query->limit ? query->limit : SIZE_MAX};
+  return rowLimit;
+}
+
+/**
+ * Create the sorter of a bound query.
+ *
+ * @param query The bound query.
+ * @return CsvSorter* The sorter, or NULL if the query is not ordered.
+ */
+static CsvSorter *createQuerySorter(const CsvQuery *query)
+{
+  if (!query->totalSortKeys)
+    return NULL;
+
+  return createSorter(
+      query->csv,
+      query->sortKeys,
+      query->totalSortKeys,
+      query->sortMemory,
+      query->offset,
+      query->limit);
+}
+
+/**
+ * Write the rows of a sorter to a sink and free it.
+ *
+ * @param sorter The sorter.
+ * @param sink The sink the rows are written to.
+ * @param stats The counters to be added to, NULL to not count anything.
+ */
+static void printSorter(CsvSorter *sorter, CsvSink *sink, CsvStats *stats)
+{
+  uint64_t ticks = stats != NULL ? readTicks() : 0;
+
+  printSortedRows(sorter, sink);
+
+  if (stats != NULL)
+  {
+    stats->cellsCopied += sorter->cellsCopied;
+    lapTicks(&stats->outputTicks, ticks);
+  }
+
+  freeSorter(sorter);
+}
+
+/**
+ * Find the first line separator outside quoted fields at or after an offset.
+ *
+ * @param data Pointer to the first row.
+ * @param length The length of the buffer.
+ * @param start Offset of the start of a row.
+ * @param offset Offset from which to look for the line separator.
+ * @return size_t The offset right after the line separator, or the length of the
+ * buffer if there is none.
+ */
+static size_t findRowEnd(const char *data, size_t length, size_t start, size_t offset)
+{
+  // Quotes before the offset decide whether it is inside a quoted field
+  size_t quotes = countQuotes(&data[start], offset - start);
+
+  while (offset < length)
+  {
+    const char *rowEnd = memchr(&data[offset], *LINE_SEPARATOR, length - offset);
+
+    if (rowEnd == NULL)
+      break;
+
+    size_t end = rowEnd - data;
+    quotes += countQuotes(&data[offset], end - offset);
+
+    if (quotes % 2 == 0)
+      return end + 1;
+
+    offset = end + 1;
+  }
+
+  return length;
+}
+
+/**
+ * Find the end of the header row of a CSV. Quoted headers may contain line
+ * separators, so the header row is found like any other row.
+ *
+ * @param data Pointer to the header row, not NUL-terminated.
+ * @param length The length of the CSV.
+ * @param headersLength Will be set to the length of the header row, without its
+ * line separator.
+ * @return size_t Offset of the first row after the header row, length if there is
+ * none.
+ */
+static size_t findHeadersEnd(const char *data, size_t length, size_t *headersLength)
+{
+  size_t rowsOffset = findRowEnd(data, length, 0, 0);
+  *headersLength = rowsOffset - (rowsOffset && data[rowsOffset - 1] == *LINE_SEPARATOR);
+  return rowsOffset;
+}
+
+/**
+ * Split ranges of CSV rows into chunks of about PARALLEL_CHUNK_SIZE bytes, each
+ * one ending at a line separator outside quoted fields.
+ *
+ * @param data Pointer to the buffer of the ranges.
+ * @param ranges The ranges of rows to be split, each starting at a row.
+ * @param rangeCount How many ranges there are.
+ * @param chunkCount Will be set to how many chunks were created.
+ * @return CsvChunk* Array with the created chunks.
+ */
+static CsvChunk *splitChunks(
+    const char *data,
+    const ByteRange ranges[],
+    size_t rangeCount,
+    size_t *chunkCount)
+{
+  size_t maxChunkCount = 0;
+  for (size_t i = 0; i < rangeCount; i++)
+    maxChunkCount += ranges[i].length / PARALLEL_CHUNK_SIZE + 1;
+
+  CsvChunk *chunks = (CsvChunk *)malloc(maxChunkCount * sizeof(CsvChunk));
+
+  *chunkCount = 0;
+  for (size_t i = 0; i < rangeCount; i++)
+  {
+    const char *rows = &data[ranges[i].offset];
+    size_t length = ranges[i].length;
+    size_t start = 0;
+
+    while (start < length)
+    {
+      size_t end = length;
+
+      if (length - start > PARALLEL_CHUNK_SIZE)
+        end = findRowEnd(rows, length, start, start + PARALLEL_CHUNK_SIZE);
+
+      CsvChunk *chunk = &chunks[(*chunkCount)++];
+      chunk->data = &rows[start];
+      chunk->length = end - start;
+      chunk->output = NULL;
+      chunk->outputLength = 0;
+      chunk->rowCount = 0;
+      chunk->isDone = false;
+
+      start = end;
+    }
+  }
+
+  return chunks;
+}
+
+/**
+ * Add the counters of a worker to the counters of a run.
+ *
+ * @param stats The counters of the run.
+ * @param workerStats The counters of the worker.
+ */
+static void addCsvStats(CsvStats *stats, const CsvStats *workerStats)
+{
+  stats->bytesRead += workerStats->bytesRead;
+  stats->bytesWritten += workerStats->bytesWritten;
+  stats->rowsScanned += workerStats->rowsScanned;
+  stats->rowsPassed += workerStats->rowsPassed;
+  for (size_t i = 0; i < CSV_STATS_MAX_FILTERS; i++)
+    stats->rowsRejected[i] += workerStats->rowsRejected[i];
+  stats->rowsRejectedPastMaxFilters += workerStats->rowsRejectedPastMaxFilters;
+  stats->cellsCopied += workerStats->cellsCopied;
+  stats->allocations += workerStats->allocations;
+  stats->setupTicks += workerStats->setupTicks;
+  stats->readTicks += workerStats->readTicks;
+  stats->scanTicks += workerStats->scanTicks;
+  stats->filterTicks += workerStats->filterTicks;
+  stats->outputTicks += workerStats->outputTicks;
+  stats->wallNanoseconds += workerStats->wallNanoseconds;
+}
+
+/**
+ * Worker thread which filters chunks into their own in-memory output, never
+ * getting more than maxChunksAhead chunks in front of the writer.
+ *
+ * @param arg The ParallelCsv shared by all the workers.
+ * @return void* Always NULL.
+ */
+static void *processChunks(void *arg)
+{
+  ParallelCsv *parallel = (ParallelCsv *)arg;
+  CellView *cells = (CellView *)malloc(parallel->csv->colCount * sizeof(CellView));
+  CsvStats workerStats = {0};
+  CsvStats *stats = parallel->stats != NULL ? &workerStats : NULL;
+  const CsvAggregator *aggregator = parallel->aggregator;
+  CsvAggregator *partial = aggregator != NULL
+                               ? createAggregator(
+                                     aggregator->groupColumns,
+                                     aggregator->groupCount,
+                                     aggregator->aggregates,
+                                     aggregator->aggregateCount)
+                               : NULL;
+
+  pthread_mutex_lock(&parallel->lock);
+  while (parallel->nextChunk < parallel->chunkCount)
+  {
+    size_t index = parallel->nextChunk;
+
+    if (index >= parallel->writtenChunks + parallel->maxChunksAhead)
+    {
+      pthread_cond_wait(&parallel->chunkWritten, &parallel->lock);
+      continue;
+    }
+
+    parallel->nextChunk++;
+    pthread_mutex_unlock(&parallel->lock);
+
+    CsvChunk *chunk = &parallel->chunks[index];
+
+    if (partial != NULL)
+    {
+      // Rows are numbered by chunk, so groups keep the order of their first row
+      uint64_t row = (uint64_t)index << 32;
+      aggregateFilteredRows(
+          chunk->data,
+          chunk->length,
+          cells,
+          parallel->filterPlan,
+          partial,
+          &row,
+          stats);
+    }
+    else
+    {
+      CsvSink *output = createGrowingSink();
+      RowLimit rowLimit = {0, parallel->chunkRowLimit};
+      chunk->rowCount = printFilteredRows(
+          chunk->data,
+          chunk->length,
+          parallel->csv,
+          cells,
+          parallel->filterPlan,
+          output,
+          &rowLimit,
+          stats);
+      chunk->output = takeSinkBuffer(output, &chunk->outputLength);
+      workerStats.allocations += output->allocations;
+      freeSink(output);
+    }
+
+    pthread_mutex_lock(&parallel->lock);
+    chunk->isDone = true;
+    pthread_cond_broadcast(&parallel->chunkDone);
+  }
+
+  if (stats != NULL)
+    addCsvStats(parallel->stats, stats);
+  if (partial != NULL)
+    mergeAggregator(parallel->aggregator, partial);
+  pthread_mutex_unlock(&parallel->lock);
+
+  if (partial != NULL)
+    freeAggregator(partial);
+  free(cells);
+  return NULL;
+}
+
+/**
+ * Print the filtered rows of ranges of a buffer using several worker threads.
+ * Chunks are written to the sink as soon as they and all the chunks before them are
+ * done, so the rows keep their original order. Once the row limit is reached, no
+ * more chunks are handed to the workers.
+ *
+ * With an aggregator, each worker groups the rows of its chunks instead, and
+ * merges its groups into the aggregator once there are no chunks left.
+ *
+ * @param data Pointer to the buffer of the ranges, not NUL-terminated.
+ * @param ranges The ranges of rows to be filtered, each starting at a row.
+ * @param rangeCount How many ranges there are.
+ * @param csv The CSV structure containing the columns.
+ * @param filterPlan The compiled filters.
+ * @param workerCount How many worker threads to start.
+ * @param sink The sink the rows are written to.
+ * @param rowLimit The rows to skip and to print, updated as rows are printed.
+ * @param aggregator The aggregator receiving the groups, NULL to print the rows.
+ * @param stats The counters to be added to, NULL to not count anything.
+ * @return bool Whether any worker thread could be started. Otherwise nothing was
+ * filtered, and the rows are left to the calling thread.
+ */
+static bool printFilteredRowsParallel(
+    const char *data,
+    const ByteRange ranges[],
+    size_t rangeCount,
+    const Csv *csv,
+    const FilterPlan *filterPlan,
+    size_t workerCount,
+    CsvSink *sink,
+    RowLimit *rowLimit,
+    CsvAggregator *aggregator,
+    CsvStats *stats)
+{
+  ParallelCsv parallel;
+  parallel.csv = csv;
+  parallel.filterPlan = filterPlan;
+  parallel.stats = stats;
+  parallel.aggregator = aggregator;
+  // A single chunk may hold all the skipped rows and the printed ones
+  parallel.chunkRowLimit = rowLimit->count > SIZE_MAX - rowLimit->offset
+                               ? SIZE_MAX
+                               : rowLimit->offset + rowLimit->count;
+  parallel.chunks = splitChunks(data, ranges, rangeCount, &parallel.chunkCount);
+  parallel.nextChunk = 0;
+  parallel.writtenChunks = 0;
+  parallel.maxChunksAhead = workerCount * PARALLEL_CHUNKS_PER_WORKER;
+  pthread_mutex_init(&parallel.lock, NULL);
+  pthread_cond_init(&parallel.chunkDone, NULL);
+  pthread_cond_init(&parallel.chunkWritten, NULL);
+
+  if (workerCount > parallel.chunkCount)
+    workerCount = parallel.chunkCount;
+
+  pthread_t *workers = (pthread_t *)malloc(workerCount * sizeof(pthread_t));
+  size_t startedWorkers = 0;
+
+  while (startedWorkers < workerCount &&
+         pthread_create(&workers[startedWorkers], NULL, processChunks, &parallel) == 0)
+    startedWorkers++;
+
+  // Workers add their counters to stats, so the writing time is only added once
+  // they are done
+  uint64_t writeTicks = 0;
+  for (size_t i = 0; startedWorkers && i < parallel.chunkCount; i++)
+  {
+    CsvChunk *chunk = &parallel.chunks[i];
+
+    pthread_mutex_lock(&parallel.lock);
+    while (!chunk->isDone)
+      pthread_cond_wait(&parallel.chunkDone, &parallel.lock);
+    pthread_mutex_unlock(&parallel.lock);
+
+    uint64_t ticks = stats != NULL ? readTicks() : 0;
+    size_t start = 0, end = chunk->outputLength;
+
+    if (chunk->rowCount <= rowLimit->offset)
+    {
+      rowLimit->offset -= chunk->rowCount;
+      start = end;
+    }
+    else
+    {
+      // Output rows may hold quoted line separators, so they are found like
+      // input rows
+      size_t rowCount = chunk->rowCount - rowLimit->offset;
+
+      for (; rowLimit->offset; rowLimit->offset--)
+        start = findRowEnd(chunk->output, chunk->outputLength, start, start);
+
+      if (rowCount > rowLimit->count)
+      {
+        rowCount = rowLimit->count;
+        end = start;
+        for (size_t row = 0; row < rowCount; row++)
+          end = findRowEnd(chunk->output, chunk->outputLength, end, end);
+      }
+
+      rowLimit->count -= rowCount;
+    }
+
+    if (end > start)
+      writeSink(sink, &chunk->output[start], end - start);
+    free(chunk->output);
+
+    if (stats != NULL)
+      lapTicks(&writeTicks, ticks);
+
+    pthread_mutex_lock(&parallel.lock);
+    parallel.writtenChunks = i + 1;
+    // Chunks which were not handed to a worker yet are dropped
+    if (!rowLimit->count)
+      parallel.chunkCount = parallel.nextChunk;
+    pthread_cond_broadcast(&parallel.chunkWritten);
+    pthread_mutex_unlock(&parallel.lock);
+  }
+
+  for (size_t i = 0; i < startedWorkers; i++)
+    pthread_join(workers[i], NULL);
+
+  if (stats != NULL)
+    stats->outputTicks += writeTicks;
+
+  free(workers);
+  free(parallel.chunks);
+  pthread_mutex_destroy(&parallel.lock);
+  pthread_cond_destroy(&parallel.chunkDone);
+  pthread_cond_destroy(&parallel.chunkWritten);
+  return startedWorkers > 0;
+}
+
+/**
+ * Process a CSV held in memory, such as a mapped file. Cells are views into the
+ * buffer, so each input byte is only touched while scanning and no cell is copied.
+ *
+ * With an index of the buffer, only the blocks of rows which may pass the filters
+ * are scanned.
+ *
+ * @param data The buffer with the CSV, including the header row.
+ * @param length The length of the buffer.
+ * @param index The index of the buffer, NULL to scan every row.
+ * @param query The query to be run.
+ * @param sink The sink the result is written to.
+ * @return bool Whether the query could be bound to the headers of the CSV.
+ */
+static bool processCsvBuffer(
+    const char *data,
+    size_t length,
+    const CsvIndex *index,
+    CsvQuery *query,
+    CsvSink *sink)
+{
+  CsvStats *stats = query->stats;
+  uint64_t ticks = stats != NULL ? readTicks() : 0;
+
+  size_t headersLength;
+  size_t rowsOffset = findHeadersEnd(data, length, &headersLength);
+
+  if (!bindCsvQuery(query, data, headersLength))
+    return false;
+
+  Csv *csv = query->csv;
+  FilterPlan *filterPlan = query->filterPlan;
+  inferFilterTypes(filterPlan, &data[rowsOffset], length - rowsOffset, csv->colCount);
+
+  ByteRange allRows = {rowsOffset, length - rowsOffset};
+  ByteRange *ranges = &allRows;
+  size_t rangeCount = rowsOffset < length;
+
+  // Blocks are skipped once the filters have their type
+  if (index != NULL &&
+      rangeCount &&
+      filterPlan->totalColumnFilters &&
+      index->header.columnCount == csv->colCount)
+  {
+    ranges = (ByteRange *)malloc(index->header.blockCount * sizeof(ByteRange));
+    rangeCount = findIndexRanges(index, filterPlan, ranges);
+  }
+
+  if (stats != NULL)
+  {
+    stats->bytesRead += rowsOffset;
+    for (size_t i = 0; i < rangeCount; i++)
+      stats->bytesRead += ranges[i].length;
+    lapTicks(&stats->setupTicks, ticks);
+  }
+
+  CsvAggregator *aggregator = createQueryAggregator(query);
+  RowLimit rowLimit = getRowLimit(query);
+
+  if (aggregator == NULL)
+    printHeaders(csv, sink);
+
+  if (aggregator != NULL)
+  {
+    // Groups are only limited once they are all known
+    RowLimit allGroups = {0, SIZE_MAX};
+
+    // Rows are grouped by the calling thread when no worker can be started
+    if (!rangeCount ||
+        query->workerCount <= 1 ||
+        !printFilteredRowsParallel(
+            data,
+            ranges,
+            rangeCount,
+            csv,
+            filterPlan,
+            query->workerCount,
+            sink,
+            &allGroups,
+            aggregator,
+            stats))
+    {
+      CellView *cells = (CellView *)malloc(csv->colCount * sizeof(CellView));
+      uint64_t row = 0;
+
+      for (size_t i = 0; i < rangeCount; i++)
+        aggregateFilteredRows(
+            &data[ranges[i].offset],
+            ranges[i].length,
+            cells,
+            filterPlan,
+            aggregator,
+            &row,
+            stats);
+
+      free(cells);
+    }
+
+    printAggregator(aggregator, query, sink, stats);
+  }
+  else if (query->totalSortKeys)
+  {
+    CellView *cells = (CellView *)malloc(csv->colCount * sizeof(CellView));
+    CsvSorter *sorter = createQuerySorter(query);
+
+    for (size_t i = 0; i < rangeCount; i++)
+      sortFilteredRows(
+          &data[ranges[i].offset],
+          ranges[i].length,
+          cells,
+          filterPlan,
+          sorter,
+          stats);
+
+    printSorter(sorter, sink, stats);
+    free(cells);
+  }
+  else if (!rangeCount ||
+           query->workerCount <= 1 ||
+           !printFilteredRowsParallel(
+               data,
+               ranges,
+               rangeCount,
+               csv,
+               filterPlan,
+               query->workerCount,
+               sink,
+               &rowLimit,
+               NULL,
+               stats))
+  {
+    CellView *cells = (CellView *)malloc(csv->colCount * sizeof(CellView));
+
+    for (size_t i = 0; i < rangeCount && rowLimit.count; i++)
+      printFilteredRows(
+          &data[ranges[i].offset],
+          ranges[i].length,
+          csv,
+          cells,
+          filterPlan,
+          sink,
+          &rowLimit,
+          stats);
+
+    free(cells);
+  }
+
+  if (ranges != &allRows)
+    free(ranges);
+
+  return true;
+}
+
+/**
+ * Process a columnar file held in memory, as converted by convertCsvFileToColumnar.
+ * Cells are views into the buffer, so no text is parsed, and filters on dictionary
+ * encoded columns are validated once per distinct value. Rows are processed on a
+ * single thread.
+ *
+ * @param data The buffer with the columnar file.
+ * @param length The length of the buffer.
+ * @param query The query to be run.
+ * @param sink The sink the result is written to.
+ * @return bool Whether the file is valid and the query could be bound to its
+ * headers.
+ */
+static bool processColumnarBuffer(
+    const char *data,
+    size_t length,
+    CsvQuery *query,
+    CsvSink *sink)
+{
+  CsvStats *stats = query->stats;
+  uint64_t ticks = stats != NULL ? readTicks() : 0;
+  ColumnarFile file;
+
+  if (!openColumnarFile(&file, data, length))
+  {
+    fprintf(stderr, "Invalid columnar file\n");
+    return false;
+  }
+
+  if (!bindCsvQuery(query, &data[file.header->headersOffset], file.header->headersLength))
+    return false;
+
+  Csv *csv = query->csv;
+  FilterPlan *filterPlan = query->filterPlan;
+
+  inferColumnarFilterTypes(filterPlan, &file, csv->colCount);
+
+  if (stats != NULL)
+  {
+    stats->bytesRead += length;
+    lapTicks(&stats->setupTicks, ticks);
+  }
+
+  CsvAggregator *aggregator = createQueryAggregator(query);
+  CsvSorter *sorter = aggregator == NULL ? createQuerySorter(query) : NULL;
+  CellView *cells = (CellView *)malloc(csv->colCount * sizeof(CellView));
+  ColumnarScan scan;
+  uint64_t row = 0;
+  size_t cellCount;
+
+  // Sorted and aggregated rows are only limited once they are all known
+  RowLimit allRows = {0, SIZE_MAX};
+  RowLimit rowLimit = aggregator == NULL && sorter == NULL ? getRowLimit(query) : allRows;
+
+  if (aggregator == NULL)
+    printHeaders(csv, sink);
+
+  initColumnarScan(&scan, &file, filterPlan);
+  while (rowLimit.count && (cellCount = nextColumnarRow(&scan, cells, filterPlan, stats)))
+  {
+    if (rowLimit.offset)
+    {
+      rowLimit.offset--;
+      continue;
+    }
+
+    ticks = stats != NULL ? readTicks() : 0;
+
+    if (aggregator != NULL)
+      addAggregatedRow(aggregator, cells, cellCount, row++);
+    else if (sorter != NULL)
+      addSortedRow(sorter, cells, cellCount);
+    else
+    {
+      rowLimit.count--;
+
+      for (size_t col = cellCount; col < csv->colCount; col++)
+      {
+        cells[col].value = "";
+        cells[col].length = 0;
+      }
+
+      printRow(csv, cells, sink);
+    }
+
+    if (stats != NULL)
+      lapTicks(&stats->outputTicks, ticks);
+  }
+  freeColumnarScan(&scan, filterPlan);
+
+  if (aggregator != NULL)
+    printAggregator(aggregator, query, sink, stats);
+  else if (sorter != NULL)
+    printSorter(sorter, sink, stats);
+
+  free(cells);
+  return true;
+}
+
+/**
+ * Read the next complete rows of a stream, counting the time and bytes read.
+ *
+ * @param stream The stream.
+ * @param minRows The fewest rows to read before the end of the file.
+ * @param rows Will be set to the first row, valid until the next read.
+ * @param stats The counters to be added to, NULL to not count anything.
+ * @return size_t The length of the rows, 0 when there are no rows left.
+ */
+static size_t readRows(InputStream *stream, size_t minRows, const char **rows, CsvStats *stats)
+{
+  uint64_t ticks = stats != NULL ? readTicks() : 0;
+  size_t length = readStreamRows(stream, minRows, rows);
+
+  if (stats != NULL)
+  {
+    lapTicks(&stats->readTicks, ticks);
+    stats->bytesRead += length;
+  }
+
+  return length;
+}
+
+/**
+ * Read the header row of a stream, along with the rows used to infer the type of
+ * auto filters. Without auto filters, rows are not waited for, so a pipe whose
+ * writer is idle does not hold back the rows written so far.
+ *
+ * @param stream The stream.
+ * @param query The query to be bound to the header row.
+ * @param rows Will be set to the header row, valid until the next read.
+ * @return size_t The length of the rows, 0 for an empty file.
+ */
+static size_t readFirstRows(InputStream *stream, const CsvQuery *query, const char **rows)
+{
+  size_t minRows = query->hasAutoFilters ? 1 + INFER_SAMPLE_ROWS : 1;
+  return readRows(stream, minRows, rows, query->stats);
+}
+
+/**
+ * Bind a query to the header row of the first rows read from a stream, and infer
+ * the type of its auto filters from the rows after it.
+ *
+ * @param query The query to be bound.
+ * @param rows The first rows, will be moved past the header row.
+ * @param rowsLength The length of the rows, will be reduced by the header row.
+ * @return bool Whether the query could be bound to the headers of the CSV.
+ */
+static bool bindStreamedCsv(CsvQuery *query, const char **rows, size_t *rowsLength)
+{
+  CsvStats *stats = query->stats;
+  uint64_t ticks = stats != NULL ? readTicks() : 0;
+  size_t headersLength;
+  size_t rowsOffset = findHeadersEnd(*rows, *rowsLength, &headersLength);
+
+  if (!bindCsvQuery(query, rowsOffset ? *rows : "", headersLength))
+    return false;
+
+  *rows += rowsOffset;
+  *rowsLength -= rowsOffset;
+  inferFilterTypes(query->filterPlan, *rows, *rowsLength, query->csv->colCount);
+  if (stats != NULL)
+    lapTicks(&stats->setupTicks, ticks);
+
+  return true;
+}
+
+/**
+ * Process a CSV file which cannot be mapped in memory (e.g. a pipe or a compressed
+ * file), parsing the rows of each buffer while the next buffers are being read.
+ *
+ * @param stream The opened stream of the CSV file.
+ * @param query The query to be run.
+ * @param sink The sink the result is written to.
+ * @return bool Whether the query could be bound to the headers of the CSV.
+ */
+static bool processStreamedCsv(InputStream *stream, CsvQuery *query, CsvSink *sink)
+{
+  CsvStats *stats = query->stats;
+  const char *rows;
+  size_t rowsLength = readFirstRows(stream, query, &rows);
+
+  if (rowsLength == 0)
+    return true;
+
+  if (!bindStreamedCsv(query, &rows, &rowsLength))
+    return false;
+
+  Csv *csv = query->csv;
+  FilterPlan *filterPlan = query->filterPlan;
+  CellView *cells = (CellView *)malloc(csv->colCount * sizeof(CellView));
+
+  CsvSorter *sorter = createQuerySorter(query);
+  CsvAggregator *aggregator = createQueryAggregator(query);
+  RowLimit rowLimit = getRowLimit(query);
+  uint64_t row = 0;
+
+  if (aggregator == NULL)
+    printHeaders(csv, sink);
+
+  // Unordered queries stop reading once their limit is reached
+  do
+    if (sorter != NULL)
+      sortFilteredRows(rows, rowsLength, cells, filterPlan, sorter, stats);
+    else if (aggregator != NULL)
+      aggregateFilteredRows(rows, rowsLength, cells, filterPlan, aggregator, &row, stats);
+    else
+      printFilteredRows(rows, rowsLength, csv, cells, filterPlan, sink, &rowLimit, stats);
+  while ((sorter != NULL || aggregator != NULL || rowLimit.count) &&
+         (rowsLength = readRows(stream, 1, &rows, stats)) > 0);
+
+  if (sorter != NULL)
+    printSorter(sorter, sink, stats);
+  if (aggregator != NULL)
+    printAggregator(aggregator, query, sink, stats);
+
+  free(cells);
+  return true;
+}
+
+/**
+ * Process a CSV string by storing the selected cells of the rows which pass the
+ * filters, then printing the stored CSV.
+ *
+ * @param csv The CSV data to be processed.
+ * @param query The query to be run.
+ * @param sink The sink the result is written to.
+ * @return bool Whether the query could be bound to the headers of the CSV.
+ */
+static bool processStoredCsv(const char csv[], CsvQuery *query, CsvSink *sink)
+{
+  CsvStats *stats = query->stats;
+  uint64_t ticks = stats != NULL ? readTicks() : 0;
+
+  const char *csvStart = csv + strspn(csv, LINE_SEPARATOR);
+  size_t headersLength, csvLength = strlen(csvStart);
+  size_t rowsOffset = findHeadersEnd(csvStart, csvLength, &headersLength);
+  const char *csvRows = &csvStart[rowsOffset];
+  size_t rowsLength = csvLength - rowsOffset;
+
+  if (!bindCsvQuery(query, csvStart, headersLength))
+    return false;
+
+  Csv *resultCsv = query->csv;
+  FilterPlan *filterPlan = query->filterPlan;
+  CellView *cells = (CellView *)malloc(resultCsv->colCount * sizeof(CellView));
+  size_t allocations = resultCsv->allocations;
+  size_t cellsCopied = resultCsv->cellsCopied;
+
+  inferFilterTypes(filterPlan, csvRows, rowsLength, resultCsv->colCount);
+
+  if (stats != NULL)
+  {
+    stats->bytesRead += (size_t)(csvRows - csv) + rowsLength;
+    lapTicks(&stats->setupTicks, ticks);
+  }
+
+  RowLimit rowLimit = getRowLimit(query);
+
+  addFilteredRows(csvRows, rowsLength, resultCsv, cells, filterPlan, &rowLimit, stats);
+
+  ticks = stats != NULL ? readTicks() : 0;
+  printCsv(resultCsv, sink);
+
+  if (stats != NULL)
+  {
+    stats->allocations += resultCsv->allocations - allocations;
+    stats->cellsCopied += resultCsv->cellsCopied - cellsCopied;
+    lapTicks(&stats->outputTicks, ticks);
+  }
+
+  free(cells);
+  return true;
+}
+
+/**
+ * Counters of a run of a query, taken when the run starts.
+ */
+typedef struct
+{
+  struct timespec start;
+  size_t bytesWritten;
+} RunStart;
+
+/**
+ * Take the counters of a query when a run starts.
+ *
+ * @param sink The sink the result is written to.
+ * @return RunStart The counters at the start of the run.
+ */
+static RunStart startRun(const CsvSink *sink)
+{
+  RunStart run;
+  clock_gettime(CLOCK_MONOTONIC, &run.start);
+  run.bytesWritten = getSinkLength(sink);
+  return run;
+}
+
+/**
+ * Add the wall time and output of a finished run to the counters of its query.
+ *
+ * @param query The query.
+ * @param sink The sink the result was written to.
+ * @param run The counters at the start of the run.
+ */
+static void endRun(const CsvQuery *query, const CsvSink *sink, const RunStart *run)
+{
+  CsvStats *stats = query->stats;
+  struct timespec end;
+  clock_gettime(CLOCK_MONOTONIC, &end);
+
+  stats->wallNanoseconds += (uint64_t)(end.tv_sec - run->start.tv_sec) * 1000000000 +
+                            end.tv_nsec - run->start.tv_nsec;
+  stats->bytesWritten += getSinkLength(sink) - run->bytesWritten;
+}
+
+/**
+ * Unmap a file which turns out to be compressed, as it is then streamed through
+ * a decompressing thread instead.
+ *
+ * @param data The mapping of the file, set to MAP_FAILED if the file is compressed.
+ * @param length The length of the file.
+ * @return enum compression The compression of the file, NO_COMPRESSION if it is
+ * not compressed or not mapped.
+ */
+static enum compression unmapCompressedFile(void **data, size_t length)
+{
+  if (*data == MAP_FAILED)
+    return NO_COMPRESSION;
+
+  enum compression compression = detectCompression(*data, length);
+
+  if (compression != NO_COMPRESSION)
+  {
+    munmap(*data, length);
+    *data = MAP_FAILED;
+  }
+
+  return compression;
+}
+
+/**
+ * Run a query on CSV data.
+ *
+ * @param query The query to be run.
+ * @param csv The CSV data to be processed.
+ * @param sink The sink the result is written to.
+ * @return bool Whether every header of the query was found in the CSV.
+ */
+static bool runQuery(CsvQuery *query, const char csv[], CsvSink *sink)
+{
+  // Ordered and aggregated rows are collected by a sorter or aggregator instead
+  // of being stored
+  if (query->workerCount > 1 || query->totalSortKeys || isAggregatedQuery(query))
+    return processCsvBuffer(csv, strlen(csv), NULL, query, sink);
+
+  return processStoredCsv(csv, query, sink);
+}
+
+/**
+ * Run a query on a CSV file, mapping it in memory when possible.
+ *
+ * @param query The query to be run.
+ * @param csvFilePath The file path of the CSV to be processed.
+ * @param sink The sink the result is written to.
+ * @return bool Whether the file could be read and every header of the query was
+ * found in it.
+ */
+static bool runQueryFile(CsvQuery *query, const char csvFilePath[], CsvSink *sink)
+{
+  CsvStats *stats = query->stats;
+  uint64_t ticks = stats != NULL ? readTicks() : 0;
+
+  int fd = open(csvFilePath, O_RDONLY);
+
+  if (fd < 0)
+    return false;
+
+  struct stat csvFileStat;
+  void *data = MAP_FAILED;
+
+  if (fstat(fd, &csvFileStat) == 0 &&
+      S_ISREG(csvFileStat.st_mode) &&
+      csvFileStat.st_size > 0)
+    data = mmap(NULL, csvFileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  enum compression compression = unmapCompressedFile(&data, csvFileStat.st_size);
+  bool isColumnar = data != MAP_FAILED && isColumnarFile(data, csvFileStat.st_size);
+
+  // Only mapped files can seek to the blocks of their index
+  CsvIndex *index = data != MAP_FAILED && !isColumnar
+                        ? readIndex(csvFilePath, &csvFileStat)
+                        : NULL;
+
+  if (stats != NULL)
+    lapTicks(&stats->readTicks, ticks);
+
+  if (isColumnar)
+  {
+    bool isBound = processColumnarBuffer(data, csvFileStat.st_size, query, sink);
+    munmap(data, csvFileStat.st_size);
+    close(fd);
+    return isBound;
+  }
+
+  if (data != MAP_FAILED)
+  {
+    madvise(data, csvFileStat.st_size, MADV_SEQUENTIAL);
+    bool isBound = processCsvBuffer(data, csvFileStat.st_size, index, query, sink);
+    munmap(data, csvFileStat.st_size);
+    close(fd);
+    if (index != NULL)
+      freeIndex(index);
+    return isBound;
+  }
+
+  InputStream *stream = openInputStream(fd, compression);
+
+  if (stream == NULL)
+  {
+    close(fd);
+    return false;
+  }
+
+  bool isBound = processStreamedCsv(stream, query, sink);
+  closeInputStream(stream);
+  return isBound;
+}
+
+bool runCsvQuery(CsvQuery *query, const char csv[], CsvSink *sink)
+{
+  if (query->stats == NULL)
+    return runQuery(query, csv, sink);
+
+  RunStart run = startRun(sink);
+  bool isBound = runQuery(query, csv, sink);
+  endRun(query, sink, &run);
+  return isBound;
+}
+
+bool runCsvQueryFile(CsvQuery *query, const char csvFilePath[], CsvSink *sink)
+{
+  if (query->stats == NULL)
+    return runQueryFile(query, csvFilePath, sink);
+
+  RunStart run = startRun(sink);
+  bool isBound = runQueryFile(query, csvFilePath, sink);
+  endRun(query, sink, &run);
+  return isBound;
+}
+
+/**
+ * Count the cells of a header row, quoted separators aside.
+ *
+ * @param data Pointer to the header row.
+ * @param rowsOffset Offset of the first row after the header row.
+ * @return size_t How many cells the header row has.
+ */
+static size_t countHeaderCells(const char *data, size_t rowsOffset)
+{
+  size_t colCount = 1;
+  CsvScanner scanner;
+
+  initScanner(&scanner, data, rowsOffset);
+  while (nextStructural(&scanner) + 1 < rowsOffset)
+    colCount++;
+
+  return colCount;
+}
+
+bool buildCsvFileIndex(const char csvFilePath[], size_t blockSize)
+{
+  int fd = open(csvFilePath, O_RDONLY);
+
+  if (fd < 0)
+    return false;
+
+  struct stat csvFileStat;
+  char *data = MAP_FAILED;
+
+  if (fstat(fd, &csvFileStat) == 0 &&
+      S_ISREG(csvFileStat.st_mode) &&
+      csvFileStat.st_size > 0)
+    data = mmap(NULL, csvFileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (data == MAP_FAILED)
+    return false;
+
+  size_t length = csvFileStat.st_size;
+
+  if (detectCompression(data, length) != NO_COMPRESSION)
+  {
+    fprintf(stderr, "Compressed files cannot be indexed: '%s'\n", csvFilePath);
+    munmap(data, length);
+    return false;
+  }
+
+  madvise(data, length, MADV_SEQUENTIAL);
+
+  size_t headersLength;
+  size_t rowsOffset = findHeadersEnd(data, length, &headersLength);
+
+  // Zones are kept for each cell of the header row
+  size_t colCount = countHeaderCells(data, rowsOffset);
+
+  CsvIndex *index = createIndex(colCount, blockSize ? blockSize : INDEX_DEFAULT_BLOCK_SIZE);
+  CellView *cells = (CellView *)malloc(colCount * sizeof(CellView));
+  const char *rows = &data[rowsOffset];
+  size_t rowsLength = length - rowsOffset;
+  size_t position = 0, blockStart = 0;
+
+  CsvScanner scanner;
+  initScanner(&scanner, rows, rowsLength);
+  while (position < rowsLength)
+  {
+    size_t cellCount = scanRow(&scanner, &position, cells, colCount);
+
+    if (cellCount)
+      addIndexedRow(index, cells, cellCount);
+
+    // The last row may end without a line separator
+    if (position > rowsLength)
+      position = rowsLength;
+
+    if (position - blockStart >= index->header.blockSize || position == rowsLength)
+    {
+      endIndexBlock(index, rowsOffset + blockStart, position - blockStart);
+      blockStart = position;
+    }
+  }
+
+  bool isWritten = writeIndex(index, csvFilePath, &csvFileStat);
+
+  freeIndex(index);
+  free(cells);
+  munmap(data, length);
+  return isWritten;
+}
+
+bool convertCsvFileToColumnar(const char csvFilePath[], const char columnarFilePath[])
+{
+  int fd = open(csvFilePath, O_RDONLY);
+
+  if (fd < 0)
+    return false;
+
+  struct stat csvFileStat;
+  char *data = MAP_FAILED;
+
+  if (fstat(fd, &csvFileStat) == 0 &&
+      S_ISREG(csvFileStat.st_mode) &&
+      csvFileStat.st_size > 0)
+    data = mmap(NULL, csvFileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+
+  if (data == MAP_FAILED)
+    return false;
+
+  size_t length = csvFileStat.st_size;
+
+  if (detectCompression(data, length) != NO_COMPRESSION)
+  {
+    fprintf(stderr, "Compressed files cannot be converted: '%s'\n", csvFilePath);
+    munmap(data, length);
+    return false;
+  }
+
+  madvise(data, length, MADV_SEQUENTIAL);
+
+  size_t headersLength;
+  size_t rowsOffset = findHeadersEnd(data, length, &headersLength);
+  size_t colCount = countHeaderCells(data, rowsOffset);
+
+  ColumnarWriter *writer = createColumnarWriter(colCount, data, headersLength);
+  CellView *cells = (CellView *)malloc(colCount * sizeof(CellView));
+  const char *rows = &data[rowsOffset];
+  size_t rowsLength = length - rowsOffset;
+  size_t position = 0;
+
+  // Empty rows are kept, as they count among the rows auto types are inferred from
+  CsvScanner scanner;
+  initScanner(&scanner, rows, rowsLength);
+  while (position < rowsLength)
+    addColumnarRow(writer, cells, scanRow(&scanner, &position, cells, colCount));
+
+  bool isWritten = writeColumnarFile(writer, columnarFilePath);
+
+  freeColumnarWriter(writer);
+  free(cells);
+  munmap(data, length);
+  return isWritten;
+}
+
+/**
+ * Create a reader for a bound query, with no rows to read yet.
+ *
+ * @param query The bound query.
+ * @return CsvReader* The created reader.
+ */
+static CsvReader *createReader(CsvQuery *query)
+{
+  const Csv *csv = query->csv;
+
+  CsvReader *reader = (CsvReader *)malloc(sizeof(CsvReader));
+  reader->query = query;
+  reader->data = NULL;
+  reader->length = 0;
+  reader->position = 0;
+  reader->mapping = NULL;
+  reader->mappingLength = 0;
+  reader->stream = NULL;
+  reader->cells = (CellView *)malloc(csv->colCount * sizeof(CellView));
+  reader->fields = (CellView *)malloc(csv->colCount * sizeof(CellView));
+  reader->headers = (CellView *)malloc(csv->colCount * sizeof(CellView));
+  reader->selectedColumns = (size_t *)malloc(csv->colCount * sizeof(size_t));
+  reader->selectedCount = 0;
+  reader->rowLimit = getRowLimit(query);
+
+  for (size_t i = 0; i < csv->colCount; i++)
+    if (csv->columns[i]->isSelected)
+    {
+      CellView header = {csv->columns[i]->header, strlen(csv->columns[i]->header)};
+      reader->headers[reader->selectedCount] = header;
+      reader->selectedColumns[reader->selectedCount++] = i;
+    }
+
+  initScanner(&reader->scanner, NULL, 0);
+  return reader;
+}
+
+/**
+ * Point a reader at the next buffer of rows.
+ *
+ * @param reader The reader.
+ * @param data Pointer to the first row, not NUL-terminated.
+ * @param length The length of the buffer.
+ */
+static void setReaderRows(CsvReader *reader, const char *data, size_t length)
+{
+  reader->data = data;
+  reader->length = length;
+  reader->position = 0;
+  initScanner(&reader->scanner, data, length);
+}
+
+/**
+ * Check whether the rows of a query can be read one at a time.
+ *
+ * @param query The query.
+ * @return bool Whether the query is neither ordered nor aggregated.
+ */
+static bool isReadableQuery(const CsvQuery *query)
+{
+  if (query->totalSortKeys)
+    fprintf(stderr, "Ordered queries cannot be read row by row\n");
+  else if (isAggregatedQuery(query))
+    fprintf(stderr, "Aggregated queries cannot be read row by row\n");
+  else
+    return true;
+
+  return false;
+}
+
+/**
+ * Open a reader over a buffer holding a whole CSV, including its header row.
+ *
+ * @param query The query to be bound to the headers.
+ * @param data The CSV data, not NUL-terminated.
+ * @param length The length of the CSV data.
+ * @return CsvReader* The opened reader, or NULL if the query cannot be bound.
+ */
+static CsvReader *openBufferReader(CsvQuery *query, const char *data, size_t length)
+{
+  CsvStats *stats = query->stats;
+  uint64_t ticks = stats != NULL ? readTicks() : 0;
+
+  size_t headersLength;
+  size_t rowsOffset = findHeadersEnd(data, length, &headersLength);
+
+  if (!bindCsvQuery(query, data, headersLength))
+    return NULL;
+
+  CsvReader *reader = createReader(query);
+  inferFilterTypes(
+      query->filterPlan,
+      &data[rowsOffset],
+      length - rowsOffset,
+      query->csv->colCount);
+  setReaderRows(reader, &data[rowsOffset], length - rowsOffset);
+
+  if (stats != NULL)
+  {
+    stats->bytesRead += length;
+    lapTicks(&stats->setupTicks, ticks);
+  }
+
+  return reader;
+}
+
+CsvReader *openCsvReader(CsvQuery *query, const char csv[], size_t length)
+{
+  if (!isReadableQuery(query))
+    return NULL;
+
+  return openBufferReader(query, csv, length);
+}
+
+CsvReader *openCsvFileReader(CsvQuery *query, const char csvFilePath[])
+{
+  if (!isReadableQuery(query))
+    return NULL;
+
+  CsvStats *stats = query->stats;
+  uint64_t ticks = stats != NULL ? readTicks() : 0;
+
+  int fd = open(csvFilePath, O_RDONLY);
+
+  if (fd < 0)
+    return NULL;
+
+  struct stat csvFileStat;
+  void *data = MAP_FAILED;
+
+  if (fstat(fd, &csvFileStat) == 0 &&
+      S_ISREG(csvFileStat.st_mode) &&
+      csvFileStat.st_size > 0)
+    data = mmap(NULL, csvFileStat.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+
+  enum compression compression = unmapCompressedFile(&data, csvFileStat.st_size);
+
+  if (stats != NULL)
+    lapTicks(&stats->readTicks, ticks);
+
+  if (data != MAP_FAILED && isColumnarFile(data, csvFileStat.st_size))
+  {
+    fprintf(stderr, "Columnar files cannot be read row by row\n");
+    munmap(data, csvFileStat.st_size);
+    close(fd);
+    return NULL;
+  }
+
+  if (data != MAP_FAILED)
+  {
+    close(fd);
+    madvise(data, csvFileStat.st_size, MADV_SEQUENTIAL);
+
+    CsvReader *reader = openBufferReader(query, data, csvFileStat.st_size);
+
+    if (reader == NULL)
+    {
+      munmap(data, csvFileStat.st_size);
+      return NULL;
+    }
+
+    reader->mapping = data;
+    reader->mappingLength = csvFileStat.st_size;
+    return reader;
+  }
+
+  InputStream *stream = openInputStream(fd, compression);
+
+  if (stream == NULL)
+  {
+    close(fd);
+    return NULL;
+  }
+
+  const char *rows;
+  size_t rowsLength = readFirstRows(stream, query, &rows);
+
+  if (!bindStreamedCsv(query, &rows, &rowsLength))
+  {
+    closeInputStream(stream);
+    return NULL;
+  }
+
+  CsvReader *reader = createReader(query);
+  reader->stream = stream;
+  setReaderRows(reader, rows, rowsLength);
+  return reader;
+}
+
+const CellView *getCsvReaderHeaders(const CsvReader *reader, size_t *fieldCount)
+{
+  *fieldCount = reader->selectedCount;
+  return reader->headers;
+}
+
+const CellView *nextCsvRow(CsvReader *reader, size_t *fieldCount)
+{
+  const FilterPlan *filterPlan = reader->query->filterPlan;
+  CsvStats *stats = reader->query->stats;
+
+  while (reader->rowLimit.count)
+  {
+    size_t cellCount = nextFilteredRow(
+        &reader->scanner,
+        &reader->position,
+        reader->cells,
+        filterPlan,
+        stats);
+
+    if (cellCount && reader->rowLimit.offset)
+    {
+      reader->rowLimit.offset--;
+      continue;
+    }
+
+    if (cellCount)
+    {
+      reader->rowLimit.count--;
+      for (size_t i = 0; i < reader->selectedCount; i++)
+      {
+        size_t col = reader->selectedColumns[i];
+        CellView empty = {"", 0};
+        reader->fields[i] = col < cellCount ? reader->cells[col] : empty;
+      }
+
+      *fieldCount = reader->selectedCount;
+      return reader->fields;
+    }
+
+    if (reader->stream == NULL)
+      break;
+
+    const char *rows;
+    size_t rowsLength = readRows(reader->stream, 1, &rows, stats);
+
+    if (!rowsLength)
+      break;
+
+    setReaderRows(reader, rows, rowsLength);
+  }
+
+  *fieldCount = 0;
+  return NULL;
+}
+
+void closeCsvReader(CsvReader *reader)
+{
+  if (reader->mapping != NULL)
+    munmap(reader->mapping, reader->mappingLength);
+  if (reader->stream != NULL)
+    closeInputStream(reader->stream);
+
+  free(reader->cells);
+  free(reader->fields);
+  free(reader->headers);
+  free(reader->selectedColumns);
+  free(reader);
+}
+
+/**
+ * Create a sink writing to the standard output, after flushing what was already
+ * written through stdio so the output keeps its order.
+ *
+ * @return CsvSink* The created sink.
+ */
+static CsvSink *createStdoutSink()
+{
+  fflush(stdout);
+  return createFdSink(STDOUT_FILENO);
+}
+
+/**
+ * Compile a query and run it once on a CSV string or file.
+ *
+ * @param csv The CSV data, or the file path of the CSV when isFile is set.
+ * @param isFile Whether csv is a file path.
+ * @param selectedColumns The columns to be selected from the CSV data.
+ * @param rowFilterDefinitions The filters to be applied to the CSV data.
+ * @param workerCount How many worker threads to use, 0 for one per online CPU.
+ * @param sink The sink the result is written to, NULL for the standard output.
+ */
+static void processOnce(
+    const char csv[],
+    bool isFile,
+    const char selectedColumns[],
+    const char rowFilterDefinitions[],
+    size_t workerCount,
+    CsvSink *sink)
+{
+  CsvQuery *query = createCsvQuery(selectedColumns, rowFilterDefinitions);
+
+  if (query == NULL)
+    return;
+
+  setCsvQueryWorkerCount(query, workerCount);
+
+  CsvSink *output = sink != NULL ? sink : createStdoutSink();
+
+  if (isFile)
+    runCsvQueryFile(query, csv, output);
+  else
+    runCsvQuery(query, csv, output);
+
+  if (sink == NULL)
+    freeSink(output);
+  freeCsvQuery(query);
+}
+
+void processCsv(
+    const char csv[],
+    const char selectedColumns[],
+    const char rowFilterDefinitions[])
+{
+  processOnce(csv, false, selectedColumns, rowFilterDefinitions, 1, NULL);
+}
+
+void processCsvToSink(
+    const char csv[],
+    const char selectedColumns[],
+    const char rowFilterDefinitions[],
+    CsvSink *sink)
+{
+  processOnce(csv, false, selectedColumns, rowFilterDefinitions, 1, sink);
+}
+
+void processCsvFile(
+    const char csvFilePath[],
+    const char selectedColumns[],
+    const char rowFilterDefinitions[])
+{
+  processOnce(csvFilePath, true, selectedColumns, rowFilterDefinitions, 1, NULL);
+}
+
+void processCsvFileToSink(
+    const char csvFilePath[],
+    const char selectedColumns[],
+    const char rowFilterDefinitions[],
+    CsvSink *sink)
+{
+  processOnce(csvFilePath, true, selectedColumns, rowFilterDefinitions, 1, sink);
+}
+
+void processCsvParallel(
+    const char csv[],
+    const char selectedColumns[],
+    const char rowFilterDefinitions[],
+    size_t workerCount)
+{
+  processOnce(csv, false, selectedColumns, rowFilterDefinitions, workerCount, NULL);
+}
+
+void processCsvFileParallel(
+    const char csvFilePath[],
+    const char selectedColumns[],
+    const char rowFilterDefinitions[],
+    size_t workerCount)
+{
+  processOnce(csvFilePath, true, selectedColumns, rowFilterDefinitions, workerCount, NULL);
 }
@@ -1,3 +1,413 @@
+#ifndef LIBCSV_H
+#define LIBCSV_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define CSV_STATS_MAX_FILTERS 32
+
+/*
+ * Every function of the library is reentrant: independent calls may run from
+ * several threads at once, as long as a query or a sink is only used by one
+ * thread at a time.
+ */
+
+/**
+ * View of a cell inside the CSV data, not NUL-terminated.
+ */
+typedef struct
+{
+  const char *value;
+  size_t length;
+} CellView;
+
+/**
+ * Destination of the processed CSV. Output is collected in a buffer and only
+ * handed to the destination when the buffer is full or the sink is flushed.
+ */
+typedef struct CsvSink CsvSink;
+
+/**
+ * Function receiving the output of a callback sink.
+ *
+ * @param data The output, not NUL-terminated.
+ * @param length The length of the output.
+ * @param context The context given when the sink was created.
+ * @return bool Whether the output was consumed; false stops further writes.
+ */
+typedef bool (*CsvSinkCallback)(const char data[], size_t length, void *context);
+
+/**
+ * Create a sink which writes to a file descriptor.
+ *
+ * @param fd The file descriptor, which is not closed by the sink.
+ * @return CsvSink* The created sink.
+ */
+CsvSink *createFdSink(int fd);
+
+/**
+ * Create a sink which writes to a buffer owned by the caller. Output which does
+ * not fit in the buffer is truncated and marks the sink with an error.
+ *
+ * @param buffer The buffer the output is written to, not NUL-terminated.
+ * @param capacity The size of the buffer.
+ * @return CsvSink* The created sink.
+ */
+CsvSink *createMemorySink(char buffer[], size_t capacity);
+
+/**
+ * Create a sink which hands its output to a callback.
+ *
+ * @param callback The function receiving the output.
+ * @param context Passed as is to the callback.
+ * @return CsvSink* The created sink.
+ */
+CsvSink *createCallbackSink(CsvSinkCallback callback, void *context);
+
+/**
+ * Hand the buffered output of a sink to its destination.
+ *
+ * @param sink The sink.
+ * @return bool Whether all the output so far reached the destination.
+ */
+bool flushSink(CsvSink *sink);
+
+/**
+ * Get how many bytes were written to a sink.
+ *
+ * @param sink The sink.
+ * @return size_t The length of the output.
+ */
+size_t getSinkLength(const CsvSink *sink);
+
+/**
+ * Check whether a write to a sink failed or was truncated.
+ *
+ * @param sink The sink.
+ * @return bool Whether an error happened.
+ */
+bool hasSinkError(const CsvSink *sink);
+
+/**
+ * Flush a sink and free it.
+ *
+ * @param sink The sink to be freed.
+ */
+void freeSink(CsvSink *sink);
+
+/**
+ * Compiled selection and filters which can be run on many CSV inputs. The headers
+ * of each input are resolved to columns when the query runs, and the result is
+ * reused while consecutive inputs have the same header row.
+ *
+ * A query may be run by a single thread at a time.
+ */
+typedef struct CsvQuery CsvQuery;
+
+/**
+ * Compile the selected columns and row filters of a query.
+ *
+ * @param selectedColumns The columns to be selected from the CSV data.
+ * @param rowFilterDefinitions The filters to be applied to the CSV data.
+ * @return CsvQuery* The compiled query, or NULL if a filter is invalid.
+ */
+CsvQuery *createCsvQuery(const char selectedColumns[], const char rowFilterDefinitions[]);
+
+/**
+ * Add an IN or NOT IN filter to a query, accepting the cells whose value is (or is
+ * not) one of a list of values. The values are kept in a hash set, so each cell is
+ * checked in constant time however many values there are. The header may declare
+ * a type like other filters, e.g. "id:int", and the filter is combined with the
+ * other filters of its header as OR.
+ *
+ * @param query The query.
+ * @param header The header of the filtered column, with an optional type.
+ * @param values The values, one per line.
+ * @param isNegated Whether to accept the cells which are not in the values.
+ * @return bool Whether the values are valid for the type. An invalid filter is not
+ * added.
+ */
+bool addCsvQueryInFilter(
+    CsvQuery *query,
+    const char header[],
+    const char values[],
+    bool isNegated);
+
+/**
+ * Add an IN or NOT IN filter to a query with the values of a file, one per line.
+ *
+ * @param query The query.
+ * @param header The header of the filtered column, with an optional type.
+ * @param valuesFilePath The file path of the values.
+ * @param isNegated Whether to accept the cells which are not in the values.
+ * @return bool Whether the file could be read and its values are valid for the type.
+ * An invalid filter is not added.
+ */
+bool addCsvQueryInFilterFile(
+    CsvQuery *query,
+    const char header[],
+    const char valuesFilePath[],
+    bool isNegated);
+
+/**
+ * Counters filled in by the runs of a query. Counters are only ever added to, so
+ * they accumulate over runs until the caller clears them.
+ *
+ * Stage times are in ticks: cycles of the time stamp counter on x86, nanoseconds
+ * elsewhere. With several worker threads, the per-row stages add up the time of
+ * every worker.
+ */
+typedef struct
+{
+  size_t bytesRead;
+  size_t bytesWritten;
+  size_t rowsScanned;
+  size_t rowsPassed;
+  // Rows rejected by the filters of a column, counted on the first filter
+  // definition of that column, in definition order. Only the first
+  // CSV_STATS_MAX_FILTERS definitions have their own counter, rows rejected by
+  // columns first filtered after them are counted in rowsRejectedPastMaxFilters
+  size_t rowsRejected[CSV_STATS_MAX_FILTERS];
+  size_t rowsRejectedPastMaxFilters;
+  // Cells copied out of the input to store or sort rows. Rows printed straight
+  // from the input, or read as views, copy none
+  size_t cellsCopied;
+  // Buffers allocated or grown to store rows or collect output
+  size_t allocations;
+  // Binding the query to the headers and inferring auto filter types
+  uint64_t setupTicks;
+  // Opening, mapping and reading the input, without the page faults of mapped files
+  uint64_t readTicks;
+  // Splitting rows into cells, including the page faults of mapped files
+  uint64_t scanTicks;
+  uint64_t filterTicks;
+  // Storing or formatting the rows which passed the filters
+  uint64_t outputTicks;
+  uint64_t wallNanoseconds;
+} CsvStats;
+
+/**
+ * Collect the counters of the runs of a query. Collecting has close to no cost
+ * while no stats are set.
+ *
+ * @param query The query.
+ * @param stats The counters to be added to, NULL to stop collecting.
+ */
+void setCsvQueryStats(CsvQuery *query, CsvStats *stats);
+
+/**
+ * Order the result of a query by one or more comma-separated columns. A column
+ * may declare a type like filters do, and end with ` desc` for a descending order,
+ * e.g. "price:int desc,name". Cells which are not valid for the type of their
+ * column come last, and rows with equal values keep their original order.
+ *
+ * Rows are held in memory up to the sort memory budget, then spilled as sorted
+ * runs to temporary files, which are merged when the result is written. Ordered
+ * queries scan their input on a single thread and cannot be read by a CsvReader.
+ *
+ * @param query The query.
+ * @param orderColumns The columns to order by, empty to keep the order of the CSV.
+ * @return bool Whether the order is valid. An invalid order leaves the query
+ * unordered.
+ */
+bool setCsvQueryOrder(CsvQuery *query, const char orderColumns[]);
+
+/**
+ * Group the rows of a query by one or more comma-separated columns, writing one row
+ * per group instead of the rows themselves. The result has the group columns, then
+ * one column per aggregate named after its definition, in the order in which each
+ * group first appears.
+ *
+ * Aggregates are comma-separated: `count`, `sum(column)`, `avg(column)`,
+ * `min(column)`, `max(column)` and `count_distinct(column)`. Sums and averages
+ * parse their column as float numbers by default, or as integers with
+ * `sum(column:int)`. Minimums and maximums compare as text unless a type is
+ * declared, and write the cell as it appears in the CSV. Cells which are not
+ * valid for the type are skipped, and aggregates without any valid cell are empty.
+ *
+ * Groups are keyed on the bytes of their cells, and held in memory. Parallel runs
+ * aggregate each chunk of rows in its worker, and merge the partial groups at the
+ * end. The offset and limit of the query apply to the groups. Aggregated queries
+ * cannot be ordered or read by a CsvReader.
+ *
+ * @param query The query.
+ * @param groupColumns The columns to group by, empty for a single group with every row.
+ * @param aggregateDefinitions The aggregates computed for each group, may be empty.
+ * @return bool Whether every aggregate is valid. An invalid definition leaves the
+ * query without groups.
+ */
+bool setCsvQueryGroupBy(
+    CsvQuery *query,
+    const char groupColumns[],
+    const char aggregateDefinitions[]);
+
+/**
+ * Set how many bytes of rows an ordered query holds in memory before spilling them
+ * to temporary files. The default is 64 MiB.
+ *
+ * @param query The query.
+ * @param memoryBudget The memory budget in bytes.
+ */
+void setCsvQuerySortMemory(CsvQuery *query, size_t memoryBudget);
+
+/**
+ * Skip the first rows of the result of a query, counted after filtering and
+ * ordering. The header row is always written.
+ *
+ * @param query The query.
+ * @param offset How many rows to skip, 0 for none.
+ */
+void setCsvQueryOffset(CsvQuery *query, size_t offset);
+
+/**
+ * Limit how many rows of a query are written after the skipped ones. Unordered
+ * queries stop reading and scanning the input once the limit is reached, while
+ * ordered ones only keep the rows which may be written in memory.
+ *
+ * @param query The query.
+ * @param limit The maximum number of rows, 0 for no limit.
+ */
+void setCsvQueryLimit(CsvQuery *query, size_t limit);
+
+/**
+ * Set how many worker threads run a query. Rows keep their original order.
+ *
+ * @param query The query.
+ * @param workerCount How many worker threads to use, 0 for one per online CPU.
+ */
+void setCsvQueryWorkerCount(CsvQuery *query, size_t workerCount);
+
+/**
+ * Run a query on CSV data, writing the result to a sink. The sink is not flushed.
+ *
+ * @param query The query to be run.
+ * @param csv The CSV data to be processed.
+ * @param sink The sink the result is written to.
+ * @return bool Whether every header of the query was found in the CSV.
+ */
+bool runCsvQuery(CsvQuery *query, const char csv[], CsvSink *sink);
+
+/**
+ * Run a query on a CSV file, writing the result to a sink. The sink is not flushed.
+ * Pipes are read, and gzip and zstd compressed files decompressed, on a separate
+ * thread while their rows are processed.
+ *
+ * @param query The query to be run.
+ * @param csvFilePath The file path of the CSV to be processed.
+ * @param sink The sink the result is written to.
+ * @return bool Whether the file could be read and every header of the query was
+ * found in it.
+ */
+bool runCsvQueryFile(CsvQuery *query, const char csvFilePath[], CsvSink *sink);
+
+/**
+ * Build the sidecar index of a CSV file, written next to it with the `.idx`
+ * suffix. The rows are split into blocks of about blockSize bytes, and the index
+ * keeps the offset and row count of each block, with a zone map of each column:
+ * its minimum and maximum as integers, floats, dates and text, and a bloom filter
+ * of its values.
+ *
+ * Queries run on the file with runCsvQueryFile, processCsvFile and their variants
+ * then skip the blocks in which a filter cannot accept any cell, and only scan the
+ * others. The index is ignored once the size or modification time of the file
+ * changes, until it is built again. Filters comparing two columns and NOT IN
+ * filters never skip blocks.
+ *
+ * @param csvFilePath The file path of the CSV to be indexed, a regular file.
+ * @param blockSize How many bytes of rows each block holds, 0 for 64 KiB.
+ * @return bool Whether the file could be read and its index written.
+ */
+bool buildCsvFileIndex(const char csvFilePath[], size_t blockSize);
+
+/**
+ * Convert a CSV file into a binary columnar file, keeping the header row and each
+ * cell as it appears in the CSV. Columns with few distinct cells are dictionary
+ * encoded, the other ones store an offset per cell. The whole CSV is held in
+ * memory during the conversion.
+ *
+ * Queries run on the columnar file with runCsvQueryFile, processCsvFile and their
+ * variants give the same output as on the CSV, without parsing any text, and
+ * filters on dictionary encoded columns are only validated once per distinct
+ * value. Rows are processed on a single thread, whatever the worker count. The
+ * columnar file is not updated with the CSV, and cannot be read row by row.
+ *
+ * @param csvFilePath The file path of the CSV to be converted, a regular file.
+ * @param columnarFilePath The file path of the columnar file to be written.
+ * @return bool Whether the CSV could be read and the columnar file written.
+ */
+bool convertCsvFileToColumnar(const char csvFilePath[], const char columnarFilePath[]);
+
+/**
+ * Free a query.
+ *
+ * @param query The query to be freed.
+ */
+void freeCsvQuery(CsvQuery *query);
+
+/**
+ * Reader returning the rows of a CSV which pass the filters of a query, one at a
+ * time, without copying or allocating anything per row.
+ */
+typedef struct CsvReader CsvReader;
+
+/**
+ * Open a reader over CSV data held in memory. The data must stay valid until the
+ * reader is closed.
+ *
+ * The query is bound to the headers of the data and must not be run or used by
+ * another reader until this reader is closed.
+ *
+ * @param query The query whose selection and filters are applied.
+ * @param csv The CSV data, including the header row, not NUL-terminated.
+ * @param length The length of the CSV data.
+ * @return CsvReader* The opened reader, or NULL if a header of the query is missing
+ * or the query is ordered.
+ */
+CsvReader *openCsvReader(CsvQuery *query, const char csv[], size_t length);
+
+/**
+ * Open a reader over a CSV file, mapping it in memory when possible. Other files,
+ * such as pipes and compressed files, are read ahead on a separate thread.
+ *
+ * The query is bound to the headers of the file and must not be run or used by
+ * another reader until this reader is closed.
+ *
+ * @param query The query whose selection and filters are applied.
+ * @param csvFilePath The file path of the CSV.
+ * @return CsvReader* The opened reader, or NULL if the file cannot be read, a
+ * header of the query is missing or the query is ordered.
+ */
+CsvReader *openCsvFileReader(CsvQuery *query, const char csvFilePath[]);
+
+/**
+ * Get the selected headers of the CSV of a reader.
+ *
+ * @param reader The reader.
+ * @param fieldCount Will be set to how many headers are selected.
+ * @return const CellView* One view per selected header, in the CSV order.
+ */
+const CellView *getCsvReaderHeaders(const CsvReader *reader, size_t *fieldCount);
+
+/**
+ * Read the next row which passes the filters. Quoted fields are returned as they
+ * appear in the CSV, quotes included.
+ *
+ * @param reader The reader.
+ * @param fieldCount Will be set to how many fields the row has, one per selected
+ * header.
+ * @return const CellView* Views of the selected fields of the row, valid until
+ * the next call, or NULL when there are no rows left.
+ */
+const CellView *nextCsvRow(CsvReader *reader, size_t *fieldCount);
+
+/**
+ * Close a reader, releasing the file it reads from. The query is not freed.
+ *
+ * @param reader The reader to be closed.
+ */
+void closeCsvReader(CsvReader *reader);
+
 /**
  * Process the CSV data by applying filters and selecting columns.
  *
@@ -19,3 +429,60 @@ void processCsv(const char[], const char[], const char[]);
  * @return void
  */
 void processCsvFile(const char[], const char[], const char[]);
+
+/**
+ * Process the CSV data by applying filters and selecting columns, writing the
+ * result to a sink. The sink is not flushed.
+ *
+ * @param csv The CSV data to be processed.
+ * @param selectedColumns The columns to be selected from the CSV data.
+ * @param rowFilterDefinitions The filters to be applied to the CSV data.
+ * @param sink The sink the result is written to.
+ *
+ * @return void
+ */
+void processCsvToSink(const char[], const char[], const char[], CsvSink *);
+
+/**
+ * Process the CSV file by applying filters and selecting columns, writing the
+ * result to a sink. The sink is not flushed.
+ *
+ * @param csvFilePath The file path of the CSV to be processed.
+ * @param selectedColumns The columns to be selected from the CSV data.
+ * @param rowFilterDefinitions The filters to be applied to the CSV data.
+ * @param sink The sink the result is written to.
+ *
+ * @return void
+ */
+void processCsvFileToSink(const char[], const char[], const char[], CsvSink *);
+
+/**
+ * Process the CSV data by applying filters and selecting columns, splitting the
+ * rows between several worker threads. The result keeps the original row order.
+ *
+ * @param csv The CSV data to be processed.
+ * @param selectedColumns The columns to be selected from the CSV data.
+ * @param rowFilterDefinitions The filters to be applied to the CSV data.
+ * @param workerCount How many worker threads to use, 0 for one per online CPU.
+ *
+ * @return void
+ */
+void processCsvParallel(const char[], const char[], const char[], size_t);
+
+/**
+ * Process the CSV file by applying filters and selecting columns, splitting the
+ * rows between several worker threads. The result keeps the original row order.
+ *
+ * Files which cannot be mapped in memory, such as pipes, are processed by the
+ * calling thread.
+ *
+ * @param csvFilePath The file path of the CSV to be processed.
+ * @param selectedColumns The columns to be selected from the CSV data.
+ * @param rowFilterDefinitions The filters to be applied to the CSV data.
+ * @param workerCount How many worker threads to use, 0 for one per online CPU.
+ *
+ * @return void
+ */
+void processCsvFileParallel(const char[], const char[], const char[], size_t);
+
+#endif
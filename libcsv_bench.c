@@ -0,0 +1,351 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "libcsv.h"
+
+#define BENCH_DEFAULT_MEGABYTES 32
+#define BENCH_KEY_RANGE 1000
+
+typedef struct
+{
+  const char *name;
+  size_t columns;
+  size_t fieldLength;
+  const char *selectedColumns;
+} BenchDataset;
+
+typedef struct
+{
+  const char *name;
+  const char *rowFilterDefinitions;
+} BenchFilter;
+
+typedef void (*BenchRun)(
+    const char csvFilePath[],
+    const char csv[],
+    const char selectedColumns[],
+    const char rowFilterDefinitions[]);
+
+typedef struct
+{
+  const char *name;
+  BenchRun run;
+  bool needsBuffer;
+} BenchApi;
+
+typedef struct
+{
+  double seconds;
+  size_t allocations;
+} BenchResult;
+
+// Column 1 is the filter key, uniformly spread over [0, BENCH_KEY_RANGE)
+static const BenchDataset datasets[] = {
+    {"tall", 8, 6, "col000,col001,col005"},
+    {"wide", 300, 6, "col000,col150,col299"},
+    {"long", 4, 2048, "col000,col002"}};
+
+static const BenchFilter filters[] = {
+    {"1% pass", "col001:int<10"},
+    {"99% pass", "col001:int>=10"}};
+
+static size_t allocations;
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t count, size_t size);
+void *__real_realloc(void *pointer, size_t size);
+char *__real_strdup(const char *value);
+char *__real_strndup(const char *value, size_t length);
+
+/*
+ * Allocation counters, linked in place of the allocator entry points used by the
+ * library with -Wl,--wrap.
+ */
+void *__wrap_malloc(size_t size)
+{
+  __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+  return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t count, size_t size)
+{
+  __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+  return __real_calloc(count, size);
+}
+
+void *__wrap_realloc(void *pointer, size_t size)
+{
+  __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+  return __real_realloc(pointer, size);
+}
+
+char *__wrap_strdup(const char *value)
+{
+  __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+  return __real_strdup(value);
+}
+
+char *__wrap_strndup(const char *value, size_t length)
+{
+  __atomic_fetch_add(&allocations, 1, __ATOMIC_RELAXED);
+  return __real_strndup(value, length);
+}
+
+static void runProcessCsv(
+    const char csvFilePath[],
+    const char csv[],
+    const char selectedColumns[],
+    const char rowFilterDefinitions[])
+{
+  (void)csvFilePath;
+  processCsv(csv, selectedColumns, rowFilterDefinitions);
+}
+
+static void runProcessCsvFile(
+    const char csvFilePath[],
+    const char csv[],
+    const char selectedColumns[],
+    const char rowFilterDefinitions[])
+{
+  (void)csv;
+  processCsvFile(csvFilePath, selectedColumns, rowFilterDefinitions);
+}
+
+static void runProcessCsvFileParallel(
+    const char csvFilePath[],
+    const char csv[],
+    const char selectedColumns[],
+    const char rowFilterDefinitions[])
+{
+  (void)csv;
+  processCsvFileParallel(csvFilePath, selectedColumns, rowFilterDefinitions, 0);
+}
+
+static void runCsvReader(
+    const char csvFilePath[],
+    const char csv[],
+    const char selectedColumns[],
+    const char rowFilterDefinitions[])
+{
+  (void)csv;
+  CsvQuery *query = createCsvQuery(selectedColumns, rowFilterDefinitions);
+  CsvReader *reader = openCsvFileReader(query, csvFilePath);
+  size_t fieldCount, bytes = 0;
+  const CellView *fields;
+
+  while ((fields = nextCsvRow(reader, &fieldCount)) != NULL)
+    bytes += fields[0].length;
+
+  closeCsvReader(reader);
+  freeCsvQuery(query);
+
+  // Keep the loop from being optimized away
+  __asm__ volatile("" : : "r"(bytes));
+}
+
+static const BenchApi apis[] = {
+    {"processCsv", runProcessCsv, true},
+    {"processCsvFile", runProcessCsvFile, false},
+    {"processCsvFileParallel", runProcessCsvFileParallel, false},
+    {"nextCsvRow", runCsvReader, false}};
+
+/**
+ * Get the current time of a monotonic clock in seconds.
+ *
+ * @return double The current time.
+ */
+static double now()
+{
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+/**
+ * Write a deterministic CSV file of about the given size.
+ *
+ * @param dataset The shape of the CSV.
+ * @param csvFilePath The file path of the CSV to be written.
+ * @param size The approximate size of the file in bytes.
+ * @return size_t How many rows were written, not counting the header row.
+ */
+static size_t generateCsv(const BenchDataset *dataset, const char csvFilePath[], size_t size)
+{
+  FILE *csvFile = fopen(csvFilePath, "w");
+  uint64_t state = 42;
+  size_t rows = 0;
+
+  for (size_t col = 0; col < dataset->columns; col++)
+    fprintf(csvFile, "%scol%03zu", col ? "," : "", col);
+  fputc('\n', csvFile);
+
+  while ((size_t)ftell(csvFile) < size)
+  {
+    fprintf(csvFile, "%zu", rows++);
+
+    for (size_t col = 1; col < dataset->columns; col++)
+    {
+      state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+      unsigned value = (unsigned)(state >> 33);
+
+      if (col == 1)
+        fprintf(csvFile, ",%u", value % BENCH_KEY_RANGE);
+      else
+      {
+        fputc(',', csvFile);
+        size_t length = dataset->fieldLength / 2 + value % dataset->fieldLength;
+        for (size_t i = 0; i < length; i++)
+          fputc('a' + (value + i) % 26, csvFile);
+      }
+    }
+    fputc('\n', csvFile);
+  }
+
+  fclose(csvFile);
+  return rows;
+}
+
+/**
+ * Read a whole file into a NUL-terminated buffer.
+ *
+ * @param csvFilePath The file path.
+ * @return char* The content of the file, which must be freed by the caller.
+ */
+static char *readFile(const char csvFilePath[])
+{
+  FILE *csvFile = fopen(csvFilePath, "r");
+  fseek(csvFile, 0, SEEK_END);
+  size_t length = ftell(csvFile);
+  rewind(csvFile);
+
+  char *csv = (char *)malloc(length + 1);
+  csv[fread(csv, sizeof(char), length, csvFile)] = '\0';
+  fclose(csvFile);
+  return csv;
+}
+
+/**
+ * Run one benchmark case in a child process, so its peak RSS and allocation count
+ * are not mixed with the other cases. The output of the library is discarded.
+ *
+ * @param api The API to be measured.
+ * @param csvFilePath The file path of the CSV.
+ * @param selectedColumns The columns to be selected.
+ * @param rowFilterDefinitions The filters to be applied.
+ * @param peakRss Will be set to the peak RSS of the child in kilobytes.
+ * @return BenchResult The wall time and allocation count of the case.
+ */
+static BenchResult runCase(
+    const BenchApi *api,
+    const char csvFilePath[],
+    const char selectedColumns[],
+    const char rowFilterDefinitions[],
+    long *peakRss)
+{
+  BenchResult result = {0, 0};
+  int results[2];
+
+  fflush(stdout);
+  if (pipe(results) != 0)
+    return result;
+
+  pid_t pid = fork();
+
+  if (pid == 0)
+  {
+    close(results[0]);
+    char *csv = api->needsBuffer ? readFile(csvFilePath) : NULL;
+
+    int devNull = open("/dev/null", O_WRONLY);
+    dup2(devNull, STDOUT_FILENO);
+    close(devNull);
+
+    allocations = 0;
+    double start = now();
+    api->run(csvFilePath, csv, selectedColumns, rowFilterDefinitions);
+    result.seconds = now() - start;
+    result.allocations = allocations;
+
+    write(results[1], &result, sizeof(result));
+    _exit(EXIT_SUCCESS);
+  }
+
+  close(results[1]);
+  if (read(results[0], &result, sizeof(result)) != sizeof(result))
+    result.seconds = 0;
+  close(results[0]);
+
+  struct rusage usage;
+  int status;
+  wait4(pid, &status, 0, &usage);
+  *peakRss = usage.ru_maxrss;
+
+  return result;
+}
+
+int main(int argc, char *argv[])
+{
+  size_t megabytes = argc > 1 ? strtoul(argv[1], NULL, 10) : BENCH_DEFAULT_MEGABYTES;
+  const char *directory = argc > 2 ? argv[2] : "/tmp";
+
+  if (!megabytes)
+  {
+    fprintf(stderr, "usage: %s [megabytes per dataset] [directory]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+
+  printf("%-6s %-9s %-23s %9s %12s %10s %12s\n",
+         "data", "filter", "api", "MB/s", "rows/s", "peak RSS", "allocations");
+
+  for (size_t i = 0; i < sizeof(datasets) / sizeof(datasets[0]); i++)
+  {
+    char csvFilePath[4096];
+    snprintf(csvFilePath, sizeof(csvFilePath), "%s/libcsv_bench_%s.csv", directory, datasets[i].name);
+
+    size_t rows = generateCsv(&datasets[i], csvFilePath, megabytes << 20);
+
+    FILE *csvFile = fopen(csvFilePath, "r");
+    fseek(csvFile, 0, SEEK_END);
+    double size = ftell(csvFile);
+    fclose(csvFile);
+
+    for (size_t j = 0; j < sizeof(filters) / sizeof(filters[0]); j++)
+      for (size_t k = 0; k < sizeof(apis) / sizeof(apis[0]); k++)
+      {
+        long peakRss = 0;
+        BenchResult result = runCase(
+            &apis[k],
+            csvFilePath,
+            datasets[i].selectedColumns,
+            filters[j].rowFilterDefinitions,
+            &peakRss);
+
+        if (result.seconds <= 0)
+        {
+          printf("%-6s %-9s %-23s failed\n", datasets[i].name, filters[j].name, apis[k].name);
+          continue;
+        }
+
+        printf("%-6s %-9s %-23s %9.1f %12.0f %8ld MB %12zu\n",
+               datasets[i].name,
+               filters[j].name,
+               apis[k].name,
+               size / result.seconds / 1e6,
+               rows / result.seconds,
+               peakRss >> 10,
+               result.allocations);
+      }
+
+    remove(csvFilePath);
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -0,0 +1,583 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "libcsv_columnar.h"
+
+#define COLUMNAR_MIN_ROWS 1024
+#define COLUMNAR_MIN_TEXT 4096
+#define COLUMNAR_ALIGNMENT 8
+
+ColumnarWriter *createColumnarWriter(size_t columnCount, const char headers[], size_t headersLength)
+{
+  ColumnarWriter *writer = (ColumnarWriter *)malloc(sizeof(ColumnarWriter));
+  writer->headers = (char *)malloc(headersLength + 1);
+  memcpy(writer->headers, headers, headersLength);
+  writer->headersLength = headersLength;
+  writer->columnCount = columnCount;
+  writer->rowCount = 0;
+  writer->rowCapacity = COLUMNAR_MIN_ROWS;
+  writer->cellCounts = (uint32_t *)malloc(writer->rowCapacity * sizeof(uint32_t));
+  writer->hasMissingCells = false;
+  writer->columns = (ColumnBuilder *)malloc(columnCount * sizeof(ColumnBuilder));
+
+  for (size_t i = 0; i < columnCount; i++)
+  {
+    ColumnBuilder *column = &writer->columns[i];
+    column->textCapacity = COLUMNAR_MIN_TEXT;
+    column->text = (char *)malloc(column->textCapacity);
+    column->textLength = 0;
+    column->offsets = (size_t *)malloc((writer->rowCapacity + 1) * sizeof(size_t));
+    column->offsets[0] = 0;
+    column->isDictionary = true;
+    column->codes = (uint32_t *)malloc(writer->rowCapacity * sizeof(uint32_t));
+    column->entryCapacity = COLUMNAR_MIN_SLOTS;
+    column->entries = (size_t *)malloc(column->entryCapacity * 2 * sizeof(size_t));
+    column->entryCount = 0;
+    column->slotHashes = (uint64_t *)calloc(COLUMNAR_MIN_SLOTS, sizeof(uint64_t));
+    column->slotEntries = (uint32_t *)malloc(COLUMNAR_MIN_SLOTS * sizeof(uint32_t));
+    column->slotMask = COLUMNAR_MIN_SLOTS - 1;
+  }
+
+  return writer;
+}
+
+/**
+ * Stop keeping the dictionary of a column, once it has too many distinct cells.
+ *
+ * @param column The column.
+ */
+static void dropDictionary(ColumnBuilder *column)
+{
+  column->isDictionary = false;
+  free(column->codes);
+  free(column->entries);
+  free(column->slotHashes);
+  free(column->slotEntries);
+  column->codes = NULL;
+  column->entries = NULL;
+  column->slotHashes = NULL;
+  column->slotEntries = NULL;
+}
+
+/**
+ * Double the slots of the dictionary of a column.
+ *
+ * @param column The column.
+ */
+static void growDictionarySlots(ColumnBuilder *column)
+{
+  size_t slotCount = (column->slotMask + 1) * 2;
+  uint64_t *slotHashes = (uint64_t *)calloc(slotCount, sizeof(uint64_t));
+  uint32_t *slotEntries = (uint32_t *)malloc(slotCount * sizeof(uint32_t));
+
+  for (size_t i = 0; i <= column->slotMask; i++)
+  {
+    if (!column->slotHashes[i])
+      continue;
+
+    size_t j = column->slotHashes[i] & (slotCount - 1);
+    while (slotHashes[j])
+      j = (j + 1) & (slotCount - 1);
+    slotHashes[j] = column->slotHashes[i];
+    slotEntries[j] = column->slotEntries[i];
+  }
+
+  free(column->slotHashes);
+  free(column->slotEntries);
+  column->slotHashes = slotHashes;
+  column->slotEntries = slotEntries;
+  column->slotMask = slotCount - 1;
+}
+
+/**
+ * Find the dictionary entry of a cell, adding it if it is not in the dictionary.
+ *
+ * @param column The column.
+ * @param start Offset of the cell in the text of the column.
+ * @param length The length of the cell.
+ * @return size_t The index of the entry, or COLUMNAR_MAX_DICTIONARY if the
+ * dictionary is full.
+ */
+static size_t findDictionaryEntry(ColumnBuilder *column, size_t start, size_t length)
+{
+  const char *cell = &column->text[start];
+  uint64_t hash = hashBytes(cell, length);
+  size_t i = hash & column->slotMask;
+
+  for (; column->slotHashes[i]; i = (i + 1) & column->slotMask)
+  {
+    const size_t *entry = &column->entries[column->slotEntries[i] * 2];
+
+    if (column->slotHashes[i] == hash &&
+        entry[1] == length &&
+        memcmp(&column->text[entry[0]], cell, length) == 0)
+      return column->slotEntries[i];
+  }
+
+  if (column->entryCount == COLUMNAR_MAX_DICTIONARY)
+    return COLUMNAR_MAX_DICTIONARY;
+
+  if (column->entryCount == column->entryCapacity)
+  {
+    column->entryCapacity *= 2;
+    column->entries = (size_t *)realloc(
+        column->entries,
+        column->entryCapacity * 2 * sizeof(size_t));
+  }
+
+  size_t entry = column->entryCount++;
+  column->entries[entry * 2] = start;
+  column->entries[entry * 2 + 1] = length;
+  column->slotHashes[i] = hash;
+  column->slotEntries[i] = (uint32_t)entry;
+
+  if (column->entryCount * 2 > column->slotMask + 1)
+    growDictionarySlots(column);
+
+  return entry;
+}
+
+/**
+ * Add a cell to a column.
+ *
+ * @param column The column.
+ * @param row The row of the cell.
+ * @param cell The cell, as it appears in the CSV.
+ */
+static void addColumnCell(ColumnBuilder *column, size_t row, const CellView *cell)
+{
+  if (column->textLength + cell->length > column->textCapacity)
+  {
+    while (column->textLength + cell->length > column->textCapacity)
+      column->textCapacity *= 2;
+    column->text = (char *)realloc(column->text, column->textCapacity);
+  }
+
+  size_t start = column->textLength;
+  memcpy(&column->text[start], cell->value, cell->length);
+  column->textLength += cell->length;
+  column->offsets[row + 1] = column->textLength;
+
+  if (!column->isDictionary)
+    return;
+
+  size_t entry = findDictionaryEntry(column, start, cell->length);
+
+  if (entry == COLUMNAR_MAX_DICTIONARY)
+    dropDictionary(column);
+  else
+    column->codes[row] = (uint32_t)entry;
+}
+
+void addColumnarRow(ColumnarWriter *writer, const CellView cells[], size_t cellCount)
+{
+  if (writer->rowCount == writer->rowCapacity)
+  {
+    writer->rowCapacity *= 2;
+    writer->cellCounts = (uint32_t *)realloc(
+        writer->cellCounts,
+        writer->rowCapacity * sizeof(uint32_t));
+
+    for (size_t i = 0; i < writer->columnCount; i++)
+    {
+      ColumnBuilder *column = &writer->columns[i];
+      column->offsets = (size_t *)realloc(
+          column->offsets,
+          (writer->rowCapacity + 1) * sizeof(size_t));
+      if (column->isDictionary)
+        column->codes = (uint32_t *)realloc(
+            column->codes,
+            writer->rowCapacity * sizeof(uint32_t));
+    }
+  }
+
+  // Missing cells are stored empty, and the cell count of the row tells them apart
+  CellView empty = {"", 0};
+  size_t row = writer->rowCount++;
+  writer->cellCounts[row] = (uint32_t)cellCount;
+  writer->hasMissingCells |= cellCount < writer->columnCount;
+
+  for (size_t i = 0; i < writer->columnCount; i++)
+    addColumnCell(&writer->columns[i], row, i < cellCount ? &cells[i] : &empty);
+}
+
+/**
+ * Round an offset up to the alignment of the sections of a columnar file.
+ *
+ * @param offset The offset.
+ * @return size_t The aligned offset.
+ */
+static size_t alignSection(size_t offset)
+{
+  return (offset + COLUMNAR_ALIGNMENT - 1) & ~(size_t)(COLUMNAR_ALIGNMENT - 1);
+}
+
+/**
+ * Check whether a column is smaller with a dictionary.
+ *
+ * @param column The column.
+ * @param rowCount How many rows the column has.
+ * @return bool Whether the column is to be dictionary encoded.
+ */
+static bool isDictionaryEncoded(const ColumnBuilder *column, size_t rowCount)
+{
+  return column->isDictionary && column->entryCount * 2 <= rowCount;
+}
+
+/**
+ * Lay out the sections of a column in a columnar file.
+ *
+ * @param column The column being written.
+ * @param layout Will be set to the description of the column in the file.
+ * @param rowCount How many rows the column has.
+ * @param offset Offset of the end of the previous section.
+ * @return size_t Offset of the end of the sections of the column.
+ */
+static size_t layOutColumn(
+    const ColumnBuilder *column,
+    ColumnarColumn *layout,
+    size_t rowCount,
+    size_t offset)
+{
+  memset(layout, 0, sizeof(ColumnarColumn));
+
+  if (isDictionaryEncoded(column, rowCount))
+  {
+    layout->encoding = DICTIONARY_ENCODING;
+    layout->indexWidth = column->entryCount <= 256 ? 1 : 2;
+    layout->indexOffset = alignSection(offset);
+    layout->entryCount = column->entryCount;
+    layout->entriesOffset = alignSection(layout->indexOffset + rowCount * layout->indexWidth);
+    layout->textOffset = layout->entriesOffset + (column->entryCount + 1) * sizeof(uint64_t);
+    for (size_t i = 0; i < column->entryCount; i++)
+      layout->textLength += column->entries[i * 2 + 1];
+  }
+  else
+  {
+    layout->encoding = OFFSET_ENCODING;
+    layout->indexWidth = column->textLength <= UINT32_MAX ? 4 : 8;
+    layout->indexOffset = alignSection(offset);
+    layout->textOffset = layout->indexOffset + (rowCount + 1) * layout->indexWidth;
+    layout->textLength = column->textLength;
+  }
+
+  return layout->textOffset + layout->textLength;
+}
+
+/**
+ * Write zeros to a file up to the start of its next section.
+ *
+ * @param file The file.
+ * @param position The offset written up to, updated to the start of the section.
+ * @param offset The start of the section.
+ * @return bool Whether the zeros could be written.
+ */
+static bool padSection(FILE *file, size_t *position, size_t offset)
+{
+  static const char zeros[COLUMNAR_ALIGNMENT] = {0};
+  size_t length = offset - *position;
+
+  *position = offset;
+  return !length || fwrite(zeros, 1, length, file) == length;
+}
+
+/**
+ * Write unsigned integers of 1, 2, 4 or 8 bytes to a file.
+ *
+ * @param file The file.
+ * @param values The integers.
+ * @param count How many integers there are.
+ * @param width The size of each integer in the file.
+ * @param isWide Whether the integers are size_t rather than uint32_t.
+ * @return bool Whether the integers could be written.
+ */
+static bool writeWidths(FILE *file, const void *values, size_t count, uint32_t width, bool isWide)
+{
+  char *buffer = (char *)malloc(count * width + 1);
+
+  for (size_t i = 0; i < count; i++)
+  {
+    uint64_t value = isWide ? ((const size_t *)values)[i] : ((const uint32_t *)values)[i];
+
+    switch (width)
+    {
+    case 1:
+      ((uint8_t *)buffer)[i] = (uint8_t)value;
+      break;
+    case 2:
+      ((uint16_t *)buffer)[i] = (uint16_t)value;
+      break;
+    case 4:
+      ((uint32_t *)buffer)[i] = (uint32_t)value;
+      break;
+    default:
+      ((uint64_t *)buffer)[i] = value;
+    }
+  }
+
+  bool isWritten = fwrite(buffer, width, count, file) == count;
+  free(buffer);
+  return isWritten;
+}
+
+/**
+ * Write the sections of a column to a columnar file.
+ *
+ * @param file The file.
+ * @param position The offset written up to, updated to the end of the column.
+ * @param column The column being written.
+ * @param layout The description of the column in the file.
+ * @param rowCount How many rows the column has.
+ * @return bool Whether the column could be written.
+ */
+static bool writeColumn(
+    FILE *file,
+    size_t *position,
+    const ColumnBuilder *column,
+    const ColumnarColumn *layout,
+    size_t rowCount)
+{
+  if (!padSection(file, position, layout->indexOffset))
+    return false;
+
+  if (layout->encoding == OFFSET_ENCODING)
+  {
+    *position = layout->textOffset + layout->textLength;
+    return writeWidths(file, column->offsets, rowCount + 1, layout->indexWidth, true) &&
+           fwrite(column->text, 1, column->textLength, file) == column->textLength;
+  }
+
+  if (!writeWidths(file, column->codes, rowCount, layout->indexWidth, false))
+    return false;
+
+  *position = layout->indexOffset + rowCount * layout->indexWidth;
+  if (!padSection(file, position, layout->entriesOffset))
+    return false;
+
+  uint64_t *entries = (uint64_t *)malloc((column->entryCount + 1) * sizeof(uint64_t));
+  entries[0] = 0;
+  for (size_t i = 0; i < column->entryCount; i++)
+    entries[i + 1] = entries[i] + column->entries[i * 2 + 1];
+
+  bool isWritten = fwrite(entries, sizeof(uint64_t), column->entryCount + 1, file) ==
+                   column->entryCount + 1;
+  free(entries);
+
+  for (size_t i = 0; i < column->entryCount && isWritten; i++)
+  {
+    size_t length = column->entries[i * 2 + 1];
+    isWritten = fwrite(&column->text[column->entries[i * 2]], 1, length, file) == length;
+  }
+
+  *position = layout->textOffset + layout->textLength;
+  return isWritten;
+}
+
+bool writeColumnarFile(const ColumnarWriter *writer, const char columnarFilePath[])
+{
+  ColumnarHeader header;
+  memset(&header, 0, sizeof(header));
+  memcpy(header.magic, COLUMNAR_MAGIC, sizeof(header.magic));
+  header.rowCount = writer->rowCount;
+  header.columnCount = writer->columnCount;
+  header.headersOffset = sizeof(ColumnarHeader) + writer->columnCount * sizeof(ColumnarColumn);
+  header.headersLength = writer->headersLength;
+
+  size_t offset = header.headersOffset + header.headersLength;
+  if (writer->hasMissingCells)
+  {
+    header.cellCountsOffset = alignSection(offset);
+    offset = header.cellCountsOffset + writer->rowCount * sizeof(uint32_t);
+  }
+
+  ColumnarColumn *layouts = (ColumnarColumn *)malloc(
+      writer->columnCount * sizeof(ColumnarColumn) + 1);
+  for (size_t i = 0; i < writer->columnCount; i++)
+    offset = layOutColumn(&writer->columns[i], &layouts[i], writer->rowCount, offset);
+
+  FILE *file = fopen(columnarFilePath, "wb");
+
+  if (file == NULL)
+  {
+    fprintf(stderr, "Could not write the columnar file: '%s'\n", columnarFilePath);
+    free(layouts);
+    return false;
+  }
+
+  size_t position = header.headersOffset + header.headersLength;
+  bool isWritten = fwrite(&header, sizeof(header), 1, file) == 1 &&
+                   fwrite(layouts, sizeof(ColumnarColumn), writer->columnCount, file) ==
+                       writer->columnCount &&
+                   fwrite(writer->headers, 1, writer->headersLength, file) == writer->headersLength;
+
+  if (isWritten && writer->hasMissingCells)
+  {
+    isWritten = padSection(file, &position, header.cellCountsOffset) &&
+                fwrite(writer->cellCounts, sizeof(uint32_t), writer->rowCount, file) ==
+                    writer->rowCount;
+    position += writer->rowCount * sizeof(uint32_t);
+  }
+
+  for (size_t i = 0; i < writer->columnCount && isWritten; i++)
+    isWritten = writeColumn(file, &position, &writer->columns[i], &layouts[i], writer->rowCount);
+
+  if (fclose(file) != 0 || !isWritten)
+  {
+    fprintf(stderr, "Could not write the columnar file: '%s'\n", columnarFilePath);
+    remove(columnarFilePath);
+    isWritten = false;
+  }
+
+  free(layouts);
+  return isWritten;
+}
+
+void freeColumnarWriter(ColumnarWriter *writer)
+{
+  for (size_t i = 0; i < writer->columnCount; i++)
+  {
+    ColumnBuilder *column = &writer->columns[i];
+    free(column->text);
+    free(column->offsets);
+    if (column->isDictionary)
+      dropDictionary(column);
+  }
+
+  free(writer->columns);
+  free(writer->cellCounts);
+  free(writer->headers);
+  free(writer);
+}
+
+bool isColumnarFile(const char *data, size_t length)
+{
+  return length >= sizeof(ColumnarHeader) &&
+         memcmp(data, COLUMNAR_MAGIC, sizeof(((ColumnarHeader *)0)->magic)) == 0;
+}
+
+/**
+ * Check whether a section fits in a buffer.
+ *
+ * @param offset The offset of the section.
+ * @param count How many items the section has.
+ * @param size The size of each item.
+ * @param length The length of the buffer.
+ * @return bool Whether the section ends inside the buffer.
+ */
+static bool isInFile(size_t offset, size_t count, size_t size, size_t length)
+{
+  return offset <= length && (!size || count <= (length - offset) / size);
+}
+
+/**
+ * Check whether offsets into the text of a column are increasing and end inside it.
+ *
+ * @param offsets The offsets.
+ * @param count How many offsets there are.
+ * @param width The size of each offset.
+ * @param textLength The length of the text of the column.
+ * @return bool Whether every cell between two offsets is inside the text.
+ */
+static bool areOffsetsValid(const char *offsets, size_t count, uint32_t width, size_t textLength)
+{
+  size_t previous = 0;
+
+  for (size_t i = 0; i < count; i++)
+  {
+    size_t offset = readWidth(&offsets[i * width], width);
+
+    if (offset < previous || offset > textLength)
+      return false;
+    previous = offset;
+  }
+
+  return true;
+}
+
+/**
+ * Check whether the values of a section are all below a bound.
+ *
+ * @param values The values.
+ * @param count How many values there are.
+ * @param width The size of each value.
+ * @param bound The bound.
+ * @return bool Whether every value is less than the bound.
+ */
+static bool areValuesBelow(const char *values, size_t count, uint32_t width, size_t bound)
+{
+  for (size_t i = 0; i < count; i++)
+    if (readWidth(&values[i * width], width) >= bound)
+      return false;
+
+  return true;
+}
+
+bool openColumnarFile(ColumnarFile *file, const char *data, size_t length)
+{
+  if (!isColumnarFile(data, length))
+    return false;
+
+  const ColumnarHeader *header = (const ColumnarHeader *)data;
+  size_t rowCount = header->rowCount;
+
+  file->data = data;
+  file->header = header;
+  file->columns = (const ColumnarColumn *)(header + 1);
+  file->cellCounts = header->cellCountsOffset
+                         ? (const uint32_t *)&data[header->cellCountsOffset]
+                         : NULL;
+
+  if (!isInFile(sizeof(ColumnarHeader), header->columnCount, sizeof(ColumnarColumn), length) ||
+      !isInFile(header->headersOffset, header->headersLength, 1, length) ||
+      (file->cellCounts != NULL &&
+       (header->cellCountsOffset % sizeof(uint32_t) ||
+        !isInFile(header->cellCountsOffset, rowCount, sizeof(uint32_t), length))))
+    return false;
+
+  for (size_t i = 0; i < header->columnCount; i++)
+  {
+    const ColumnarColumn *column = &file->columns[i];
+    uint32_t width = column->indexWidth;
+    size_t indexCount = column->encoding == OFFSET_ENCODING ? rowCount + 1 : rowCount;
+
+    if ((width != 1 && width != 2 && width != 4 && width != 8) ||
+        column->indexOffset % width ||
+        rowCount == SIZE_MAX ||
+        !isInFile(column->indexOffset, indexCount, width, length) ||
+        !isInFile(column->textOffset, column->textLength, 1, length))
+      return false;
+
+    if (column->encoding == DICTIONARY_ENCODING &&
+        (column->entriesOffset % sizeof(uint64_t) ||
+         column->entryCount >= SIZE_MAX / sizeof(uint64_t) ||
+         !isInFile(column->entriesOffset, column->entryCount + 1, sizeof(uint64_t), length)))
+      return false;
+
+    if (column->encoding != OFFSET_ENCODING && column->encoding != DICTIONARY_ENCODING)
+      return false;
+
+    // Cells are read without any check, so a corrupt file must not point out of them
+    const char *index = &data[column->indexOffset];
+    bool isValid = column->encoding == OFFSET_ENCODING
+                       ? areOffsetsValid(index, indexCount, width, column->textLength)
+                       : areOffsetsValid(
+                             &data[column->entriesOffset],
+                             column->entryCount + 1,
+                             sizeof(uint64_t),
+                             column->textLength) &&
+                             areValuesBelow(index, indexCount, width, column->entryCount);
+
+    if (!isValid)
+      return false;
+  }
+
+  return file->cellCounts == NULL ||
+         areValuesBelow(
+             (const char *)file->cellCounts,
+             rowCount,
+             sizeof(uint32_t),
+             header->columnCount + 1);
+}
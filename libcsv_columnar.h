@@ -0,0 +1,256 @@
+#ifndef LIBCSV_COLUMNAR_H
+#define LIBCSV_COLUMNAR_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#include "libcsv_util.h"
+
+// The NUL byte keeps CSV text from ever starting like a columnar file
+#define COLUMNAR_MAGIC "LCSVCOL"
+#define COLUMNAR_MAX_DICTIONARY (1 << 16)
+#define COLUMNAR_MIN_SLOTS 64
+
+enum columnEncoding
+{
+  OFFSET_ENCODING = 1,
+  DICTIONARY_ENCODING = 2
+};
+
+/**
+ * Start of a columnar file. It is followed by one ColumnarColumn per column, then
+ * the sections they point to, each aligned on 8 bytes: the header row, the cell
+ * count of each row when some row lacks cells, and the data of each column.
+ */
+typedef struct
+{
+  char magic[8];
+  size_t rowCount;
+  size_t columnCount;
+  size_t headersOffset;
+  size_t headersLength;
+  // Offset of a uint32_t cell count per row, 0 if every row has every cell
+  size_t cellCountsOffset;
+} ColumnarHeader;
+
+/**
+ * Column of a columnar file, holding its cells as they appear in the CSV. Offset
+ * encoded columns keep rowCount + 1 offsets of indexWidth bytes into their text.
+ * Dictionary encoded columns keep a code of indexWidth bytes per row, and
+ * entryCount + 1 offsets of 8 bytes into the text of their distinct values.
+ */
+typedef struct
+{
+  enum columnEncoding encoding;
+  uint32_t indexWidth;
+  size_t indexOffset;
+  size_t entryCount;
+  size_t entriesOffset;
+  size_t textOffset;
+  size_t textLength;
+} ColumnarColumn;
+
+/**
+ * A columnar file mapped in memory.
+ */
+typedef struct
+{
+  const char *data;
+  const ColumnarHeader *header;
+  const ColumnarColumn *columns;
+  const uint32_t *cellCounts;
+} ColumnarFile;
+
+typedef struct
+{
+  char *text;
+  size_t textLength;
+  size_t textCapacity;
+  // One offset per cell into text, then the end of the last cell
+  size_t *offsets;
+  // Distinct cells and the code of each row, until there are too many of them
+  bool isDictionary;
+  uint32_t *codes;
+  size_t *entries;
+  size_t entryCount;
+  size_t entryCapacity;
+  uint64_t *slotHashes;
+  uint32_t *slotEntries;
+  size_t slotMask;
+} ColumnBuilder;
+
+typedef struct
+{
+  char *headers;
+  size_t headersLength;
+  size_t columnCount;
+  size_t rowCount;
+  size_t rowCapacity;
+  uint32_t *cellCounts;
+  bool hasMissingCells;
+  ColumnBuilder *columns;
+} ColumnarWriter;
+
+/**
+ * Create a writer collecting the rows of a CSV column by column in memory.
+ *
+ * @param columnCount How many columns the CSV has.
+ * @param headers The header row, not NUL-terminated.
+ * @param headersLength The length of the header row.
+ * @return ColumnarWriter* The created writer.
+ */
+ColumnarWriter *createColumnarWriter(
+    size_t columnCount,
+    const char headers[],
+    size_t headersLength);
+
+/**
+ * Add a row to a columnar writer, keeping its cells as they appear in the CSV.
+ *
+ * @param writer The writer.
+ * @param cells Array with one view per cell of the row.
+ * @param cellCount How many cells the row has, 0 for empty rows.
+ */
+void addColumnarRow(ColumnarWriter *writer, const CellView cells[], size_t cellCount);
+
+/**
+ * Write the rows of a columnar writer to a file. Columns with few distinct cells
+ * are dictionary encoded, the other ones offset encoded.
+ *
+ * @param writer The writer.
+ * @param columnarFilePath The file path of the columnar file.
+ * @return bool Whether the file could be written.
+ */
+bool writeColumnarFile(const ColumnarWriter *writer, const char columnarFilePath[]);
+
+/**
+ * Free a columnar writer.
+ *
+ * @param writer The writer to be freed.
+ */
+void freeColumnarWriter(ColumnarWriter *writer);
+
+/**
+ * Check whether a buffer holds a columnar file.
+ *
+ * @param data The buffer.
+ * @param length The length of the buffer.
+ * @return bool Whether the buffer starts like a columnar file.
+ */
+bool isColumnarFile(const char *data, size_t length);
+
+/**
+ * Open a columnar file mapped in memory, checking that its sections fit in it and
+ * that every offset, dictionary code and cell count stays inside its section.
+ *
+ * @param file Will be set to the sections of the file.
+ * @param data The buffer with the file, aligned on 8 bytes.
+ * @param length The length of the buffer.
+ * @return bool Whether the buffer holds a valid columnar file.
+ */
+bool openColumnarFile(ColumnarFile *file, const char *data, size_t length);
+
+/**
+ * Read an unsigned integer of 1, 2, 4 or 8 bytes.
+ *
+ * @param data Pointer to the integer, aligned on its size.
+ * @param width The size of the integer.
+ * @return size_t The integer.
+ */
+static inline size_t readWidth(const char *data, uint32_t width)
+{
+  switch (width)
+  {
+  case 1:
+    return *(const uint8_t *)data;
+  case 2:
+    return *(const uint16_t *)data;
+  case 4:
+    return *(const uint32_t *)data;
+  default:
+    return *(const uint64_t *)data;
+  }
+}
+
+/**
+ * Get the code of a cell of a dictionary encoded column.
+ *
+ * @param file The columnar file.
+ * @param column The column.
+ * @param row The row of the cell.
+ * @return size_t The index of the value of the cell in the dictionary.
+ */
+static inline size_t getColumnarCode(
+    const ColumnarFile *file,
+    const ColumnarColumn *column,
+    size_t row)
+{
+  return readWidth(
+      &file->data[column->indexOffset + row * column->indexWidth],
+      column->indexWidth);
+}
+
+/**
+ * Get a value of the dictionary of a column.
+ *
+ * @param file The columnar file.
+ * @param column The dictionary encoded column.
+ * @param entry The index of the value.
+ * @return CellView The value, as it appears in the CSV.
+ */
+static inline CellView getColumnarEntry(
+    const ColumnarFile *file,
+    const ColumnarColumn *column,
+    size_t entry)
+{
+  const uint64_t *entries = (const uint64_t *)&file->data[column->entriesOffset];
+  CellView cell = {
+      &file->data[column->textOffset + entries[entry]],
+      entries[entry + 1] - entries[entry]};
+  return cell;
+}
+
+/**
+ * Get the cells of a row of a columnar file.
+ *
+ * @param file The columnar file.
+ * @param row The row.
+ * @param cells Array which will contain one view per cell of the row.
+ * @param columnCount How many leading columns to get.
+ * @return size_t How many cells of the row were set, 0 for empty rows.
+ */
+static inline size_t getColumnarRow(
+    const ColumnarFile *file,
+    size_t row,
+    CellView cells[],
+    size_t columnCount)
+{
+  size_t cellCount = file->cellCounts != NULL
+                         ? file->cellCounts[row]
+                         : file->header->columnCount;
+
+  if (cellCount > columnCount)
+    cellCount = columnCount;
+
+  for (size_t i = 0; i < cellCount; i++)
+  {
+    const ColumnarColumn *column = &file->columns[i];
+
+    if (column->encoding == DICTIONARY_ENCODING)
+    {
+      cells[i] = getColumnarEntry(file, column, getColumnarCode(file, column, row));
+      continue;
+    }
+
+    const char *offsets = &file->data[column->indexOffset + row * column->indexWidth];
+    size_t start = readWidth(offsets, column->indexWidth);
+    cells[i].value = &file->data[column->textOffset + start];
+    cells[i].length = readWidth(offsets + column->indexWidth, column->indexWidth) - start;
+  }
+
+  return cellCount;
+}
+
+#endif
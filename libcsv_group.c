@@ -0,0 +1,543 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "libcsv_group.h"
+
+#define DISTINCT_KEY_PREFIX_SIZE (2 * sizeof(uint64_t))
+
+/**
+ * Initialize an empty key table.
+ *
+ * @param table The table to be initialized.
+ */
+static void initKeyTable(KeyTable *table)
+{
+  table->slots = (KeyEntry **)calloc(GROUP_MIN_SLOTS, sizeof(KeyEntry *));
+  table->slotMask = GROUP_MIN_SLOTS - 1;
+  table->entryCount = 0;
+}
+
+/**
+ * Find the slot of a key in a key table.
+ *
+ * @param table The table.
+ * @param key The key, does not need to be NUL-terminated.
+ * @param length The length of the key.
+ * @param hash The hash of the key.
+ * @return KeyEntry** The slot with the key, or the empty slot where it belongs.
+ */
+static KeyEntry **findKeySlot(
+    const KeyTable *table,
+    const char key[],
+    size_t length,
+    uint64_t hash)
+{
+  for (size_t i = hash & table->slotMask;; i = (i + 1) & table->slotMask)
+  {
+    KeyEntry *entry = table->slots[i];
+
+    if (entry == NULL ||
+        (entry->hash == hash &&
+         entry->keyLength == length &&
+         memcmp(entry->key, key, length) == 0))
+      return &table->slots[i];
+  }
+}
+
+/**
+ * Add an entry to a key table, doubling its slots when it gets half full.
+ *
+ * @param table The table.
+ * @param slot The empty slot returned by findKeySlot for the key of the entry.
+ * @param entry The entry, which must stay valid as long as the table.
+ */
+static void addKeyEntry(KeyTable *table, KeyEntry **slot, KeyEntry *entry)
+{
+  *slot = entry;
+
+  if (++table->entryCount * 2 <= table->slotMask + 1)
+    return;
+
+  size_t slotCount = (table->slotMask + 1) * 2;
+  KeyEntry **slots = (KeyEntry **)calloc(slotCount, sizeof(KeyEntry *));
+
+  for (size_t i = 0; i <= table->slotMask; i++)
+  {
+    KeyEntry *moved = table->slots[i];
+    if (moved == NULL)
+      continue;
+
+    size_t j = moved->hash & (slotCount - 1);
+    while (slots[j] != NULL)
+      j = (j + 1) & (slotCount - 1);
+    slots[j] = moved;
+  }
+
+  free(table->slots);
+  table->slots = slots;
+  table->slotMask = slotCount - 1;
+}
+
+/**
+ * Make room for a key of a given length in the key buffer of an aggregator.
+ *
+ * @param aggregator The aggregator.
+ * @param length The length of the key.
+ */
+static void reserveKey(CsvAggregator *aggregator, size_t length)
+{
+  if (length <= aggregator->keyCapacity)
+    return;
+
+  while (aggregator->keyCapacity < length)
+    aggregator->keyCapacity *= 2;
+  aggregator->key = (char *)realloc(aggregator->key, aggregator->keyCapacity);
+}
+
+CsvAggregator *createAggregator(
+    const size_t groupColumns[],
+    size_t groupCount,
+    const Aggregate aggregates[],
+    size_t aggregateCount)
+{
+  CsvAggregator *aggregator = (CsvAggregator *)malloc(sizeof(CsvAggregator));
+  aggregator->groupColumns = groupColumns;
+  aggregator->groupCount = groupCount;
+  aggregator->aggregates = aggregates;
+  aggregator->aggregateCount = aggregateCount;
+  initKeyTable(&aggregator->groupTable);
+  initKeyTable(&aggregator->distinctTable);
+  aggregator->groups = NULL;
+  aggregator->totalGroups = 0;
+  aggregator->groupCapacity = 0;
+  initArena(&aggregator->arena, ARENA_BLOCK_SIZE);
+  aggregator->keyCapacity = 256;
+  aggregator->key = (char *)malloc(aggregator->keyCapacity);
+  return aggregator;
+}
+
+/**
+ * Add a new group to an aggregator, with no rows yet.
+ *
+ * @param aggregator The aggregator.
+ * @param slot The empty slot returned by findKeySlot for the key of the group.
+ * @param key The key of the group, does not need to be NUL-terminated.
+ * @param length The length of the key.
+ * @param hash The hash of the key.
+ * @param firstRow Position of the first row of the group in the input.
+ * @return CsvGroup* The created group.
+ */
+static CsvGroup *createGroup(
+    CsvAggregator *aggregator,
+    KeyEntry **slot,
+    const char key[],
+    size_t length,
+    uint64_t hash,
+    uint64_t firstRow)
+{
+  size_t valuesSize = aggregator->aggregateCount * sizeof(AggregateValue);
+  CsvGroup *group = (CsvGroup *)arenaAlloc(&aggregator->arena, sizeof(CsvGroup) + valuesSize);
+  group->entry.hash = hash;
+  group->entry.key = arenaStrndup(&aggregator->arena, key, length);
+  group->entry.keyLength = length;
+  group->index = aggregator->totalGroups;
+  group->firstRow = firstRow;
+  memset(group->values, 0, valuesSize);
+
+  if (aggregator->totalGroups == aggregator->groupCapacity)
+  {
+    aggregator->groupCapacity = aggregator->groupCapacity ? aggregator->groupCapacity * 2 : 64;
+    aggregator->groups = (CsvGroup **)realloc(
+        aggregator->groups,
+        aggregator->groupCapacity * sizeof(CsvGroup *));
+  }
+
+  aggregator->groups[aggregator->totalGroups++] = group;
+  addKeyEntry(&aggregator->groupTable, slot, &group->entry);
+  return group;
+}
+
+/**
+ * Parse a cell in the type of an aggregate. Enclosing quotes are ignored, since
+ * escaped quotes never appear in values of the other types than text.
+ *
+ * @param cell The cell to be parsed.
+ * @param type The type of the aggregate.
+ * @param value Will be set to the parsed value, and to the cell as its text.
+ * @return bool Whether the cell is valid for the type.
+ */
+static bool parseAggregateValue(const CellView *cell, enum cellType type, AggregateValue *value)
+{
+  CellView unquoted = *cell;
+
+  value->text = (char *)cell->value;
+  value->textLength = cell->length;
+
+  if (type != TEXT &&
+      unquoted.length >= 2 &&
+      unquoted.value[0] == *QUOTE &&
+      unquoted.value[unquoted.length - 1] == *QUOTE)
+  {
+    unquoted.value++;
+    unquoted.length -= 2;
+  }
+
+  switch (type)
+  {
+  case INTEGER:
+    return parseInteger(&unquoted, &value->integerValue);
+  case DATE:
+    return parseDate(&unquoted, &value->integerValue);
+  case FLOAT:
+    return parseFloat(&unquoted, &value->floatValue);
+  default:
+    return true;
+  }
+}
+
+/**
+ * Compare two values of a minimum or maximum aggregate.
+ *
+ * @param type The type of the aggregate.
+ * @param a The first value.
+ * @param b The second value.
+ * @return int Negative, zero or positive if a is less, equal or greater than b.
+ */
+static int compareAggregateValues(enum cellType type, const AggregateValue *a, const AggregateValue *b)
+{
+  CellView text = {a->text, a->textLength};
+
+  switch (type)
+  {
+  case INTEGER:
+  case DATE:
+    return (a->integerValue > b->integerValue) - (a->integerValue < b->integerValue);
+  case FLOAT:
+    return (a->floatValue > b->floatValue) - (a->floatValue < b->floatValue);
+  default:
+    return compareCell(&text, b->text, b->textLength);
+  }
+}
+
+/**
+ * Keep a value in a minimum or maximum aggregate if it is the new minimum or
+ * maximum, copying its text.
+ *
+ * @param aggregate The aggregate.
+ * @param value The value of the aggregate for a group.
+ * @param candidate The value which may replace it.
+ */
+static void updateExtreme(
+    const Aggregate *aggregate,
+    AggregateValue *value,
+    const AggregateValue *candidate)
+{
+  if (value->count)
+  {
+    int comparison = compareAggregateValues(aggregate->type, candidate, value);
+
+    if (aggregate->function == MINIMUM ? comparison >= 0 : comparison <= 0)
+      return;
+  }
+
+  value->integerValue = candidate->integerValue;
+  value->floatValue = candidate->floatValue;
+
+  if (candidate->textLength > value->textCapacity)
+  {
+    value->textCapacity = candidate->textLength;
+    value->text = (char *)realloc(value->text, value->textCapacity);
+  }
+
+  if (candidate->textLength)
+    memcpy(value->text, candidate->text, candidate->textLength);
+  value->textLength = candidate->textLength;
+}
+
+/**
+ * Count a value as distinct for an aggregate of a group, unless it was already.
+ *
+ * @param aggregator The aggregator.
+ * @param group The group.
+ * @param aggregateIndex The index of the aggregate.
+ * @param value The value, as it appears in the CSV.
+ * @param length The length of the value.
+ */
+static void addDistinctValue(
+    CsvAggregator *aggregator,
+    CsvGroup *group,
+    size_t aggregateIndex,
+    const char value[],
+    size_t length)
+{
+  uint64_t prefix[2] = {group->index, aggregateIndex};
+  size_t keyLength = DISTINCT_KEY_PREFIX_SIZE + length;
+
+  reserveKey(aggregator, keyLength);
+  memcpy(aggregator->key, prefix, sizeof(prefix));
+  memcpy(&aggregator->key[DISTINCT_KEY_PREFIX_SIZE], value, length);
+
+  uint64_t hash = hashBytes(aggregator->key, keyLength);
+  KeyEntry **slot = findKeySlot(&aggregator->distinctTable, aggregator->key, keyLength, hash);
+
+  if (*slot != NULL)
+    return;
+
+  KeyEntry *entry = (KeyEntry *)arenaAlloc(&aggregator->arena, sizeof(KeyEntry));
+  entry->hash = hash;
+  entry->key = arenaStrndup(&aggregator->arena, aggregator->key, keyLength);
+  entry->keyLength = keyLength;
+  addKeyEntry(&aggregator->distinctTable, slot, entry);
+  group->values[aggregateIndex].count++;
+}
+
+void addAggregatedRow(
+    CsvAggregator *aggregator,
+    const CellView cells[],
+    size_t cellCount,
+    uint64_t row)
+{
+  const CellView empty = {"", 0};
+  size_t keyLength = 0;
+
+  for (size_t i = 0; i < aggregator->groupCount; i++)
+  {
+    size_t column = aggregator->groupColumns[i];
+    const CellView *cell = column < cellCount ? &cells[column] : &empty;
+
+    reserveKey(aggregator, keyLength + cell->length + 1);
+    if (i)
+      aggregator->key[keyLength++] = *VALUE_SEPARATOR;
+    memcpy(&aggregator->key[keyLength], cell->value, cell->length);
+    keyLength += cell->length;
+  }
+
+  uint64_t hash = hashBytes(aggregator->key, keyLength);
+  KeyEntry **slot = findKeySlot(&aggregator->groupTable, aggregator->key, keyLength, hash);
+  CsvGroup *group = *slot != NULL
+                        ? (CsvGroup *)*slot
+                        : createGroup(aggregator, slot, aggregator->key, keyLength, hash, row);
+
+  for (size_t i = 0; i < aggregator->aggregateCount; i++)
+  {
+    const Aggregate *aggregate = &aggregator->aggregates[i];
+    AggregateValue *value = &group->values[i];
+    const CellView *cell = aggregate->column < cellCount ? &cells[aggregate->column] : &empty;
+    AggregateValue parsed;
+
+    switch (aggregate->function)
+    {
+    case COUNT:
+      value->count++;
+      break;
+    case SUM:
+    case AVERAGE:
+      if (!parseAggregateValue(cell, aggregate->type, &parsed))
+        break;
+      if (aggregate->type == INTEGER)
+        value->integerValue += parsed.integerValue;
+      else
+        value->floatValue += parsed.floatValue;
+      value->count++;
+      break;
+    case MINIMUM:
+    case MAXIMUM:
+      if (!parseAggregateValue(cell, aggregate->type, &parsed))
+        break;
+      updateExtreme(aggregate, value, &parsed);
+      value->count++;
+      break;
+    case COUNT_DISTINCT:
+      addDistinctValue(aggregator, group, i, cell->value, cell->length);
+      break;
+    }
+  }
+}
+
+void mergeAggregator(CsvAggregator *aggregator, const CsvAggregator *partial)
+{
+  size_t *groupIndexes = (size_t *)malloc((partial->totalGroups + 1) * sizeof(size_t));
+
+  for (size_t i = 0; i < partial->totalGroups; i++)
+  {
+    const CsvGroup *partialGroup = partial->groups[i];
+    const KeyEntry *entry = &partialGroup->entry;
+    KeyEntry **slot = findKeySlot(&aggregator->groupTable, entry->key, entry->keyLength, entry->hash);
+    CsvGroup *group = *slot != NULL
+                          ? (CsvGroup *)*slot
+                          : createGroup(
+                                aggregator,
+                                slot,
+                                entry->key,
+                                entry->keyLength,
+                                entry->hash,
+                                partialGroup->firstRow);
+
+    if (partialGroup->firstRow < group->firstRow)
+      group->firstRow = partialGroup->firstRow;
+    groupIndexes[partialGroup->index] = group->index;
+
+    for (size_t j = 0; j < aggregator->aggregateCount; j++)
+    {
+      const Aggregate *aggregate = &aggregator->aggregates[j];
+      AggregateValue *value = &group->values[j];
+      const AggregateValue *partialValue = &partialGroup->values[j];
+
+      switch (aggregate->function)
+      {
+      case SUM:
+      case AVERAGE:
+        if (aggregate->type == INTEGER)
+          value->integerValue += partialValue->integerValue;
+        else
+          value->floatValue += partialValue->floatValue;
+        value->count += partialValue->count;
+        break;
+      case MINIMUM:
+      case MAXIMUM:
+        if (partialValue->count)
+          updateExtreme(aggregate, value, partialValue);
+        value->count += partialValue->count;
+        break;
+      case COUNT:
+        value->count += partialValue->count;
+        break;
+      case COUNT_DISTINCT:
+        // Counted again below, since both sides may have seen the same values
+        break;
+      }
+    }
+  }
+
+  for (size_t i = 0; i <= partial->distinctTable.slotMask; i++)
+  {
+    const KeyEntry *entry = partial->distinctTable.slots[i];
+    if (entry == NULL)
+      continue;
+
+    uint64_t prefix[2];
+    memcpy(prefix, entry->key, sizeof(prefix));
+
+    addDistinctValue(
+        aggregator,
+        aggregator->groups[groupIndexes[prefix[0]]],
+        prefix[1],
+        &entry->key[DISTINCT_KEY_PREFIX_SIZE],
+        entry->keyLength - DISTINCT_KEY_PREFIX_SIZE);
+  }
+
+  free(groupIndexes);
+}
+
+/**
+ * Order groups by the position of their first row.
+ */
+static int compareGroups(const void *a, const void *b)
+{
+  const CsvGroup *groupA = *(CsvGroup *const *)a;
+  const CsvGroup *groupB = *(CsvGroup *const *)b;
+
+  return (groupA->firstRow > groupB->firstRow) - (groupA->firstRow < groupB->firstRow);
+}
+
+/**
+ * Write the value of an aggregate for a group to a sink. Sums, averages, minimums
+ * and maximums without any valid value are empty.
+ *
+ * @param aggregate The aggregate.
+ * @param value The value of the aggregate for the group.
+ * @param sink The sink.
+ */
+static void printAggregateValue(const Aggregate *aggregate, const AggregateValue *value, CsvSink *sink)
+{
+  char buffer[32];
+  int length = 0;
+
+  if (aggregate->function == COUNT || aggregate->function == COUNT_DISTINCT)
+    length = snprintf(buffer, sizeof(buffer), "%llu", (unsigned long long)value->count);
+  else if (!value->count)
+    return;
+  else if (aggregate->function == MINIMUM || aggregate->function == MAXIMUM)
+  {
+    if (value->textLength)
+      writeSink(sink, value->text, value->textLength);
+    return;
+  }
+  else if (aggregate->function == AVERAGE)
+    length = snprintf(
+        buffer,
+        sizeof(buffer),
+        "%.15g",
+        (aggregate->type == INTEGER ? (double)value->integerValue : value->floatValue) /
+            value->count);
+  else if (aggregate->type == INTEGER)
+    length = snprintf(buffer, sizeof(buffer), "%lld", value->integerValue);
+  else
+    length = snprintf(buffer, sizeof(buffer), "%.15g", value->floatValue);
+
+  writeSink(sink, buffer, length);
+}
+
+void printAggregatedRows(
+    CsvAggregator *aggregator,
+    const Csv *headers,
+    char *const labels[],
+    size_t offset,
+    size_t limit,
+    CsvSink *sink)
+{
+  Csv *resultCsv = createSizedCsv(1024);
+
+  for (size_t i = 0; i < aggregator->groupCount; i++)
+    addColumn(resultCsv, headers->columns[aggregator->groupColumns[i]]->header, true);
+  for (size_t i = 0; i < aggregator->aggregateCount; i++)
+    addColumn(resultCsv, labels[i], true);
+
+  printHeaders(resultCsv, sink);
+  freeCsv(resultCsv);
+
+  // Aggregates over every row have a value even without rows
+  if (!aggregator->groupCount && !aggregator->totalGroups)
+  {
+    uint64_t hash = hashBytes("", 0);
+    createGroup(aggregator, findKeySlot(&aggregator->groupTable, "", 0, hash), "", 0, hash, 0);
+  }
+
+  qsort(aggregator->groups, aggregator->totalGroups, sizeof(CsvGroup *), compareGroups);
+
+  size_t end = aggregator->totalGroups;
+  if (limit && offset < end && limit < end - offset)
+    end = offset + limit;
+
+  for (size_t i = offset; i < end; i++)
+  {
+    const CsvGroup *group = aggregator->groups[i];
+    writeSink(sink, group->entry.key, group->entry.keyLength);
+
+    for (size_t j = 0; j < aggregator->aggregateCount; j++)
+    {
+      if (aggregator->groupCount || j)
+        putSink(sink, *VALUE_SEPARATOR);
+      printAggregateValue(&aggregator->aggregates[j], &group->values[j], sink);
+    }
+
+    putSink(sink, *LINE_SEPARATOR);
+  }
+}
+
+void freeAggregator(CsvAggregator *aggregator)
+{
+  for (size_t i = 0; i < aggregator->totalGroups; i++)
+    for (size_t j = 0; j < aggregator->aggregateCount; j++)
+      free(aggregator->groups[i]->values[j].text);
+
+  free(aggregator->groupTable.slots);
+  free(aggregator->distinctTable.slots);
+  free(aggregator->groups);
+  free(aggregator->key);
+  freeArena(&aggregator->arena);
+  free(aggregator);
+}
@@ -0,0 +1,166 @@
+#ifndef LIBCSV_GROUP_H
+#define LIBCSV_GROUP_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "libcsv_util.h"
+
+#define GROUP_MIN_SLOTS 64
+
+enum aggregateFunction
+{
+  COUNT = 1,
+  SUM = 2,
+  MINIMUM = 3,
+  MAXIMUM = 4,
+  AVERAGE = 5,
+  COUNT_DISTINCT = 6
+};
+
+typedef struct
+{
+  enum aggregateFunction function;
+  // The aggregated column, NO_CELL for COUNT
+  size_t column;
+  enum cellType type;
+} Aggregate;
+
+/**
+ * Entry of a KeyTable. Structures kept in a table start with it.
+ */
+typedef struct
+{
+  uint64_t hash;
+  const char *key;
+  size_t keyLength;
+} KeyEntry;
+
+/**
+ * Open-addressing hash table of entries keyed on raw bytes, which never holds more
+ * entries than half its slots.
+ */
+typedef struct
+{
+  KeyEntry **slots;
+  size_t slotMask;
+  size_t entryCount;
+} KeyTable;
+
+typedef struct
+{
+  long long integerValue;
+  double floatValue;
+  // Rows counted, valid values summed or compared, or distinct values
+  uint64_t count;
+  // The cell with the minimum or maximum value, as it appears in the CSV
+  char *text;
+  size_t textLength;
+  size_t textCapacity;
+} AggregateValue;
+
+/**
+ * Group of rows with the same values in the group columns. Its key is made of
+ * those values as they appear in the CSV, joined by value separators, so it is
+ * also the start of its row in the result.
+ */
+typedef struct
+{
+  KeyEntry entry;
+  // Index of the group in the groups of its aggregator
+  size_t index;
+  // Position of the first row of the group in the input, which orders the result
+  uint64_t firstRow;
+  AggregateValue values[];
+} CsvGroup;
+
+typedef struct
+{
+  const size_t *groupColumns;
+  size_t groupCount;
+  const Aggregate *aggregates;
+  size_t aggregateCount;
+  KeyTable groupTable;
+  // Pairs of a group and aggregate with each value they counted as distinct
+  KeyTable distinctTable;
+  CsvGroup **groups;
+  size_t totalGroups;
+  size_t groupCapacity;
+  Arena arena;
+  // The key being looked up
+  char *key;
+  size_t keyCapacity;
+} CsvAggregator;
+
+/**
+ * Create an aggregator collecting the rows of a CSV into groups.
+ *
+ * @param groupColumns The columns whose values define the groups, none for a single
+ * group with every row.
+ * @param groupCount How many group columns there are.
+ * @param aggregates The aggregates computed for each group.
+ * @param aggregateCount How many aggregates there are.
+ * @return CsvAggregator* The created aggregator.
+ */
+CsvAggregator *createAggregator(
+    const size_t groupColumns[],
+    size_t groupCount,
+    const Aggregate aggregates[],
+    size_t aggregateCount);
+
+/**
+ * Add a row to the group with its values, creating the group if needed.
+ *
+ * Sums and averages skip the cells which are not valid for their type, as do typed
+ * minimums and maximums. Text cells are compared and counted as distinct as they
+ * appear in the CSV.
+ *
+ * @param aggregator The aggregator.
+ * @param cells Array with one view per cell of the row.
+ * @param cellCount How many cells the row has. Missing cells are empty.
+ * @param row Position of the row in the input, increasing from row to row.
+ */
+void addAggregatedRow(
+    CsvAggregator *aggregator,
+    const CellView cells[],
+    size_t cellCount,
+    uint64_t row);
+
+/**
+ * Merge the groups of an aggregator into another one with the same groups and
+ * aggregates, such as the partial aggregates of a worker thread.
+ *
+ * @param aggregator The aggregator receiving the groups.
+ * @param partial The aggregator whose groups are merged.
+ */
+void mergeAggregator(CsvAggregator *aggregator, const CsvAggregator *partial);
+
+/**
+ * Write the groups of an aggregator to a sink, in the order of their first row.
+ * Without group columns, a single row is written even if no row was added.
+ *
+ * @param aggregator The aggregator, which must not be added to afterwards.
+ * @param headers The CSV structure with the columns of the rows, whose headers
+ * name the group columns.
+ * @param labels The header of each aggregate in the result.
+ * @param offset How many of the first groups to skip.
+ * @param limit How many groups to write after the skipped ones, 0 for all of them.
+ * @param sink The sink the result is written to.
+ */
+void printAggregatedRows(
+    CsvAggregator *aggregator,
+    const Csv *headers,
+    char *const labels[],
+    size_t offset,
+    size_t limit,
+    CsvSink *sink);
+
+/**
+ * Free the memory of an aggregator.
+ *
+ * @param aggregator The aggregator to be freed.
+ */
+void freeAggregator(CsvAggregator *aggregator);
+
+#endif
@@ -0,0 +1,657 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "libcsv_index.h"
+
+#define INDEX_MIN_BLOCKS 16
+#define INDEX_MIN_ROWS 256
+
+CsvIndex *createIndex(size_t columnCount, size_t blockSize)
+{
+  CsvIndex *index = (CsvIndex *)calloc(1, sizeof(CsvIndex));
+  memcpy(index->header.magic, INDEX_MAGIC, sizeof(index->header.magic));
+  index->header.blockSize = blockSize;
+  index->header.columnCount = columnCount;
+  index->hashes = (uint64_t **)calloc(columnCount, sizeof(uint64_t *));
+  return index;
+}
+
+/**
+ * Get the zones of the block being built, starting them when it has no rows yet.
+ *
+ * @param index The index.
+ * @return ColumnZone* The zones of the block, one per column.
+ */
+static ColumnZone *getBlockZones(CsvIndex *index)
+{
+  size_t columnCount = index->header.columnCount;
+
+  if (index->header.blockCount == index->blockCapacity)
+  {
+    index->blockCapacity = index->blockCapacity ? index->blockCapacity * 2 : INDEX_MIN_BLOCKS;
+    index->blocks = (IndexBlock *)realloc(
+        index->blocks,
+        index->blockCapacity * sizeof(IndexBlock));
+    index->zones = (ColumnZone *)realloc(
+        index->zones,
+        index->blockCapacity * columnCount * sizeof(ColumnZone));
+  }
+
+  ColumnZone *zones = &index->zones[index->header.blockCount * columnCount];
+
+  if (!index->rowCount)
+    memset(zones, 0, columnCount * sizeof(ColumnZone));
+
+  return zones;
+}
+
+/**
+ * Set a text bound of a zone to the first bytes of a value.
+ *
+ * @param bound The bound.
+ * @param boundLength Will be set to the length of the bound.
+ * @param isTruncated Will be set to whether the value is longer than the bound.
+ * @param cell The value.
+ */
+static void setTextBound(char bound[], uint8_t *boundLength, bool *isTruncated, const CellView *cell)
+{
+  size_t length = cell->length < INDEX_TEXT_BOUND_LENGTH ? cell->length : INDEX_TEXT_BOUND_LENGTH;
+
+  memcpy(bound, cell->value, length);
+  *boundLength = (uint8_t)length;
+  *isTruncated = cell->length > INDEX_TEXT_BOUND_LENGTH;
+}
+
+/**
+ * Add a value to the text bounds of a zone. Values sharing the first bytes of a
+ * bound keep it, and only change whether the bound is the whole value.
+ *
+ * @param zone The zone.
+ * @param cell The value.
+ * @param isFirst Whether it is the first value of the zone.
+ */
+static void addTextBounds(ColumnZone *zone, const CellView *cell, bool isFirst)
+{
+  if (isFirst)
+  {
+    setTextBound(zone->textMinimum, &zone->textMinimumLength, &zone->isTextMinimumTruncated, cell);
+    setTextBound(zone->textMaximum, &zone->textMaximumLength, &zone->isTextMaximumTruncated, cell);
+    return;
+  }
+
+  CellView prefix = {cell->value, cell->length};
+  if (prefix.length > INDEX_TEXT_BOUND_LENGTH)
+    prefix.length = INDEX_TEXT_BOUND_LENGTH;
+
+  int comparison = compareCell(&prefix, zone->textMinimum, zone->textMinimumLength);
+  if (comparison < 0)
+    setTextBound(zone->textMinimum, &zone->textMinimumLength, &zone->isTextMinimumTruncated, cell);
+  else if (comparison == 0 && cell->length <= INDEX_TEXT_BOUND_LENGTH)
+    zone->isTextMinimumTruncated = false;
+
+  comparison = compareCell(&prefix, zone->textMaximum, zone->textMaximumLength);
+  if (comparison > 0)
+    setTextBound(zone->textMaximum, &zone->textMaximumLength, &zone->isTextMaximumTruncated, cell);
+  else if (comparison == 0 && cell->length > INDEX_TEXT_BOUND_LENGTH)
+    zone->isTextMaximumTruncated = true;
+}
+
+/**
+ * Add a value to the ranges of a zone for each type it is valid for.
+ *
+ * @param zone The zone.
+ * @param cell The value.
+ */
+static void addTypedBounds(ColumnZone *zone, const CellView *cell)
+{
+  long long integerValue;
+  double floatValue;
+
+  if (parseInteger(cell, &integerValue))
+  {
+    if (!zone->integerCount++ || integerValue < zone->integerMinimum)
+      zone->integerMinimum = integerValue;
+    if (zone->integerCount == 1 || integerValue > zone->integerMaximum)
+      zone->integerMaximum = integerValue;
+  }
+
+  if (parseDate(cell, &integerValue))
+  {
+    if (!zone->dateCount++ || integerValue < zone->dateMinimum)
+      zone->dateMinimum = integerValue;
+    if (zone->dateCount == 1 || integerValue > zone->dateMaximum)
+      zone->dateMaximum = integerValue;
+  }
+
+  if (parseFloat(cell, &floatValue))
+  {
+    if (!zone->floatCount++ || floatValue < zone->floatMinimum)
+      zone->floatMinimum = floatValue;
+    if (zone->floatCount == 1 || floatValue > zone->floatMaximum)
+      zone->floatMaximum = floatValue;
+  }
+}
+
+void addIndexedRow(CsvIndex *index, const CellView cells[], size_t cellCount)
+{
+  ColumnZone *zones = getBlockZones(index);
+  size_t columnCount = index->header.columnCount;
+
+  if (index->rowCount == index->hashCapacity)
+  {
+    index->hashCapacity = index->hashCapacity ? index->hashCapacity * 2 : INDEX_MIN_ROWS;
+    for (size_t i = 0; i < columnCount; i++)
+      index->hashes[i] = (uint64_t *)realloc(
+          index->hashes[i],
+          index->hashCapacity * sizeof(uint64_t));
+  }
+
+  for (size_t i = 0; i < columnCount; i++)
+  {
+    ColumnZone *zone = &zones[i];
+
+    if (i >= cellCount)
+    {
+      zone->missingCount++;
+      continue;
+    }
+
+    // Zones hold the values the filters compare, so quoted cells are unquoted
+    CellView cell = cells[i];
+    if (cell.length && *cell.value == *QUOTE)
+    {
+      if (cell.length > index->valueCapacity)
+      {
+        index->valueCapacity = cell.length;
+        index->value = (char *)realloc(index->value, index->valueCapacity);
+      }
+      cell.length = unquoteCell(&cells[i], index->value);
+      cell.value = index->value;
+    }
+
+    size_t valueCount = index->rowCount - zone->missingCount;
+    addTextBounds(zone, &cell, valueCount == 0);
+    addTypedBounds(zone, &cell);
+    index->hashes[i][valueCount] = hashBytes(cell.value, cell.length);
+  }
+
+  index->rowCount++;
+}
+
+/**
+ * Compare two hashes, to sort them.
+ *
+ * @param a Pointer to the first hash.
+ * @param b Pointer to the second hash.
+ * @return int Negative, zero or positive if a is less, equal or greater than b.
+ */
+static int compareHashes(const void *a, const void *b)
+{
+  uint64_t hashA = *(const uint64_t *)a;
+  uint64_t hashB = *(const uint64_t *)b;
+
+  return (hashA > hashB) - (hashA < hashB);
+}
+
+/**
+ * Get one of the bits of a bloom filter set for a hash, combining its two halves.
+ *
+ * @param hash The hash.
+ * @param probe Which of the INDEX_BLOOM_HASHES bits to get.
+ * @param bloomBits The size of the bloom filter in bits.
+ * @return size_t The bit.
+ */
+static inline size_t getBloomBit(uint64_t hash, uint32_t probe, size_t bloomBits)
+{
+  uint32_t bit = (uint32_t)hash + probe * ((uint32_t)(hash >> 32) | 1);
+
+  return (size_t)(((uint64_t)bit * bloomBits) >> 32);
+}
+
+void endIndexBlock(CsvIndex *index, size_t offset, size_t length)
+{
+  ColumnZone *zones = getBlockZones(index);
+  IndexBlock *block = &index->blocks[index->header.blockCount];
+  block->offset = offset;
+  block->length = length;
+  block->rowCount = index->rowCount;
+
+  for (size_t i = 0; i < index->header.columnCount; i++)
+  {
+    ColumnZone *zone = &zones[i];
+    uint64_t *hashes = index->hashes[i];
+    size_t valueCount = index->rowCount - zone->missingCount;
+    size_t distinctCount = 0;
+
+    if (valueCount)
+      qsort(hashes, valueCount, sizeof(uint64_t), compareHashes);
+    for (size_t j = 0; j < valueCount; j++)
+      if (!j || hashes[j] != hashes[j - 1])
+        hashes[distinctCount++] = hashes[j];
+
+    zone->bloomOffset = index->header.bloomLength;
+    zone->bloomBits = (distinctCount * INDEX_BLOOM_BITS_PER_VALUE + 63) / 64 * 64;
+
+    size_t bloomLength = zone->bloomBits / 8;
+    if (index->header.bloomLength + bloomLength > index->bloomCapacity)
+    {
+      while (index->header.bloomLength + bloomLength > index->bloomCapacity)
+        index->bloomCapacity = index->bloomCapacity ? index->bloomCapacity * 2 : ARENA_BLOCK_SIZE;
+      index->blooms = (unsigned char *)realloc(index->blooms, index->bloomCapacity);
+    }
+
+    unsigned char *bloom = &index->blooms[zone->bloomOffset];
+    memset(bloom, 0, bloomLength);
+    for (size_t j = 0; j < distinctCount; j++)
+      for (uint32_t probe = 0; probe < INDEX_BLOOM_HASHES; probe++)
+      {
+        size_t bit = getBloomBit(hashes[j], probe, zone->bloomBits);
+        bloom[bit / 8] |= 1 << (bit % 8);
+      }
+
+    index->header.bloomLength += bloomLength;
+  }
+
+  index->header.blockCount++;
+  index->rowCount = 0;
+}
+
+/**
+ * Get the file path of the index of a CSV file.
+ *
+ * @param csvFilePath The file path of the CSV.
+ * @return char* The file path of the index, to be freed by the caller.
+ */
+static char *getIndexPath(const char csvFilePath[])
+{
+  size_t length = strlen(csvFilePath);
+  char *indexPath = (char *)malloc(length + sizeof(INDEX_FILE_SUFFIX));
+
+  memcpy(indexPath, csvFilePath, length);
+  memcpy(&indexPath[length], INDEX_FILE_SUFFIX, sizeof(INDEX_FILE_SUFFIX));
+  return indexPath;
+}
+
+bool writeIndex(CsvIndex *index, const char csvFilePath[], const struct stat *csvFileStat)
+{
+  IndexHeader *header = &index->header;
+  header->fileSize = csvFileStat->st_size;
+  header->modifiedSeconds = csvFileStat->st_mtim.tv_sec;
+  header->modifiedNanoseconds = csvFileStat->st_mtim.tv_nsec;
+
+  char *indexPath = getIndexPath(csvFilePath);
+  FILE *indexFile = fopen(indexPath, "wb");
+
+  if (indexFile == NULL)
+  {
+    fprintf(stderr, "Could not write the index file: '%s'\n", indexPath);
+    free(indexPath);
+    return false;
+  }
+
+  size_t zoneCount = header->blockCount * header->columnCount;
+  bool isWritten = fwrite(header, sizeof(IndexHeader), 1, indexFile) == 1 &&
+                   fwrite(index->blocks, sizeof(IndexBlock), header->blockCount, indexFile) ==
+                       header->blockCount &&
+                   fwrite(index->zones, sizeof(ColumnZone), zoneCount, indexFile) == zoneCount &&
+                   fwrite(index->blooms, 1, header->bloomLength, indexFile) == header->bloomLength;
+
+  if (fclose(indexFile) != 0 || !isWritten)
+  {
+    fprintf(stderr, "Could not write the index file: '%s'\n", indexPath);
+    remove(indexPath);
+    isWritten = false;
+  }
+
+  free(indexPath);
+  return isWritten;
+}
+
+CsvIndex *readIndex(const char csvFilePath[], const struct stat *csvFileStat)
+{
+  char *indexPath = getIndexPath(csvFilePath);
+  FILE *indexFile = fopen(indexPath, "rb");
+  free(indexPath);
+
+  if (indexFile == NULL)
+    return NULL;
+
+  IndexHeader header;
+
+  if (fread(&header, sizeof(IndexHeader), 1, indexFile) != 1 ||
+      memcmp(header.magic, INDEX_MAGIC, sizeof(header.magic)) != 0 ||
+      header.fileSize != (size_t)csvFileStat->st_size ||
+      header.modifiedSeconds != csvFileStat->st_mtim.tv_sec ||
+      header.modifiedNanoseconds != csvFileStat->st_mtim.tv_nsec)
+  {
+    fclose(indexFile);
+    return NULL;
+  }
+
+  CsvIndex *index = (CsvIndex *)calloc(1, sizeof(CsvIndex));
+  size_t zoneCount = header.blockCount * header.columnCount;
+  index->header = header;
+  index->blockCapacity = header.blockCount;
+  index->blocks = (IndexBlock *)malloc(header.blockCount * sizeof(IndexBlock));
+  index->zones = (ColumnZone *)malloc(zoneCount * sizeof(ColumnZone));
+  index->bloomCapacity = header.bloomLength;
+  index->blooms = (unsigned char *)malloc(header.bloomLength);
+
+  bool isRead = fread(index->blocks, sizeof(IndexBlock), header.blockCount, indexFile) ==
+                    header.blockCount &&
+                fread(index->zones, sizeof(ColumnZone), zoneCount, indexFile) == zoneCount &&
+                fread(index->blooms, 1, header.bloomLength, indexFile) == header.bloomLength;
+  fclose(indexFile);
+
+  if (!isRead)
+  {
+    freeIndex(index);
+    return NULL;
+  }
+
+  return index;
+}
+
+/**
+ * Check whether a value may be in the bloom filter of a zone.
+ *
+ * @param index The index.
+ * @param zone The zone.
+ * @param hash The hash of the value.
+ * @return bool Whether all the bits of the value are set.
+ */
+static bool isInBloom(const CsvIndex *index, const ColumnZone *zone, uint64_t hash)
+{
+  const unsigned char *bloom = &index->blooms[zone->bloomOffset];
+
+  if (!zone->bloomBits)
+    return true;
+
+  for (uint32_t probe = 0; probe < INDEX_BLOOM_HASHES; probe++)
+  {
+    size_t bit = getBloomBit(hash, probe, zone->bloomBits);
+    if (!(bloom[bit / 8] & (1 << (bit % 8))))
+      return false;
+  }
+
+  return true;
+}
+
+/**
+ * Check whether a filter may accept some value between the minimum and maximum of
+ * a zone, from how they compare with the value of the filter.
+ *
+ * @param op The operator of the filter.
+ * @param minimumComparison How the minimum compares with the value of the filter.
+ * @param maximumComparison How the maximum compares with the value of the filter.
+ * @return bool Whether some value of the range may pass the filter.
+ */
+static bool isInRange(enum operator op, int minimumComparison, int maximumComparison)
+{
+  switch (op)
+  {
+  case EQUAL:
+  case IN:
+    return minimumComparison <= 0 && maximumComparison >= 0;
+  case NOT_EQUAL:
+    return minimumComparison != 0 || maximumComparison != 0;
+  case LESS:
+    return minimumComparison < 0;
+  case LESS_EQUAL:
+    return minimumComparison <= 0;
+  case GREATER:
+    return maximumComparison > 0;
+  case GREATER_EQUAL:
+    return maximumComparison >= 0;
+  default:
+    return true;
+  }
+}
+
+/**
+ * Check whether a filter may accept some text value of a zone. When a bound was
+ * truncated, its comparison is the one letting the most values through.
+ *
+ * @param index The index.
+ * @param zone The zone.
+ * @param op The operator of the filter.
+ * @param value The value of the filter.
+ * @param length The length of the value.
+ * @param hash The hash of the value, checked against the bloom filter of equalities.
+ * @return bool Whether some value of the zone may pass the filter.
+ */
+static bool mayMatchText(
+    const CsvIndex *index,
+    const ColumnZone *zone,
+    enum operator op,
+    const char value[],
+    size_t length,
+    uint64_t hash)
+{
+  CellView minimum = {zone->textMinimum, zone->textMinimumLength};
+  CellView maximum = {zone->textMaximum, zone->textMaximumLength};
+
+  // A truncated minimum is less than the whole minimum
+  int minimumComparison = compareCell(&minimum, value, length);
+  if (minimumComparison == 0 && zone->isTextMinimumTruncated)
+    minimumComparison = 1;
+  else if (minimumComparison < 0)
+    minimumComparison = -1;
+
+  // A truncated maximum starts the whole maximum, so only its first bytes tell
+  int maximumComparison;
+  if (zone->isTextMaximumTruncated)
+  {
+    size_t prefixLength = length < INDEX_TEXT_BOUND_LENGTH ? length : INDEX_TEXT_BOUND_LENGTH;
+    maximumComparison = compareCell(&maximum, value, prefixLength) < 0 ? -1 : 1;
+  }
+  else
+    maximumComparison = compareCell(&maximum, value, length);
+
+  if (!isInRange(op, minimumComparison, maximumComparison))
+    return false;
+
+  return (op != EQUAL && op != IN) || isInBloom(index, zone, hash);
+}
+
+/**
+ * Check whether an IN or NOT IN filter may accept some value of a zone.
+ *
+ * @param index The index.
+ * @param zone The zone.
+ * @param rowFilter The filter.
+ * @return bool Whether some value of the zone may pass the filter.
+ */
+static bool mayMatchSet(const CsvIndex *index, const ColumnZone *zone, const RowFilter *rowFilter)
+{
+  const ValueSet *valueSet = rowFilter->valueSet;
+
+  switch (valueSet->type)
+  {
+  case INTEGER:
+    if (!zone->integerCount)
+      return false;
+    break;
+  case DATE:
+    if (!zone->dateCount)
+      return false;
+    break;
+  case FLOAT:
+    if (!zone->floatCount)
+      return false;
+    break;
+  case TEXT:
+    break;
+  default:
+    return true;
+  }
+
+  if (rowFilter->op != IN || valueSet->valueCount > INDEX_MAX_PROBED_VALUES)
+    return true;
+
+  for (size_t i = 0; i <= valueSet->slotMask; i++)
+  {
+    const ValueSetSlot *slot = &valueSet->slots[i];
+    const char *key = &valueSet->keys[slot->offset];
+    long long integerValue;
+    double floatValue;
+
+    if (!slot->hash)
+      continue;
+
+    switch (valueSet->type)
+    {
+    case INTEGER:
+      memcpy(&integerValue, key, sizeof(integerValue));
+      if (integerValue >= zone->integerMinimum && integerValue <= zone->integerMaximum)
+        return true;
+      break;
+    case DATE:
+      memcpy(&integerValue, key, sizeof(integerValue));
+      if (integerValue >= zone->dateMinimum && integerValue <= zone->dateMaximum)
+        return true;
+      break;
+    case FLOAT:
+      memcpy(&floatValue, key, sizeof(floatValue));
+      if (floatValue >= zone->floatMinimum && floatValue <= zone->floatMaximum)
+        return true;
+      break;
+    default:
+      if (mayMatchText(index, zone, IN, key, slot->length, slot->hash))
+        return true;
+    }
+  }
+
+  return false;
+}
+
+/**
+ * Check whether a filter may accept some value of a zone. Typed filters never
+ * accept the values which are not valid for their type.
+ *
+ * @param index The index.
+ * @param zone The zone.
+ * @param rowFilter The filter.
+ * @return bool Whether some value of the zone may pass the filter.
+ */
+static bool mayMatch(const CsvIndex *index, const ColumnZone *zone, const RowFilter *rowFilter)
+{
+  long long value = rowFilter->integerValue;
+
+  if (rowFilter->otherColumn != NO_CELL)
+    return true;
+
+  if (rowFilter->valueSet != NULL)
+    return mayMatchSet(index, zone, rowFilter);
+
+  switch (rowFilter->type)
+  {
+  case TEXT:
+    return mayMatchText(
+        index,
+        zone,
+        rowFilter->op,
+        rowFilter->value,
+        rowFilter->valueLength,
+        hashBytes(rowFilter->value, rowFilter->valueLength));
+  case INTEGER:
+    return zone->integerCount &&
+           isInRange(
+               rowFilter->op,
+               (zone->integerMinimum > value) - (zone->integerMinimum < value),
+               (zone->integerMaximum > value) - (zone->integerMaximum < value));
+  case DATE:
+    return zone->dateCount &&
+           isInRange(
+               rowFilter->op,
+               (zone->dateMinimum > value) - (zone->dateMinimum < value),
+               (zone->dateMaximum > value) - (zone->dateMaximum < value));
+  case FLOAT:
+    return zone->floatCount &&
+           isInRange(
+               rowFilter->op,
+               (zone->floatMinimum > rowFilter->floatValue) -
+                   (zone->floatMinimum < rowFilter->floatValue),
+               (zone->floatMaximum > rowFilter->floatValue) -
+                   (zone->floatMaximum < rowFilter->floatValue));
+  default:
+    return true;
+  }
+}
+
+/**
+ * Check whether no row of a block can pass a filter plan: some column filter
+ * cannot accept any cell of the block. Rows missing the cell of a column are not
+ * validated, so they pass its filters.
+ *
+ * @param index The index.
+ * @param block Which block to check.
+ * @param filterPlan The compiled filters.
+ * @return bool Whether the block can be skipped.
+ */
+static bool isBlockSkipped(const CsvIndex *index, size_t block, const FilterPlan *filterPlan)
+{
+  const ColumnZone *zones = &index->zones[block * index->header.columnCount];
+
+  for (size_t i = 0; i < filterPlan->totalColumnFilters; i++)
+  {
+    const ColumnFilter *columnFilter = &filterPlan->columnFilters[i];
+
+    if (columnFilter->column >= index->header.columnCount ||
+        zones[columnFilter->column].missingCount)
+      continue;
+
+    const ColumnZone *zone = &zones[columnFilter->column];
+    bool isMatched = false;
+
+    for (size_t j = 0; j < columnFilter->totalRowFilters && !isMatched; j++)
+      isMatched = mayMatch(index, zone, columnFilter->rowFilters[j]);
+
+    if (!isMatched)
+      return true;
+  }
+
+  return false;
+}
+
+size_t findIndexRanges(const CsvIndex *index, const FilterPlan *filterPlan, ByteRange ranges[])
+{
+  size_t rangeCount = 0;
+
+  for (size_t i = 0; i < index->header.blockCount; i++)
+  {
+    const IndexBlock *block = &index->blocks[i];
+
+    if (!block->rowCount || isBlockSkipped(index, i, filterPlan))
+      continue;
+
+    if (rangeCount &&
+        ranges[rangeCount - 1].offset + ranges[rangeCount - 1].length == block->offset)
+      ranges[rangeCount - 1].length += block->length;
+    else
+    {
+      ranges[rangeCount].offset = block->offset;
+      ranges[rangeCount].length = block->length;
+      rangeCount++;
+    }
+  }
+
+  return rangeCount;
+}
+
+void freeIndex(CsvIndex *index)
+{
+  if (index->hashes != NULL)
+    for (size_t i = 0; i < index->header.columnCount; i++)
+      free(index->hashes[i]);
+
+  free(index->hashes);
+  free(index->blocks);
+  free(index->zones);
+  free(index->blooms);
+  free(index->value);
+  free(index);
+}
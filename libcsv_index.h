@@ -0,0 +1,167 @@
+#ifndef LIBCSV_INDEX_H
+#define LIBCSV_INDEX_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/stat.h>
+
+#include "libcsv_util.h"
+
+#define INDEX_FILE_SUFFIX ".idx"
+#define INDEX_MAGIC "LCSVIDX1"
+#define INDEX_DEFAULT_BLOCK_SIZE (64 << 10)
+#define INDEX_TEXT_BOUND_LENGTH 16
+#define INDEX_BLOOM_BITS_PER_VALUE 8
+#define INDEX_BLOOM_HASHES 3
+#define INDEX_MAX_PROBED_VALUES 4096
+
+typedef struct
+{
+  size_t offset;
+  size_t length;
+} ByteRange;
+
+/**
+ * Rows of a block of the indexed file, from the start of its first row to the end
+ * of its last one.
+ */
+typedef struct
+{
+  size_t offset;
+  size_t length;
+  size_t rowCount;
+} IndexBlock;
+
+/**
+ * Zone map of a column in a block: the range of its cells in each type, and a bloom
+ * filter of their text values. Text bounds keep the first INDEX_TEXT_BOUND_LENGTH
+ * bytes of the minimum and maximum, with whether there was more to them.
+ */
+typedef struct
+{
+  // Rows of the block without a cell in the column
+  size_t missingCount;
+  // Cells valid for each type, whose range is only set when there is one
+  size_t integerCount;
+  long long integerMinimum;
+  long long integerMaximum;
+  size_t dateCount;
+  long long dateMinimum;
+  long long dateMaximum;
+  size_t floatCount;
+  double floatMinimum;
+  double floatMaximum;
+  char textMinimum[INDEX_TEXT_BOUND_LENGTH];
+  char textMaximum[INDEX_TEXT_BOUND_LENGTH];
+  uint8_t textMinimumLength;
+  uint8_t textMaximumLength;
+  bool isTextMinimumTruncated;
+  bool isTextMaximumTruncated;
+  // Offset of the bloom filter in the blooms of the index, and its size in bits
+  size_t bloomOffset;
+  size_t bloomBits;
+} ColumnZone;
+
+/**
+ * Start of an index file. It is followed by the blocks, the zones of each block
+ * one column after the other, and the bloom filters. The file is only valid for
+ * the size and modification time of the CSV file it was built from.
+ */
+typedef struct
+{
+  char magic[8];
+  size_t fileSize;
+  long long modifiedSeconds;
+  long long modifiedNanoseconds;
+  size_t blockSize;
+  size_t columnCount;
+  size_t blockCount;
+  size_t bloomLength;
+} IndexHeader;
+
+typedef struct
+{
+  IndexHeader header;
+  IndexBlock *blocks;
+  size_t blockCapacity;
+  ColumnZone *zones;
+  unsigned char *blooms;
+  size_t bloomCapacity;
+  // Rows and hashes of the values of each column of the block being built
+  size_t rowCount;
+  uint64_t **hashes;
+  size_t hashCapacity;
+  // Buffer for the value of quoted cells
+  char *value;
+  size_t valueCapacity;
+} CsvIndex;
+
+/**
+ * Create an empty index, whose blocks are then built one row at a time.
+ *
+ * @param columnCount How many columns the indexed CSV has.
+ * @param blockSize How many bytes of rows each block holds at least, but the last.
+ * @return CsvIndex* The created index.
+ */
+CsvIndex *createIndex(size_t columnCount, size_t blockSize);
+
+/**
+ * Add a row to the zone maps of the block being built.
+ *
+ * @param index The index.
+ * @param cells Array with one view per cell of the row.
+ * @param cellCount How many cells the row has. Missing cells are counted as such.
+ */
+void addIndexedRow(CsvIndex *index, const CellView cells[], size_t cellCount);
+
+/**
+ * End the block being built, sizing the bloom filter of each column after its
+ * distinct values.
+ *
+ * @param index The index.
+ * @param offset Offset of the first row of the block in the file.
+ * @param length The length of the rows of the block.
+ */
+void endIndexBlock(CsvIndex *index, size_t offset, size_t length);
+
+/**
+ * Write an index next to the CSV file it was built from, as the file path of the
+ * CSV followed by INDEX_FILE_SUFFIX.
+ *
+ * @param index The index.
+ * @param csvFilePath The file path of the indexed CSV.
+ * @param csvFileStat The status of the CSV file when it was indexed.
+ * @return bool Whether the index could be written.
+ */
+bool writeIndex(CsvIndex *index, const char csvFilePath[], const struct stat *csvFileStat);
+
+/**
+ * Read the index of a CSV file, if there is one which is still valid.
+ *
+ * @param csvFilePath The file path of the CSV.
+ * @param csvFileStat The current status of the CSV file.
+ * @return CsvIndex* The index, or NULL if there is none, or the size or
+ * modification time of the file changed since it was built.
+ */
+CsvIndex *readIndex(const char csvFilePath[], const struct stat *csvFileStat);
+
+/**
+ * Find the rows which may pass a filter plan, skipping the blocks in which some
+ * column filter cannot accept any cell. Adjacent blocks are merged into a range.
+ *
+ * @param index The index.
+ * @param filterPlan The compiled filters, with their types resolved.
+ * @param ranges Array with room for one range per block of the index.
+ * @return size_t How many ranges were found.
+ */
+size_t findIndexRanges(const CsvIndex *index, const FilterPlan *filterPlan, ByteRange ranges[]);
+
+/**
+ * Free the memory of an index.
+ *
+ * @param index The index to be freed.
+ */
+void freeIndex(CsvIndex *index);
+
+#endif
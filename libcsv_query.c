@@ -0,0 +1,835 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <strings.h>
+#include <unistd.h>
+
+#include "libcsv_query.h"
+
+/**
+ * Print error message for header not found.
+ *
+ * @param header The header that was not found.
+ */
+static void headerNotFound(const char header[])
+{
+  fprintf(stderr, "Header '%s' not found in CSV file/string\n", header);
+}
+
+/**
+ * Split the selected columns of a query into headers. Empty headers are skipped.
+ *
+ * @param query The query, with selectedColumns already set.
+ */
+static void defineSelectedHeaders(CsvQuery *query)
+{
+  const char *header = query->selectedColumns;
+
+  while (*header)
+  {
+    size_t length = strcspn(header, VALUE_SEPARATOR);
+
+    if (length)
+    {
+      query->selectedHeaders = (char **)realloc(
+          query->selectedHeaders,
+          (query->totalSelectedHeaders + 1) * sizeof(char *));
+      query->selectedHeaders[query->totalSelectedHeaders++] = strndup(header, length);
+    }
+
+    header += length;
+    if (*header)
+      header++;
+  }
+}
+
+/**
+ * Add a filter to a query, with the type declared after its header if any. The
+ * column of the filter is only resolved when the query is bound to headers.
+ *
+ * @param query The query the filter is added to.
+ * @param header The header of the filter, with an optional type. It will be modified.
+ * @param otherHeader The header of the column compared with, NULL if none.
+ * @param rowFilter The filter, which will be owned by the query.
+ * @return bool Whether the value of the filter is valid for its type.
+ */
+static bool addQueryFilter(
+    CsvQuery *query,
+    char header[],
+    const char otherHeader[],
+    RowFilter *rowFilter)
+{
+  enum cellType type = TEXT;
+  char *typeName = strrchr(header, *TYPE_SEPARATOR);
+  if (typeName != NULL && parseCellType(typeName + 1, strlen(typeName + 1), &type))
+    *typeName = '\0';
+
+  if (type == AUTO)
+  {
+    rowFilter->type = AUTO;
+    query->hasAutoFilters = true;
+  }
+  else if (otherHeader != NULL)
+    rowFilter->type = type;
+  else if (!setRowFilterType(rowFilter, type))
+  {
+    if (rowFilter->valueSet != NULL)
+      fprintf(stderr, "Invalid values for type: '%s'\n", header);
+    else
+      fprintf(stderr, "Invalid value for type: '%s'\n", rowFilter->value);
+    freeRowFilter(rowFilter);
+    return false;
+  }
+
+  query->filters = (QueryFilter *)realloc(
+      query->filters,
+      (query->totalFilters + 1) * sizeof(QueryFilter));
+  query->filters[query->totalFilters].header = strdup(header);
+  query->filters[query->totalFilters].otherHeader =
+      otherHeader != NULL ? strdup(otherHeader) : NULL;
+  query->filters[query->totalFilters].rowFilter = rowFilter;
+  query->totalFilters++;
+
+  return true;
+}
+
+/**
+ * Parse a single row filter definition into a filter of a query. The column of the
+ * filter is only resolved when the query is bound to headers.
+ *
+ * @param query The query the filter is added to.
+ * @param rowFilterDefinition The definition, which will be modified.
+ * @return bool Whether the definition is valid.
+ */
+static bool defineRowFilter(CsvQuery *query, char rowFilterDefinition[])
+{
+  enum operator op = 0;
+  size_t i;
+
+  for (i = strlen(rowFilterDefinition) - 1; i > 0 && !op; --i)
+  {
+    switch (rowFilterDefinition[i])
+    {
+    case '=':
+      switch (rowFilterDefinition[i - 1])
+      {
+      case '!':
+        op = NOT_EQUAL;
+        break;
+      case '<':
+        op = LESS_EQUAL;
+        break;
+      case '>':
+        op = GREATER_EQUAL;
+        break;
+      default:
+        op = EQUAL;
+      }
+      if (op != EQUAL)
+        rowFilterDefinition[i - 1] = '\0';
+      break;
+    case '<':
+      op = LESS;
+      break;
+    case '>':
+      op = GREATER;
+      break;
+    }
+  }
+
+  if (!op)
+  {
+    fprintf(stderr, "Invalid filter: '%s'\n", rowFilterDefinition);
+    return false;
+  }
+
+  // The loop decremented i once more after finding the operator
+  i++;
+  rowFilterDefinition[i] = '\0';
+
+  // Values starting with COLUMN_REFERENCE name the column to compare with, unless
+  // it is doubled to compare with a value starting with COLUMN_REFERENCE
+  char *value = &rowFilterDefinition[i + 1];
+  bool isColumnReference = *value == *COLUMN_REFERENCE &&
+                           value[1] &&
+                           value[1] != *COLUMN_REFERENCE;
+  if (*value == *COLUMN_REFERENCE && value[1])
+    value++;
+
+  RowFilter *rowFilter = createRowFilter(NO_CELL, op, value);
+  return addQueryFilter(query, rowFilterDefinition, isColumnReference ? value : NULL, rowFilter);
+}
+
+/**
+ * Parse the row filter definitions of a query, one per line. Empty lines are
+ * skipped.
+ *
+ * @param query The query the filters are added to.
+ * @param rowFilterDefinitions A string containing zero or more row filter definitions.
+ * @return bool Whether every definition is valid.
+ */
+static bool defineRowFilters(CsvQuery *query, const char rowFilterDefinitions[])
+{
+  const char *definition = rowFilterDefinitions;
+
+  while (*definition)
+  {
+    size_t length = strcspn(definition, LINE_SEPARATOR);
+
+    if (length)
+    {
+      char *rowFilterDefinition = strndup(definition, length);
+      bool isValid = defineRowFilter(query, rowFilterDefinition);
+      free(rowFilterDefinition);
+
+      if (!isValid)
+        return false;
+    }
+
+    definition += length;
+    if (*definition)
+      definition++;
+  }
+
+  return true;
+}
+
+CsvQuery *createCsvQuery(const char selectedColumns[], const char rowFilterDefinitions[])
+{
+  CsvQuery *query = (CsvQuery *)malloc(sizeof(CsvQuery));
+  query->selectedColumns = strdup(selectedColumns);
+  query->selectedHeaders = NULL;
+  query->totalSelectedHeaders = 0;
+  query->filters = NULL;
+  query->totalFilters = 0;
+  query->hasAutoFilters = false;
+  query->orderHeaders = NULL;
+  query->sortKeys = NULL;
+  query->totalSortKeys = 0;
+  query->sortMemory = SORT_DEFAULT_MEMORY_BUDGET;
+  query->groupHeaders = NULL;
+  query->groupColumns = NULL;
+  query->totalGroupColumns = 0;
+  query->aggregateHeaders = NULL;
+  query->aggregateLabels = NULL;
+  query->aggregates = NULL;
+  query->totalAggregates = 0;
+  query->offset = 0;
+  query->limit = 0;
+  query->workerCount = 1;
+  query->stats = NULL;
+  query->boundHeaders = NULL;
+  query->boundHeadersLength = 0;
+  query->csv = NULL;
+  query->filterPlan = NULL;
+
+  defineSelectedHeaders(query);
+
+  if (!defineRowFilters(query, rowFilterDefinitions))
+  {
+    freeCsvQuery(query);
+    return NULL;
+  }
+
+  return query;
+}
+
+void setCsvQueryWorkerCount(CsvQuery *query, size_t workerCount)
+{
+  if (!workerCount)
+  {
+    long cpuCount = sysconf(_SC_NPROCESSORS_ONLN);
+    workerCount = cpuCount > 0 ? (size_t)cpuCount : 1;
+  }
+
+  query->workerCount = workerCount;
+}
+
+void setCsvQueryStats(CsvQuery *query, CsvStats *stats)
+{
+  query->stats = stats;
+}
+
+void setCsvQuerySortMemory(CsvQuery *query, size_t memoryBudget)
+{
+  query->sortMemory = memoryBudget;
+}
+
+void setCsvQueryOffset(CsvQuery *query, size_t offset)
+{
+  query->offset = offset;
+}
+
+void setCsvQueryLimit(CsvQuery *query, size_t limit)
+{
+  query->limit = limit;
+}
+
+/**
+ * Build the filter plan of a bound query from copies of its filters, so values
+ * inferred for one input do not leak into the next one.
+ *
+ * @param query The bound query.
+ * @return FilterPlan* The compiled plan.
+ */
+static FilterPlan *createQueryFilterPlan(const CsvQuery *query)
+{
+  RowFilter **rowFilters = (RowFilter **)malloc(query->totalFilters * sizeof(RowFilter *));
+
+  for (size_t i = 0; i < query->totalFilters; i++)
+    rowFilters[i] = copyRowFilter(query->filters[i].rowFilter);
+
+  FilterPlan *filterPlan = createFilterPlan(rowFilters, query->totalFilters);
+  free(rowFilters);
+
+  // Aggregated queries only need the grouped and aggregated columns
+  for (size_t i = filterPlan->scanColumns; i < query->csv->colCount && !isAggregatedQuery(query); i++)
+    if (query->csv->columns[i]->isSelected)
+      filterPlan->scanColumns = i + 1;
+
+  for (size_t i = 0; i < query->totalGroupColumns; i++)
+    if (query->groupColumns[i] >= filterPlan->scanColumns)
+      filterPlan->scanColumns = query->groupColumns[i] + 1;
+
+  for (size_t i = 0; i < query->totalAggregates; i++)
+    if (query->aggregates[i].column != NO_CELL &&
+        query->aggregates[i].column >= filterPlan->scanColumns)
+      filterPlan->scanColumns = query->aggregates[i].column + 1;
+
+  for (size_t i = 0; i < query->totalSortKeys; i++)
+    if (query->sortKeys[i].column >= filterPlan->scanColumns)
+      filterPlan->scanColumns = query->sortKeys[i].column + 1;
+
+  return filterPlan;
+}
+
+/**
+ * Release the binding of a query, if any.
+ *
+ * @param query The query.
+ */
+static void unbindCsvQuery(CsvQuery *query)
+{
+  if (query->filterPlan != NULL)
+    freeFilterPlan(query->filterPlan);
+  if (query->csv != NULL)
+    freeCsv(query->csv);
+
+  free(query->boundHeaders);
+  query->boundHeaders = NULL;
+  query->boundHeadersLength = 0;
+  query->csv = NULL;
+  query->filterPlan = NULL;
+}
+
+/**
+ * Remove the order of a query.
+ *
+ * @param query The query.
+ */
+static void clearOrder(CsvQuery *query)
+{
+  for (size_t i = 0; i < query->totalSortKeys; i++)
+    free(query->orderHeaders[i]);
+
+  free(query->orderHeaders);
+  free(query->sortKeys);
+  query->orderHeaders = NULL;
+  query->sortKeys = NULL;
+  query->totalSortKeys = 0;
+}
+
+/**
+ * Parse a single order definition into a sort key of a query. The column of the
+ * key is only resolved when the query is bound to headers.
+ *
+ * @param query The query the sort key is added to.
+ * @param orderDefinition The definition, which will be modified.
+ * @return bool Whether the definition is valid.
+ */
+static bool defineOrder(CsvQuery *query, char orderDefinition[])
+{
+  SortKey sortKey = {NO_CELL, TEXT, false};
+  char *direction = strrchr(orderDefinition, ' ');
+
+  if (direction != NULL && (strcasecmp(direction + 1, "desc") == 0 ||
+                            strcasecmp(direction + 1, "asc") == 0))
+  {
+    sortKey.isDescending = strcasecmp(direction + 1, "desc") == 0;
+    *direction = '\0';
+  }
+
+  char *typeName = strrchr(orderDefinition, *TYPE_SEPARATOR);
+  if (typeName != NULL && parseCellType(typeName + 1, strlen(typeName + 1), &sortKey.type))
+    *typeName = '\0';
+
+  if (!*orderDefinition || sortKey.type == AUTO)
+  {
+    fprintf(stderr, "Invalid order: '%s'\n", orderDefinition);
+    return false;
+  }
+
+  query->orderHeaders = (char **)realloc(
+      query->orderHeaders,
+      (query->totalSortKeys + 1) * sizeof(char *));
+  query->sortKeys = (SortKey *)realloc(
+      query->sortKeys,
+      (query->totalSortKeys + 1) * sizeof(SortKey));
+  query->orderHeaders[query->totalSortKeys] = strdup(orderDefinition);
+  query->sortKeys[query->totalSortKeys] = sortKey;
+  query->totalSortKeys++;
+
+  return true;
+}
+
+bool setCsvQueryOrder(CsvQuery *query, const char orderColumns[])
+{
+  const char *definition = orderColumns;
+
+  clearOrder(query);
+  unbindCsvQuery(query);
+
+  while (*definition)
+  {
+    size_t length = strcspn(definition, VALUE_SEPARATOR);
+
+    if (length)
+    {
+      char *orderDefinition = strndup(definition, length);
+      bool isValid = defineOrder(query, orderDefinition);
+      free(orderDefinition);
+
+      if (!isValid)
+      {
+        clearOrder(query);
+        return false;
+      }
+    }
+
+    definition += length;
+    if (*definition)
+      definition++;
+  }
+
+  return true;
+}
+
+/**
+ * Remove the groups and aggregates of a query.
+ *
+ * @param query The query.
+ */
+static void clearGroupBy(CsvQuery *query)
+{
+  for (size_t i = 0; i < query->totalGroupColumns; i++)
+    free(query->groupHeaders[i]);
+
+  for (size_t i = 0; i < query->totalAggregates; i++)
+  {
+    free(query->aggregateHeaders[i]);
+    free(query->aggregateLabels[i]);
+  }
+
+  free(query->groupHeaders);
+  free(query->groupColumns);
+  free(query->aggregateHeaders);
+  free(query->aggregateLabels);
+  free(query->aggregates);
+  query->groupHeaders = NULL;
+  query->groupColumns = NULL;
+  query->totalGroupColumns = 0;
+  query->aggregateHeaders = NULL;
+  query->aggregateLabels = NULL;
+  query->aggregates = NULL;
+  query->totalAggregates = 0;
+}
+
+/**
+ * Parse a single aggregate definition, such as "count" or "sum(price:int)", into
+ * an aggregate of a query. The column of the aggregate is only resolved when the
+ * query is bound to headers.
+ *
+ * @param query The query the aggregate is added to.
+ * @param aggregateDefinition The definition, which will be modified.
+ * @return bool Whether the definition is valid.
+ */
+static bool defineAggregate(CsvQuery *query, char aggregateDefinition[])
+{
+  static const struct
+  {
+    const char *name;
+    enum aggregateFunction function;
+  } functions[] = {
+      {"count", COUNT},
+      {"sum", SUM},
+      {"min", MINIMUM},
+      {"max", MAXIMUM},
+      {"avg", AVERAGE},
+      {"count_distinct", COUNT_DISTINCT}};
+
+  char *label = strdup(aggregateDefinition);
+  size_t length = strlen(aggregateDefinition);
+  char *header = strchr(aggregateDefinition, '(');
+  Aggregate aggregate = {0, NO_CELL, TEXT};
+  bool isValid = header == NULL || aggregateDefinition[length - 1] == ')';
+
+  if (header != NULL)
+  {
+    aggregateDefinition[length - 1] = '\0';
+    *header++ = '\0';
+  }
+  else
+    header = &aggregateDefinition[length];
+
+  for (size_t i = 0; i < sizeof(functions) / sizeof(functions[0]); i++)
+    if (strcasecmp(functions[i].name, aggregateDefinition) == 0)
+      aggregate.function = functions[i].function;
+
+  if (aggregate.function == SUM || aggregate.function == AVERAGE)
+    aggregate.type = FLOAT;
+
+  char *typeName = strrchr(header, *TYPE_SEPARATOR);
+  if (typeName != NULL && parseCellType(typeName + 1, strlen(typeName + 1), &aggregate.type))
+    *typeName = '\0';
+
+  switch (aggregate.function)
+  {
+  case COUNT:
+    isValid = isValid && !*header;
+    break;
+  case SUM:
+  case AVERAGE:
+    isValid = isValid && *header && (aggregate.type == INTEGER || aggregate.type == FLOAT);
+    break;
+  case MINIMUM:
+  case MAXIMUM:
+    isValid = isValid && *header && aggregate.type != AUTO;
+    break;
+  case COUNT_DISTINCT:
+    isValid = isValid && *header && aggregate.type == TEXT;
+    break;
+  default:
+    isValid = false;
+  }
+
+  if (!isValid)
+  {
+    fprintf(stderr, "Invalid aggregate: '%s'\n", label);
+    free(label);
+    return false;
+  }
+
+  query->aggregateHeaders = (char **)realloc(
+      query->aggregateHeaders,
+      (query->totalAggregates + 1) * sizeof(char *));
+  query->aggregateLabels = (char **)realloc(
+      query->aggregateLabels,
+      (query->totalAggregates + 1) * sizeof(char *));
+  query->aggregates = (Aggregate *)realloc(
+      query->aggregates,
+      (query->totalAggregates + 1) * sizeof(Aggregate));
+  query->aggregateHeaders[query->totalAggregates] = *header ? strdup(header) : NULL;
+  query->aggregateLabels[query->totalAggregates] = label;
+  query->aggregates[query->totalAggregates] = aggregate;
+  query->totalAggregates++;
+
+  return true;
+}
+
+bool setCsvQueryGroupBy(
+    CsvQuery *query,
+    const char groupColumns[],
+    const char aggregateDefinitions[])
+{
+  const char *definition = groupColumns;
+
+  clearGroupBy(query);
+  unbindCsvQuery(query);
+
+  while (*definition)
+  {
+    size_t length = strcspn(definition, VALUE_SEPARATOR);
+
+    if (length)
+    {
+      query->groupHeaders = (char **)realloc(
+          query->groupHeaders,
+          (query->totalGroupColumns + 1) * sizeof(char *));
+      query->groupHeaders[query->totalGroupColumns++] = strndup(definition, length);
+    }
+
+    definition += length;
+    if (*definition)
+      definition++;
+  }
+
+  query->groupColumns = (size_t *)calloc(query->totalGroupColumns + 1, sizeof(size_t));
+  definition = aggregateDefinitions;
+
+  while (*definition)
+  {
+    size_t length = strcspn(definition, VALUE_SEPARATOR);
+
+    if (length)
+    {
+      char *aggregateDefinition = strndup(definition, length);
+      bool isValid = defineAggregate(query, aggregateDefinition);
+      free(aggregateDefinition);
+
+      if (!isValid)
+      {
+        clearGroupBy(query);
+        return false;
+      }
+    }
+
+    definition += length;
+    if (*definition)
+      definition++;
+  }
+
+  return true;
+}
+
+bool isAggregatedQuery(const CsvQuery *query)
+{
+  return query->totalGroupColumns || query->totalAggregates;
+}
+
+/**
+ * Add an IN or NOT IN filter to a query, unbinding it so the filter plan is built
+ * again for the next input.
+ *
+ * @param query The query the filter is added to.
+ * @param header The header of the filter, with an optional type.
+ * @param values The values, one per line, not NUL-terminated.
+ * @param length The length of the values.
+ * @param isNegated Whether the filter accepts the cells which are not in the values.
+ * @return bool Whether the values are valid for the type of the filter.
+ */
+static bool defineInFilter(
+    CsvQuery *query,
+    const char header[],
+    const char values[],
+    size_t length,
+    bool isNegated)
+{
+  RowFilter *rowFilter = createRowFilter(NO_CELL, isNegated ? NOT_IN : IN, "");
+  rowFilter->valueSet = createValueSet(values, length);
+
+  char *filterHeader = strdup(header);
+  bool isValid = addQueryFilter(query, filterHeader, NULL, rowFilter);
+  free(filterHeader);
+
+  unbindCsvQuery(query);
+  return isValid;
+}
+
+bool addCsvQueryInFilter(
+    CsvQuery *query,
+    const char header[],
+    const char values[],
+    bool isNegated)
+{
+  return defineInFilter(query, header, values, strlen(values), isNegated);
+}
+
+bool addCsvQueryInFilterFile(
+    CsvQuery *query,
+    const char header[],
+    const char valuesFilePath[],
+    bool isNegated)
+{
+  FILE *valuesFile = fopen(valuesFilePath, "r");
+
+  if (!valuesFile)
+  {
+    fprintf(stderr, "Could not open the file of values: '%s'\n", valuesFilePath);
+    return false;
+  }
+
+  size_t capacity = BUFSIZ, length = 0, readLength;
+  char *values = (char *)malloc(capacity);
+
+  while ((readLength = fread(&values[length], sizeof(char), capacity - length, valuesFile)) > 0)
+  {
+    length += readLength;
+    if (length == capacity)
+    {
+      capacity *= 2;
+      values = (char *)realloc(values, capacity);
+    }
+  }
+
+  fclose(valuesFile);
+
+  bool isValid = defineInFilter(query, header, values, length, isNegated);
+  free(values);
+  return isValid;
+}
+
+/**
+ * Get the length of a header, including the value separators inside its quotes.
+ *
+ * @param header The header, followed by the rest of the header row.
+ * @return size_t The length of the header.
+ */
+static size_t getHeaderLength(const char header[])
+{
+  size_t length = 0;
+
+  if (*header == *QUOTE)
+    for (length = 1; header[length]; length++)
+      if (header[length] == *QUOTE && header[++length] != *QUOTE)
+        break;
+
+  return length + strcspn(&header[length], VALUE_SEPARATOR);
+}
+
+/**
+ * Add a column to the CSV of a query for each header of a header row. Quoted
+ * headers are unquoted. Every column is selected when the query selects none.
+ *
+ * @param query The query.
+ * @param csvHeaders The header row, which will be modified.
+ */
+static void addColumns(CsvQuery *query, char csvHeaders[])
+{
+  char *header = csvHeaders;
+
+  while (true)
+  {
+    size_t length = getHeaderLength(header);
+    bool isLast = !header[length];
+    header[length] = '\0';
+
+    if (length && *header == *QUOTE)
+    {
+      CellView cell = {header, length};
+      header[unquoteCell(&cell, header)] = '\0';
+    }
+
+    if (length)
+      addColumn(query->csv, header, !*query->selectedColumns);
+
+    if (isLast)
+      return;
+    header += length + 1;
+  }
+}
+
+/**
+ * Search the CSV of a query for a column with a specificied header.
+ *
+ * @param query The query.
+ * @param header The header to be searched for.
+ * @param success Will be set as true if the operation was successful.
+ * @return size_t The column index of the column containing the header.
+ */
+static size_t getColumn(const CsvQuery *query, const char header[], bool *success)
+{
+  size_t column = findColumn(query->csv, header);
+  *success = column != NO_CELL;
+
+  if (!*success)
+  {
+    headerNotFound(header);
+    return 0;
+  }
+
+  return column;
+}
+
+bool bindCsvQuery(CsvQuery *query, const char headers[], size_t length)
+{
+  if (length && headers[length - 1] == '\r')
+    length--;
+
+  if (query->totalSortKeys && isAggregatedQuery(query))
+  {
+    fprintf(stderr, "Aggregated queries cannot be ordered\n");
+    return false;
+  }
+
+  if (query->csv != NULL &&
+      query->boundHeadersLength == length &&
+      memcmp(query->boundHeaders, headers, length) == 0)
+  {
+    clearRows(query->csv);
+
+    if (query->hasAutoFilters)
+    {
+      freeFilterPlan(query->filterPlan);
+      query->filterPlan = createQueryFilterPlan(query);
+    }
+
+    return true;
+  }
+
+  unbindCsvQuery(query);
+
+  char *csvHeaders = strndup(headers, length);
+  query->csv = createCsv();
+  addColumns(query, csvHeaders);
+  free(csvHeaders);
+
+  bool success = true;
+  for (size_t i = 0; i < query->totalSelectedHeaders && success; i++)
+  {
+    size_t column = getColumn(query, query->selectedHeaders[i], &success);
+    if (success)
+      query->csv->columns[column]->isSelected = true;
+  }
+  for (size_t i = 0; i < query->totalFilters && success; i++)
+  {
+    QueryFilter *filter = &query->filters[i];
+    filter->rowFilter->column = getColumn(query, filter->header, &success);
+
+    if (success && filter->otherHeader != NULL)
+      filter->rowFilter->otherColumn = getColumn(query, filter->otherHeader, &success);
+  }
+
+  for (size_t i = 0; i < query->totalSortKeys && success; i++)
+    query->sortKeys[i].column = getColumn(query, query->orderHeaders[i], &success);
+
+  for (size_t i = 0; i < query->totalGroupColumns && success; i++)
+    query->groupColumns[i] = getColumn(query, query->groupHeaders[i], &success);
+
+  for (size_t i = 0; i < query->totalAggregates && success; i++)
+    if (query->aggregateHeaders[i] != NULL)
+      query->aggregates[i].column = getColumn(query, query->aggregateHeaders[i], &success);
+
+  if (!success)
+  {
+    unbindCsvQuery(query);
+    return false;
+  }
+
+  query->filterPlan = createQueryFilterPlan(query);
+  query->boundHeaders = strndup(headers, length);
+  query->boundHeadersLength = length;
+  return true;
+}
+
+void freeCsvQuery(CsvQuery *query)
+{
+  unbindCsvQuery(query);
+  clearOrder(query);
+  clearGroupBy(query);
+
+  for (size_t i = 0; i < query->totalSelectedHeaders; i++)
+    free(query->selectedHeaders[i]);
+
+  for (size_t i = 0; i < query->totalFilters; i++)
+  {
+    free(query->filters[i].header);
+    free(query->filters[i].otherHeader);
+    freeRowFilter(query->filters[i].rowFilter);
+  }
+
+  free(query->selectedHeaders);
+  free(query->filters);
+  free(query->selectedColumns);
+  free(query);
+}
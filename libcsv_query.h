@@ -0,0 +1,70 @@
+#ifndef LIBCSV_QUERY_H
+#define LIBCSV_QUERY_H
+
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "libcsv.h"
+#include "libcsv_util.h"
+#include "libcsv_sort.h"
+#include "libcsv_group.h"
+
+typedef struct
+{
+  char *header;
+  // The header of the column compared with, NULL when comparing with a value
+  char *otherHeader;
+  RowFilter *rowFilter;
+} QueryFilter;
+
+struct CsvQuery
+{
+  char *selectedColumns;
+  char **selectedHeaders;
+  size_t totalSelectedHeaders;
+  QueryFilter *filters;
+  size_t totalFilters;
+  bool hasAutoFilters;
+  char **orderHeaders;
+  SortKey *sortKeys;
+  size_t totalSortKeys;
+  size_t sortMemory;
+  char **groupHeaders;
+  size_t *groupColumns;
+  size_t totalGroupColumns;
+  // The aggregated headers, NULL for COUNT, and the headers of the aggregates in the result
+  char **aggregateHeaders;
+  char **aggregateLabels;
+  Aggregate *aggregates;
+  size_t totalAggregates;
+  size_t offset;
+  size_t limit;
+  size_t workerCount;
+  CsvStats *stats;
+  char *boundHeaders;
+  size_t boundHeadersLength;
+  Csv *csv;
+  FilterPlan *filterPlan;
+};
+
+/**
+ * Bind a query to the header row of an input, resolving the selected, filtered and
+ * ordered headers to columns. The result is kept in the csv and filterPlan of the query,
+ * and is reused as is when the next input has the same header row.
+ *
+ * @param query The query to be bound.
+ * @param headers The header row, not NUL-terminated.
+ * @param length The length of the header row.
+ * @return bool Whether every header of the query was found.
+ */
+bool bindCsvQuery(CsvQuery *query, const char headers[], size_t length);
+
+/**
+ * Check whether a query groups its rows instead of writing them.
+ *
+ * @param query The query.
+ * @return bool Whether the query has group columns or aggregates.
+ */
+bool isAggregatedQuery(const CsvQuery *query);
+
+#endif
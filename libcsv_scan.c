@@ -0,0 +1,170 @@
+#include <stdlib.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#define SCAN_X86
+#endif
+
+#include "libcsv_util.h"
+#include "libcsv_scan.h"
+
+uint64_t scalarBlockMask(const char *block, size_t length, uint64_t *quotes)
+{
+  uint64_t mask = 0;
+
+  *quotes = 0;
+  for (size_t i = 0; i < length; i++)
+    if (block[i] == *VALUE_SEPARATOR || block[i] == *LINE_SEPARATOR)
+      mask |= (uint64_t)1 << i;
+    else if (block[i] == *QUOTE)
+      *quotes |= (uint64_t)1 << i;
+
+  return mask;
+}
+
+/**
+ * Build the structural mask of a full block, one byte at a time.
+ *
+ * @param block The block to be scanned.
+ * @param quotes Will be set to a bitmap with one bit set for each quote.
+ * @return uint64_t Bitmap with one bit set for each value or line separator.
+ */
+static uint64_t scalarFullBlockMask(const char *block, uint64_t *quotes)
+{
+  return scalarBlockMask(block, SCAN_BLOCK_SIZE, quotes);
+}
+
+#ifdef SCAN_X86
+
+/**
+ * Build the structural mask of a full block with SSE2, 16 bytes at a time.
+ *
+ * @param block The block to be scanned.
+ * @param quotes Will be set to a bitmap with one bit set for each quote.
+ * @return uint64_t Bitmap with one bit set for each value or line separator.
+ */
+__attribute__((target("sse2"))) static uint64_t sse2BlockMask(const char *block, uint64_t *quotes)
+{
+  const __m128i valueSeparator = _mm_set1_epi8(*VALUE_SEPARATOR);
+  const __m128i lineSeparator = _mm_set1_epi8(*LINE_SEPARATOR);
+  const __m128i quote = _mm_set1_epi8(*QUOTE);
+  uint64_t mask = 0;
+
+  *quotes = 0;
+  for (int i = 0; i < SCAN_BLOCK_SIZE; i += 16)
+  {
+    __m128i bytes = _mm_loadu_si128((const __m128i *)&block[i]);
+    __m128i structural = _mm_or_si128(
+        _mm_cmpeq_epi8(bytes, valueSeparator),
+        _mm_cmpeq_epi8(bytes, lineSeparator));
+    mask |= (uint64_t)(uint16_t)_mm_movemask_epi8(structural) << i;
+    *quotes |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(bytes, quote)) << i;
+  }
+
+  return mask;
+}
+
+/**
+ * Build the structural mask of a full block with AVX2, 32 bytes at a time.
+ *
+ * @param block The block to be scanned.
+ * @param quotes Will be set to a bitmap with one bit set for each quote.
+ * @return uint64_t Bitmap with one bit set for each value or line separator.
+ */
+__attribute__((target("avx2"))) static uint64_t avx2BlockMask(const char *block, uint64_t *quotes)
+{
+  const __m256i valueSeparator = _mm256_set1_epi8(*VALUE_SEPARATOR);
+  const __m256i lineSeparator = _mm256_set1_epi8(*LINE_SEPARATOR);
+  const __m256i quote = _mm256_set1_epi8(*QUOTE);
+
+  __m256i low = _mm256_loadu_si256((const __m256i *)block);
+  __m256i high = _mm256_loadu_si256((const __m256i *)&block[32]);
+
+  uint32_t lowMask = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(
+      _mm256_cmpeq_epi8(low, valueSeparator),
+      _mm256_cmpeq_epi8(low, lineSeparator)));
+  uint32_t highMask = (uint32_t)_mm256_movemask_epi8(_mm256_or_si256(
+      _mm256_cmpeq_epi8(high, valueSeparator),
+      _mm256_cmpeq_epi8(high, lineSeparator)));
+
+  *quotes = (uint64_t)(uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(high, quote)) << 32 |
+            (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(low, quote));
+  return (uint64_t)highMask << 32 | lowMask;
+}
+
+/**
+ * Build the structural mask of a full block with AVX-512, in a single load.
+ *
+ * @param block The block to be scanned.
+ * @param quotes Will be set to a bitmap with one bit set for each quote.
+ * @return uint64_t Bitmap with one bit set for each value or line separator.
+ */
+__attribute__((target("avx512f,avx512bw"))) static uint64_t avx512BlockMask(const char *block, uint64_t *quotes)
+{
+  __m512i bytes = _mm512_loadu_si512((const void *)block);
+
+  *quotes = _mm512_cmpeq_epi8_mask(bytes, _mm512_set1_epi8(*QUOTE));
+  return _mm512_cmpeq_epi8_mask(bytes, _mm512_set1_epi8(*VALUE_SEPARATOR)) |
+         _mm512_cmpeq_epi8_mask(bytes, _mm512_set1_epi8(*LINE_SEPARATOR));
+}
+
+#endif
+
+size_t listBlockMasks(BlockMask blockMasks[])
+{
+  size_t count = 0;
+
+#ifdef SCAN_X86
+  __builtin_cpu_init();
+
+  if (__builtin_cpu_supports("avx512bw"))
+    blockMasks[count++] = avx512BlockMask;
+  if (__builtin_cpu_supports("avx2"))
+    blockMasks[count++] = avx2BlockMask;
+  if (__builtin_cpu_supports("sse2"))
+    blockMasks[count++] = sse2BlockMask;
+#endif
+
+  blockMasks[count++] = scalarFullBlockMask;
+  return count;
+}
+
+BlockMask selectBlockMask()
+{
+  BlockMask blockMasks[MAX_BLOCK_MASKS];
+  listBlockMasks(blockMasks);
+  return blockMasks[0];
+}
+
+void initScanner(CsvScanner *scanner, const char *data, size_t length)
+{
+  scanner->data = data;
+  scanner->length = length;
+  scanner->blockStart = 0;
+  scanner->quoteCarry = 0;
+  scanner->blockMask = selectBlockMask();
+  scanner->mask = length ? loadBlockMask(scanner) : 0;
+}
+
+size_t countQuotes(const char *data, size_t length)
+{
+  const char *quote = memchr(data, *QUOTE, length);
+
+  if (quote == NULL)
+    return 0;
+
+  BlockMask blockMask = selectBlockMask();
+  size_t position = quote - data, count = 0;
+  uint64_t quotes;
+
+  for (; position + SCAN_BLOCK_SIZE <= length; position += SCAN_BLOCK_SIZE)
+  {
+    blockMask(&data[position], &quotes);
+    count += __builtin_popcountll(quotes);
+  }
+
+  scalarBlockMask(&data[position], length - position, &quotes);
+  return count + __builtin_popcountll(quotes);
+}
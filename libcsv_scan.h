@@ -0,0 +1,180 @@
+#ifndef LIBCSV_SCAN_H
+#define LIBCSV_SCAN_H
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#define SCAN_BLOCK_SIZE 64
+#define MAX_BLOCK_MASKS 4
+
+typedef uint64_t (*BlockMask)(const char *block, uint64_t *quotes);
+
+typedef struct
+{
+  const char *data;
+  size_t length;
+  size_t blockStart;
+  uint64_t mask;
+  // All bits set while the end of the last loaded block is inside a quoted field
+  uint64_t quoteCarry;
+  BlockMask blockMask;
+} CsvScanner;
+
+/**
+ * Select the fastest implementation for building the structural mask of a block
+ * supported by the running CPU (AVX-512, AVX2, SSE2 or scalar).
+ *
+ * @return BlockMask Function returning a bitmap with one bit set for each value or
+ * line separator in a block of SCAN_BLOCK_SIZE bytes, and setting the bitmap of
+ * its quotes.
+ */
+BlockMask selectBlockMask();
+
+/**
+ * List the implementations for building the structural mask of a block which are
+ * supported by the running CPU, from the fastest to the scalar one.
+ *
+ * @param blockMasks Array with room for MAX_BLOCK_MASKS implementations.
+ * @return size_t How many implementations were listed.
+ */
+size_t listBlockMasks(BlockMask blockMasks[]);
+
+/**
+ * Build the structural mask of a block shorter than SCAN_BLOCK_SIZE.
+ *
+ * @param block The block to be scanned.
+ * @param length The length of the block.
+ * @param quotes Will be set to a bitmap with one bit set for each quote.
+ * @return uint64_t Bitmap with one bit set for each value or line separator.
+ */
+uint64_t scalarBlockMask(const char *block, size_t length, uint64_t *quotes);
+
+/**
+ * Count the quotes of a buffer.
+ *
+ * @param data The buffer, does not need to be NUL-terminated.
+ * @param length The length of the buffer.
+ * @return size_t How many quotes the buffer contains.
+ */
+size_t countQuotes(const char *data, size_t length);
+
+/**
+ * Initialize a scanner which finds the value and line separators of a buffer,
+ * one block of SCAN_BLOCK_SIZE bytes at a time.
+ *
+ * @param scanner The scanner to be initialized.
+ * @param data The buffer to be scanned, does not need to be NUL-terminated.
+ * @param length The length of the buffer.
+ */
+void initScanner(CsvScanner *scanner, const char *data, size_t length);
+
+/**
+ * Load the structural mask of the block starting at the scanner's current position.
+ * Separators inside quoted fields are removed from the mask, carrying whether the
+ * block ends inside a quoted field over to the next block. Blocks without quotes
+ * outside of quoted fields keep the mask as it is.
+ *
+ * @param scanner The scanner.
+ * @return uint64_t The structural mask of the block.
+ */
+static inline uint64_t loadBlockMask(CsvScanner *scanner)
+{
+  uint64_t quotes, mask;
+
+  if (scanner->blockStart + SCAN_BLOCK_SIZE <= scanner->length)
+    mask = scanner->blockMask(&scanner->data[scanner->blockStart], &quotes);
+  else
+    mask = scalarBlockMask(
+        &scanner->data[scanner->blockStart],
+        scanner->length - scanner->blockStart,
+        &quotes);
+
+  if (!(quotes | scanner->quoteCarry))
+    return mask;
+
+  // Prefix XOR: bit i is set when an odd number of quotes comes before or at i, so
+  // escaped quotes close and reopen the field without exposing any separator
+  uint64_t quoted = quotes;
+  quoted ^= quoted << 1;
+  quoted ^= quoted << 2;
+  quoted ^= quoted << 4;
+  quoted ^= quoted << 8;
+  quoted ^= quoted << 16;
+  quoted ^= quoted << 32;
+  quoted ^= scanner->quoteCarry;
+
+  scanner->quoteCarry = (uint64_t)((int64_t)quoted >> 63);
+  return mask & ~quoted;
+}
+
+/**
+ * Find the next value or line separator of the scanned buffer.
+ *
+ * @param scanner The scanner.
+ * @return size_t The offset of the separator, or the length of the buffer when
+ * there are no separators left.
+ */
+static inline size_t nextStructural(CsvScanner *scanner)
+{
+  while (scanner->mask == 0)
+  {
+    scanner->blockStart += SCAN_BLOCK_SIZE;
+    if (scanner->blockStart >= scanner->length)
+    {
+      scanner->blockStart = scanner->length;
+      return scanner->length;
+    }
+    scanner->mask = loadBlockMask(scanner);
+  }
+
+  size_t position = scanner->blockStart + __builtin_ctzll(scanner->mask);
+  scanner->mask &= scanner->mask - 1;
+  return position;
+}
+
+/**
+ * Skip the rest of a line without visiting its value separators, leaving the
+ * scanner right after the line separator. Lines whose rest contains quotes are
+ * followed separator by separator, since their line separator may be quoted.
+ *
+ * @param scanner The scanner.
+ * @param position Offset inside the line from which to look for its end, right
+ * after a value separator.
+ * @return size_t The offset of the line separator, or the length of the buffer
+ * when the line is the last one.
+ */
+static inline size_t skipLine(CsvScanner *scanner, size_t position)
+{
+  const char *lineEnd = memchr(&scanner->data[position], '\n', scanner->length - position);
+  size_t end = lineEnd != NULL ? (size_t)(lineEnd - scanner->data) : scanner->length;
+
+  if (memchr(&scanner->data[position], '"', end - position) != NULL)
+  {
+    end = nextStructural(scanner);
+    while (end < scanner->length && scanner->data[end] != '\n')
+      end = nextStructural(scanner);
+    return end;
+  }
+
+  if (lineEnd == NULL)
+  {
+    scanner->blockStart = scanner->length;
+    scanner->mask = 0;
+    return scanner->length;
+  }
+  size_t blockStart = end - end % SCAN_BLOCK_SIZE;
+
+  if (blockStart != scanner->blockStart)
+  {
+    // Without quotes up to the line separator, its block starts outside quoted fields
+    scanner->quoteCarry = 0;
+    scanner->blockStart = blockStart;
+    scanner->mask = loadBlockMask(scanner);
+  }
+
+  scanner->mask &= (~0ULL << (end % SCAN_BLOCK_SIZE)) << 1;
+  return end;
+}
+
+#endif
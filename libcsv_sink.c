@@ -0,0 +1,213 @@
+#include <stdlib.h>
+#include <stdbool.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/uio.h>
+
+#include "libcsv_sink.h"
+
+/**
+ * Allocate memory to a new sink.
+ *
+ * @param kind The kind of the sink.
+ * @param buffer The buffer of the sink.
+ * @param capacity The size of the buffer.
+ * @return CsvSink* The created sink.
+ */
+static CsvSink *createSink(enum sinkKind kind, char buffer[], size_t capacity)
+{
+  CsvSink *sink = (CsvSink *)malloc(sizeof(CsvSink));
+  sink->kind = kind;
+  sink->buffer = buffer;
+  sink->length = 0;
+  sink->capacity = capacity;
+  sink->bytesWritten = 0;
+  sink->fd = -1;
+  sink->callback = NULL;
+  sink->context = NULL;
+  sink->hasError = false;
+  sink->allocations = 0;
+  return sink;
+}
+
+CsvSink *createFdSink(int fd)
+{
+  CsvSink *sink = createSink(FD_SINK, (char *)malloc(SINK_BUFFER_SIZE), SINK_BUFFER_SIZE);
+  sink->fd = fd;
+  return sink;
+}
+
+CsvSink *createMemorySink(char buffer[], size_t capacity)
+{
+  return createSink(MEMORY_SINK, buffer, capacity);
+}
+
+CsvSink *createCallbackSink(CsvSinkCallback callback, void *context)
+{
+  CsvSink *sink = createSink(CALLBACK_SINK, (char *)malloc(SINK_BUFFER_SIZE), SINK_BUFFER_SIZE);
+  sink->callback = callback;
+  sink->context = context;
+  return sink;
+}
+
+CsvSink *createGrowingSink()
+{
+  return createSink(GROWING_SINK, NULL, 0);
+}
+
+char *takeSinkBuffer(CsvSink *sink, size_t *length)
+{
+  char *buffer = sink->buffer;
+  *length = sink->length;
+
+  sink->buffer = NULL;
+  sink->length = 0;
+  sink->capacity = 0;
+  return buffer;
+}
+
+/**
+ * Write all the data of an I/O vector to a file descriptor, retrying partial and
+ * interrupted writes.
+ *
+ * @param fd The file descriptor.
+ * @param iov The I/O vector, which will be modified.
+ * @param iovcnt How many entries the vector has.
+ * @return bool Whether all the data was written.
+ */
+static bool writeAll(int fd, struct iovec iov[], int iovcnt)
+{
+  while (iovcnt > 0)
+  {
+    ssize_t written = writev(fd, iov, iovcnt);
+
+    if (written < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      return false;
+    }
+
+    while (iovcnt > 0 && (size_t)written >= iov->iov_len)
+    {
+      written -= iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+
+    if (iovcnt > 0)
+    {
+      iov->iov_base = (char *)iov->iov_base + written;
+      iov->iov_len -= written;
+    }
+  }
+
+  return true;
+}
+
+void writeSinkOverflow(CsvSink *sink, const char data[], size_t length)
+{
+  if (sink->hasError)
+    return;
+
+  switch (sink->kind)
+  {
+  case FD_SINK:
+  {
+    struct iovec iov[2] = {
+        {sink->buffer, sink->length},
+        {(void *)data, length}};
+    sink->bytesWritten += sink->length + length;
+    sink->hasError = !writeAll(sink->fd, iov, 2);
+    sink->length = 0;
+    break;
+  }
+  case CALLBACK_SINK:
+    sink->bytesWritten += sink->length;
+    sink->hasError = sink->length && !sink->callback(sink->buffer, sink->length, sink->context);
+    sink->length = 0;
+
+    if (sink->hasError)
+      break;
+
+    if (length < sink->capacity)
+    {
+      memcpy(sink->buffer, data, length);
+      sink->length = length;
+    }
+    else
+    {
+      sink->bytesWritten += length;
+      sink->hasError = !sink->callback(data, length, sink->context);
+    }
+    break;
+  case GROWING_SINK:
+    while (sink->length + length > sink->capacity)
+      sink->capacity = sink->capacity ? sink->capacity * 2 : SINK_BUFFER_SIZE;
+    sink->buffer = (char *)realloc(sink->buffer, sink->capacity);
+    sink->allocations++;
+    memcpy(&sink->buffer[sink->length], data, length);
+    sink->length += length;
+    break;
+  case MEMORY_SINK:
+    memcpy(&sink->buffer[sink->length], data, sink->capacity - sink->length);
+    sink->length = sink->capacity;
+    sink->hasError = true;
+    break;
+  }
+}
+
+bool flushSink(CsvSink *sink)
+{
+  if (sink->hasError || !sink->length)
+    return !sink->hasError;
+
+  switch (sink->kind)
+  {
+  case FD_SINK:
+  {
+    struct iovec iov = {sink->buffer, sink->length};
+    sink->bytesWritten += sink->length;
+    sink->hasError = !writeAll(sink->fd, &iov, 1);
+    sink->length = 0;
+    break;
+  }
+  case CALLBACK_SINK:
+    sink->bytesWritten += sink->length;
+    sink->hasError = !sink->callback(sink->buffer, sink->length, sink->context);
+    sink->length = 0;
+    break;
+  default:
+    break;
+  }
+
+  return !sink->hasError;
+}
+
+size_t getSinkLength(const CsvSink *sink)
+{
+  switch (sink->kind)
+  {
+  case MEMORY_SINK:
+  case GROWING_SINK:
+    return sink->length;
+  default:
+    return sink->bytesWritten + sink->length;
+  }
+}
+
+bool hasSinkError(const CsvSink *sink)
+{
+  return sink->hasError;
+}
+
+void freeSink(CsvSink *sink)
+{
+  flushSink(sink);
+
+  if (sink->kind != MEMORY_SINK)
+    free(sink->buffer);
+
+  free(sink);
+}
@@ -0,0 +1,96 @@
+#ifndef LIBCSV_SINK_H
+#define LIBCSV_SINK_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <string.h>
+
+#include "libcsv.h"
+
+#define SINK_BUFFER_SIZE (1 << 16)
+
+enum sinkKind
+{
+  FD_SINK = 1,
+  MEMORY_SINK = 2,
+  GROWING_SINK = 3,
+  CALLBACK_SINK = 4
+};
+
+struct CsvSink
+{
+  enum sinkKind kind;
+  char *buffer;
+  size_t length;
+  size_t capacity;
+  size_t bytesWritten;
+  int fd;
+  CsvSinkCallback callback;
+  void *context;
+  bool hasError;
+  size_t allocations;
+};
+
+/**
+ * Create a sink which keeps everything written to it in memory, growing its buffer
+ * as needed. The content can be taken with takeSinkBuffer.
+ *
+ * @return CsvSink* The created sink.
+ */
+CsvSink *createGrowingSink();
+
+/**
+ * Take the buffer of a growing sink, leaving the sink empty.
+ *
+ * @param sink The growing sink.
+ * @param length Will be set to the length of the buffer.
+ * @return char* The buffer, which must be freed by the caller.
+ */
+char *takeSinkBuffer(CsvSink *sink, size_t *length);
+
+/**
+ * Write data which does not fit in the free space of the sink buffer.
+ *
+ * @param sink The sink.
+ * @param data The data to be written.
+ * @param length The length of the data.
+ */
+void writeSinkOverflow(CsvSink *sink, const char data[], size_t length);
+
+/**
+ * Write data to a sink, copying it into the sink buffer when it fits.
+ *
+ * @param sink The sink.
+ * @param data The data to be written.
+ * @param length The length of the data.
+ */
+static inline void writeSink(CsvSink *sink, const char data[], size_t length)
+{
+  if (sink->length + length <= sink->capacity)
+  {
+    memcpy(&sink->buffer[sink->length], data, length);
+    sink->length += length;
+    return;
+  }
+
+  writeSinkOverflow(sink, data, length);
+}
+
+/**
+ * Write a single character to a sink.
+ *
+ * @param sink The sink.
+ * @param character The character to be written.
+ */
+static inline void putSink(CsvSink *sink, char character)
+{
+  if (sink->length < sink->capacity)
+  {
+    sink->buffer[sink->length++] = character;
+    return;
+  }
+
+  writeSinkOverflow(sink, &character, 1);
+}
+
+#endif
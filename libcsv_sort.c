@@ -0,0 +1,683 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "libcsv_sort.h"
+
+#define SORT_INSERTION_THRESHOLD 16
+
+typedef struct
+{
+  FILE *run;
+  SortRecord **records;
+  size_t recordCount;
+  size_t nextRecord;
+  char *buffer;
+  size_t bufferCapacity;
+  SortRecord *current;
+} SortCursor;
+
+/**
+ * Get the sort values of a record.
+ *
+ * @param record The record.
+ * @return SortValue* The sort values, one per sort key.
+ */
+static inline SortValue *getSortValues(const SortRecord *record)
+{
+  return (SortValue *)(record + 1);
+}
+
+/**
+ * Compare two records by their sort keys, then by the order in which they were
+ * added, so the order of every record is fully defined.
+ *
+ * Values which are not valid for the type of their key come after the valid ones,
+ * whatever the direction of the key.
+ *
+ * @param sorter The sorter with the sort keys.
+ * @param a The first record.
+ * @param b The second record.
+ * @return int Negative, zero or positive if a comes before, with or after b.
+ */
+static int compareRecords(const CsvSorter *sorter, const SortRecord *a, const SortRecord *b)
+{
+  const SortValue *aValues = getSortValues(a);
+  const SortValue *bValues = getSortValues(b);
+
+  for (size_t i = 0; i < sorter->keyCount; i++)
+  {
+    const SortValue *aValue = &aValues[i];
+    const SortValue *bValue = &bValues[i];
+    int comparison;
+
+    if (aValue->isValid != bValue->isValid)
+      return aValue->isValid ? -1 : 1;
+    if (!aValue->isValid)
+      continue;
+
+    switch (sorter->keys[i].type)
+    {
+    case INTEGER:
+    case DATE:
+      comparison = (aValue->integerValue > bValue->integerValue) -
+                   (aValue->integerValue < bValue->integerValue);
+      break;
+    case FLOAT:
+      comparison = (aValue->floatValue > bValue->floatValue) -
+                   (aValue->floatValue < bValue->floatValue);
+      break;
+    default:
+    {
+      CellView cell = {(const char *)a + aValue->text.offset, aValue->text.length};
+      comparison = compareCell(&cell, (const char *)b + bValue->text.offset, bValue->text.length);
+    }
+    }
+
+    if (comparison != 0)
+      return sorter->keys[i].isDescending ? -comparison : comparison;
+  }
+
+  return (a->sequence > b->sequence) - (a->sequence < b->sequence);
+}
+
+/**
+ * Sort records with a merge sort, switching to insertion sort for short ranges.
+ *
+ * @param sorter The sorter with the sort keys.
+ * @param records The records to be sorted.
+ * @param buffer Temporary array with room for half of the records.
+ * @param count How many records there are.
+ */
+static void mergeSortRecords(
+    const CsvSorter *sorter,
+    SortRecord **records,
+    SortRecord **buffer,
+    size_t count)
+{
+  if (count <= SORT_INSERTION_THRESHOLD)
+  {
+    for (size_t i = 1; i < count; i++)
+    {
+      SortRecord *record = records[i];
+      size_t j = i;
+
+      for (; j > 0 && compareRecords(sorter, record, records[j - 1]) < 0; j--)
+        records[j] = records[j - 1];
+      records[j] = record;
+    }
+    return;
+  }
+
+  size_t half = count / 2;
+  mergeSortRecords(sorter, records, buffer, half);
+  mergeSortRecords(sorter, &records[half], buffer, count - half);
+
+  // Already ordered halves, common for inputs which are mostly sorted
+  if (compareRecords(sorter, records[half - 1], records[half]) <= 0)
+    return;
+
+  memcpy(buffer, records, half * sizeof(SortRecord *));
+
+  size_t i = 0, j = half, k = 0;
+  while (i < half && j < count)
+    records[k++] = compareRecords(sorter, records[j], buffer[i]) < 0 ? records[j++] : buffer[i++];
+  while (i < half)
+    records[k++] = buffer[i++];
+}
+
+/**
+ * Sort the records held in memory by a sorter.
+ *
+ * @param sorter The sorter.
+ */
+static void sortRecords(CsvSorter *sorter)
+{
+  SortRecord **buffer = (SortRecord **)malloc((sorter->recordCount / 2 + 1) * sizeof(SortRecord *));
+  mergeSortRecords(sorter, sorter->records, buffer, sorter->recordCount);
+  free(buffer);
+}
+
+/**
+ * Move a record of a bounded max-heap down until no child comes after it.
+ *
+ * @param sorter The sorter, whose records are the heap.
+ * @param index The index of the record.
+ */
+static void siftDownTopK(CsvSorter *sorter, size_t index)
+{
+  SortRecord **heap = sorter->records;
+
+  while (true)
+  {
+    size_t worst = index;
+    size_t left = 2 * index + 1, right = left + 1;
+
+    if (left < sorter->recordCount && compareRecords(sorter, heap[left], heap[worst]) > 0)
+      worst = left;
+    if (right < sorter->recordCount && compareRecords(sorter, heap[right], heap[worst]) > 0)
+      worst = right;
+    if (worst == index)
+      return;
+
+    SortRecord *record = heap[index];
+    heap[index] = heap[worst];
+    heap[worst] = record;
+    index = worst;
+  }
+}
+
+/**
+ * Move a record of a bounded max-heap up until its parent does not come before it.
+ *
+ * @param sorter The sorter, whose records are the heap.
+ * @param index The index of the record.
+ */
+static void siftUpTopK(CsvSorter *sorter, size_t index)
+{
+  SortRecord **heap = sorter->records;
+
+  while (index > 0)
+  {
+    size_t parent = (index - 1) / 2;
+
+    if (compareRecords(sorter, heap[index], heap[parent]) <= 0)
+      return;
+
+    SortRecord *record = heap[index];
+    heap[index] = heap[parent];
+    heap[parent] = record;
+    index = parent;
+  }
+}
+
+CsvSorter *createSorter(
+    const Csv *csv,
+    const SortKey keys[],
+    size_t keyCount,
+    size_t memoryBudget,
+    size_t offset,
+    size_t limit)
+{
+  CsvSorter *sorter = (CsvSorter *)malloc(sizeof(CsvSorter));
+  sorter->csv = csv;
+  sorter->keys = keys;
+  sorter->keyCount = keyCount;
+  sorter->memoryBudget = memoryBudget;
+  sorter->offset = offset;
+  sorter->limit = limit ? offset + limit : 0;
+  sorter->sequence = 0;
+  sorter->records = NULL;
+  sorter->recordCount = 0;
+  sorter->recordCapacity = 0;
+  initArena(&sorter->arena, ARENA_BLOCK_SIZE);
+  sorter->isTopK = limit > 0;
+  sorter->topKBytes = 0;
+  sorter->scratch = NULL;
+  sorter->scratchCapacity = 0;
+  sorter->runs = NULL;
+  sorter->runLevels = NULL;
+  sorter->runCount = 0;
+  sorter->cellsCopied = 0;
+  return sorter;
+}
+
+/**
+ * Build the header and sort values of a record in the scratch buffer of a sorter,
+ * reserving room for its line.
+ *
+ * @param sorter The sorter.
+ * @param cells Array with one view per cell of the row.
+ * @param cellCount How many cells the row has.
+ * @return SortRecord* The record, whose line is not set yet.
+ */
+static SortRecord *buildRecordKeys(CsvSorter *sorter, const CellView cells[], size_t cellCount)
+{
+  const Csv *csv = sorter->csv;
+  size_t capacity = sizeof(SortRecord) + sorter->keyCount * sizeof(SortValue) + csv->colCount;
+
+  for (size_t i = 0; i < sorter->keyCount; i++)
+    if (sorter->keys[i].column < cellCount)
+      capacity += cells[sorter->keys[i].column].length;
+
+  for (size_t col = 0; col < cellCount && col < csv->colCount; col++)
+    if (csv->columns[col]->isSelected)
+      capacity += cells[col].length;
+
+  if (capacity > sorter->scratchCapacity)
+  {
+    sorter->scratchCapacity = capacity * 2;
+    free(sorter->scratch);
+    sorter->scratch = (char *)malloc(sorter->scratchCapacity);
+  }
+
+  SortRecord *record = (SortRecord *)sorter->scratch;
+  SortValue *values = getSortValues(record);
+  size_t size = sizeof(SortRecord) + sorter->keyCount * sizeof(SortValue);
+
+  for (size_t i = 0; i < sorter->keyCount; i++)
+  {
+    const SortKey *key = &sorter->keys[i];
+    CellView cell = {"", 0};
+    char *text = &sorter->scratch[size];
+
+    if (key->column < cellCount)
+      cell = cells[key->column];
+
+    if (cell.length && *cell.value == *QUOTE)
+    {
+      cell.length = unquoteCell(&cell, text);
+      cell.value = text;
+    }
+
+    values[i].isValid = true;
+    switch (key->type)
+    {
+    case INTEGER:
+      values[i].isValid = parseInteger(&cell, &values[i].integerValue);
+      break;
+    case DATE:
+      values[i].isValid = parseDate(&cell, &values[i].integerValue);
+      break;
+    case FLOAT:
+      values[i].isValid = parseFloat(&cell, &values[i].floatValue);
+      break;
+    default:
+      if (cell.value != text)
+        memcpy(text, cell.value, cell.length);
+      values[i].text.offset = size;
+      values[i].text.length = cell.length;
+      size += cell.length;
+    }
+  }
+
+  record->lineOffset = size;
+  record->lineLength = 0;
+  record->size = size;
+  record->reserved = 0;
+  record->sequence = sorter->sequence++;
+  return record;
+}
+
+/**
+ * Append the selected cells of a row to a record built by buildRecordKeys.
+ *
+ * @param sorter The sorter.
+ * @param record The record in the scratch buffer of the sorter.
+ * @param cells Array with one view per cell of the row.
+ * @param cellCount How many cells the row has.
+ */
+static void appendRecordLine(
+    CsvSorter *sorter,
+    SortRecord *record,
+    const CellView cells[],
+    size_t cellCount)
+{
+  const Csv *csv = sorter->csv;
+  char *line = (char *)record + record->lineOffset;
+  size_t length = 0;
+  bool first = true;
+
+  for (size_t col = 0; col < csv->colCount; col++)
+  {
+    if (!csv->columns[col]->isSelected)
+      continue;
+
+    if (!first)
+      line[length++] = *VALUE_SEPARATOR;
+    first = false;
+
+    if (col < cellCount)
+    {
+      memcpy(&line[length], cells[col].value, cells[col].length);
+      length += cells[col].length;
+      sorter->cellsCopied++;
+    }
+  }
+
+  record->lineLength = length;
+  record->size += length;
+}
+
+/**
+ * Release the records held in memory by a sorter.
+ *
+ * @param sorter The sorter.
+ */
+static void releaseRecords(CsvSorter *sorter)
+{
+  if (sorter->isTopK)
+    for (size_t i = 0; i < sorter->recordCount; i++)
+      free(sorter->records[i]);
+
+  freeArena(&sorter->arena);
+  initArena(&sorter->arena, ARENA_BLOCK_SIZE);
+  sorter->recordCount = 0;
+  sorter->topKBytes = 0;
+}
+
+/**
+ * Read the next record of a cursor.
+ *
+ * @param cursor The cursor.
+ * @return bool Whether there was a record left.
+ */
+static bool advanceCursor(SortCursor *cursor)
+{
+  cursor->current = NULL;
+
+  if (cursor->run == NULL)
+  {
+    if (cursor->nextRecord < cursor->recordCount)
+      cursor->current = cursor->records[cursor->nextRecord++];
+    return cursor->current != NULL;
+  }
+
+  SortRecord header;
+  if (fread(&header, sizeof(SortRecord), 1, cursor->run) != 1)
+    return false;
+
+  if (header.size > cursor->bufferCapacity)
+  {
+    cursor->bufferCapacity = header.size;
+    free(cursor->buffer);
+    cursor->buffer = (char *)malloc(cursor->bufferCapacity);
+  }
+
+  memcpy(cursor->buffer, &header, sizeof(SortRecord));
+  size_t rest = header.size - sizeof(SortRecord);
+
+  if (rest && fread(&cursor->buffer[sizeof(SortRecord)], rest, 1, cursor->run) != 1)
+    return false;
+
+  cursor->current = (SortRecord *)cursor->buffer;
+  return true;
+}
+
+/**
+ * Move a cursor of a min-heap down until no child comes before it.
+ *
+ * @param sorter The sorter with the sort keys.
+ * @param heap The heap of cursors, ordered by their current record.
+ * @param count How many cursors the heap has.
+ * @param index The index of the cursor.
+ */
+static void siftDownCursor(
+    const CsvSorter *sorter,
+    SortCursor **heap,
+    size_t count,
+    size_t index)
+{
+  while (true)
+  {
+    size_t first = index;
+    size_t left = 2 * index + 1, right = left + 1;
+
+    if (left < count && compareRecords(sorter, heap[left]->current, heap[first]->current) < 0)
+      first = left;
+    if (right < count && compareRecords(sorter, heap[right]->current, heap[first]->current) < 0)
+      first = right;
+    if (first == index)
+      return;
+
+    SortCursor *cursor = heap[index];
+    heap[index] = heap[first];
+    heap[first] = cursor;
+    index = first;
+  }
+}
+
+/**
+ * Merge the last runs of a sorter and its sorted records held in memory, writing
+ * the records to a run file, or the lines after the offset of the sorter to a sink.
+ *
+ * @param sorter The sorter.
+ * @param firstRun The index of the first run to be merged.
+ * @param output The run file the records are written to, or NULL.
+ * @param sink The sink the lines are written to when there is no run file.
+ * @return bool Whether the runs could be read back.
+ */
+static bool mergeRuns(CsvSorter *sorter, size_t firstRun, FILE *output, CsvSink *sink)
+{
+  size_t runCount = sorter->runCount - firstRun;
+  size_t cursorCount = runCount + 1;
+  SortCursor *cursors = (SortCursor *)calloc(cursorCount, sizeof(SortCursor));
+  SortCursor **heap = (SortCursor **)malloc(cursorCount * sizeof(SortCursor *));
+  size_t heapCount = 0;
+  bool isValid = true;
+
+  for (size_t i = 0; i < cursorCount; i++)
+  {
+    SortCursor *cursor = &cursors[i];
+
+    if (i < runCount)
+    {
+      cursor->run = sorter->runs[firstRun + i];
+      rewind(cursor->run);
+    }
+    else
+    {
+      cursor->records = sorter->records;
+      cursor->recordCount = sorter->recordCount;
+    }
+
+    if (advanceCursor(cursor))
+      heap[heapCount++] = cursor;
+  }
+
+  for (size_t i = heapCount; i-- > 0;)
+    siftDownCursor(sorter, heap, heapCount, i);
+
+  size_t written = 0;
+  while (heapCount > 0 && (!sorter->limit || written < sorter->limit))
+  {
+    const SortRecord *record = heap[0]->current;
+
+    if (output != NULL)
+      fwrite(record, record->size, 1, output);
+    else if (written >= sorter->offset)
+    {
+      writeSink(sink, (const char *)record + record->lineOffset, record->lineLength);
+      putSink(sink, *LINE_SEPARATOR);
+    }
+    written++;
+
+    if (!advanceCursor(heap[0]))
+      heap[0] = heap[--heapCount];
+    siftDownCursor(sorter, heap, heapCount, 0);
+  }
+
+  for (size_t i = 0; i < cursorCount; i++)
+  {
+    if (cursors[i].run != NULL && ferror(cursors[i].run))
+      isValid = false;
+    free(cursors[i].buffer);
+  }
+
+  free(heap);
+  free(cursors);
+  return isValid;
+}
+
+/**
+ * Create an empty run file.
+ *
+ * @return FILE* The run file, or NULL if it could not be created.
+ */
+static FILE *createRun()
+{
+  FILE *run = tmpfile();
+
+  if (run == NULL)
+  {
+    fprintf(stderr, "Could not create a temporary file to sort rows\n");
+    return NULL;
+  }
+
+  setvbuf(run, NULL, _IOFBF, SORT_RUN_BUFFER_SIZE);
+  return run;
+}
+
+/**
+ * Write the records held in memory by a sorter to a new run file, sorted. Whenever
+ * the last SORT_MAX_MERGED_RUNS runs come from as many merges, they are merged
+ * into a single one, like the carries of a counter. This keeps few files open and
+ * rewrites each row once per level.
+ *
+ * @param sorter The sorter.
+ * @return bool Whether the records could be written. If not, they are kept in
+ * memory beyond the budget.
+ */
+static bool spillRun(CsvSorter *sorter)
+{
+  FILE *run = createRun();
+
+  if (run == NULL)
+  {
+    sorter->memoryBudget = SIZE_MAX;
+    return false;
+  }
+
+  sortRecords(sorter);
+  for (size_t i = 0; i < sorter->recordCount; i++)
+    fwrite(sorter->records[i], sorter->records[i]->size, 1, run);
+
+  releaseRecords(sorter);
+  sorter->runs = (FILE **)realloc(sorter->runs, (sorter->runCount + 1) * sizeof(FILE *));
+  sorter->runLevels = (size_t *)realloc(sorter->runLevels, (sorter->runCount + 1) * sizeof(size_t));
+  sorter->runs[sorter->runCount] = run;
+  sorter->runLevels[sorter->runCount] = 0;
+  sorter->runCount++;
+
+  // Levels never increase along the runs, so the last runs share a level when the
+  // first of them has the level of the last one
+  while (sorter->runCount >= SORT_MAX_MERGED_RUNS)
+  {
+    size_t firstRun = sorter->runCount - SORT_MAX_MERGED_RUNS;
+    size_t level = sorter->runLevels[firstRun];
+
+    if (sorter->runLevels[sorter->runCount - 1] != level || (run = createRun()) == NULL)
+      break;
+
+    if (!mergeRuns(sorter, firstRun, run, NULL))
+      fprintf(stderr, "Could not read back the temporary files of sorted rows\n");
+
+    for (size_t i = firstRun; i < sorter->runCount; i++)
+      fclose(sorter->runs[i]);
+    sorter->runs[firstRun] = run;
+    sorter->runLevels[firstRun] = level + 1;
+    sorter->runCount = firstRun + 1;
+  }
+
+  return true;
+}
+
+/**
+ * Make room for one more record in the records array of a sorter.
+ *
+ * @param sorter The sorter.
+ */
+static void reserveRecord(CsvSorter *sorter)
+{
+  if (sorter->recordCount < sorter->recordCapacity)
+    return;
+
+  sorter->recordCapacity = sorter->recordCapacity ? sorter->recordCapacity * 2 : 1024;
+  sorter->records = (SortRecord **)realloc(
+      sorter->records,
+      sorter->recordCapacity * sizeof(SortRecord *));
+}
+
+/**
+ * Add a record to the bounded heap of a sorter with a limit, replacing the record
+ * which comes last once the heap is full.
+ *
+ * @param sorter The sorter.
+ * @param record The record in the scratch buffer of the sorter.
+ * @param cells Array with one view per cell of the row.
+ * @param cellCount How many cells the row has.
+ */
+static void addTopKRecord(
+    CsvSorter *sorter,
+    SortRecord *record,
+    const CellView cells[],
+    size_t cellCount)
+{
+  if (sorter->recordCount == sorter->limit)
+  {
+    // Rows coming after every kept row are dropped without formatting their line
+    if (compareRecords(sorter, record, sorter->records[0]) >= 0)
+      return;
+
+    appendRecordLine(sorter, record, cells, cellCount);
+    sorter->topKBytes += record->size;
+    sorter->topKBytes -= sorter->records[0]->size;
+    sorter->records[0] = (SortRecord *)realloc(sorter->records[0], record->size);
+    memcpy(sorter->records[0], record, record->size);
+    siftDownTopK(sorter, 0);
+  }
+  else
+  {
+    appendRecordLine(sorter, record, cells, cellCount);
+    reserveRecord(sorter);
+
+    SortRecord *copy = (SortRecord *)malloc(record->size);
+    memcpy(copy, record, record->size);
+    sorter->records[sorter->recordCount++] = copy;
+    sorter->topKBytes += record->size;
+    siftUpTopK(sorter, sorter->recordCount - 1);
+  }
+
+  // A limit too large for the memory budget falls back to sorted runs
+  if (sorter->topKBytes + sorter->recordCapacity * sizeof(SortRecord *) > sorter->memoryBudget &&
+      spillRun(sorter))
+    sorter->isTopK = false;
+}
+
+void addSortedRow(CsvSorter *sorter, const CellView cells[], size_t cellCount)
+{
+  SortRecord *record = buildRecordKeys(sorter, cells, cellCount);
+
+  if (sorter->isTopK)
+  {
+    addTopKRecord(sorter, record, cells, cellCount);
+    return;
+  }
+
+  appendRecordLine(sorter, record, cells, cellCount);
+  reserveRecord(sorter);
+
+  SortRecord *copy = (SortRecord *)arenaAlloc(&sorter->arena, record->size);
+  memcpy(copy, record, record->size);
+  sorter->records[sorter->recordCount++] = copy;
+
+  // The merge sort needs room for half as many pointers again
+  if (sorter->arena.bytesUsed + sorter->recordCapacity * sizeof(SortRecord *) * 3 / 2 >
+      sorter->memoryBudget)
+    spillRun(sorter);
+}
+
+void printSortedRows(CsvSorter *sorter, CsvSink *sink)
+{
+  sortRecords(sorter);
+
+  if (!mergeRuns(sorter, 0, NULL, sink))
+    fprintf(stderr, "Could not read back the temporary files of sorted rows\n");
+}
+
+void freeSorter(CsvSorter *sorter)
+{
+  releaseRecords(sorter);
+  freeArena(&sorter->arena);
+
+  for (size_t i = 0; i < sorter->runCount; i++)
+    fclose(sorter->runs[i]);
+
+  free(sorter->runs);
+  free(sorter->runLevels);
+  free(sorter->records);
+  free(sorter->scratch);
+  free(sorter);
+}
@@ -0,0 +1,127 @@
+#ifndef LIBCSV_SORT_H
+#define LIBCSV_SORT_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include "libcsv_util.h"
+
+#define SORT_DEFAULT_MEMORY_BUDGET (64 << 20)
+#define SORT_MAX_MERGED_RUNS 64
+#define SORT_RUN_BUFFER_SIZE (64 << 10)
+
+typedef struct
+{
+  size_t column;
+  enum cellType type;
+  bool isDescending;
+} SortKey;
+
+/**
+ * Header of a row kept for sorting. It is followed by one SortValue per sort key,
+ * the text of the text keys and the formatted selected cells of the row. Offsets
+ * are relative to the header, so records can be written to and read back from run
+ * files as they are.
+ */
+typedef struct
+{
+  uint32_t size;
+  uint32_t lineOffset;
+  uint32_t lineLength;
+  uint32_t reserved;
+  uint64_t sequence;
+} SortRecord;
+
+typedef struct
+{
+  union
+  {
+    long long integerValue;
+    double floatValue;
+    struct
+    {
+      uint32_t offset;
+      uint32_t length;
+    } text;
+  };
+  bool isValid;
+} SortValue;
+
+typedef struct
+{
+  const Csv *csv;
+  const SortKey *keys;
+  size_t keyCount;
+  size_t memoryBudget;
+  size_t offset;
+  // How many rows of the order may be written, counting the skipped ones
+  size_t limit;
+  uint64_t sequence;
+  // Rows of the current run, or the bounded max-heap of the best rows when limited
+  SortRecord **records;
+  size_t recordCount;
+  size_t recordCapacity;
+  Arena arena;
+  bool isTopK;
+  size_t topKBytes;
+  // The record being added, built before deciding whether to keep it
+  char *scratch;
+  size_t scratchCapacity;
+  // Spilled runs, with how many merges produced each of them
+  FILE **runs;
+  size_t *runLevels;
+  size_t runCount;
+  // Cells copied into the lines of the records
+  size_t cellsCopied;
+} CsvSorter;
+
+/**
+ * Create a sorter collecting the rows of a CSV in memory, spilling sorted runs to
+ * temporary files whenever they grow beyond the memory budget.
+ *
+ * With a limit, only the best rows are kept in a bounded heap. If even those do
+ * not fit in the memory budget, the sorter falls back to sorted runs.
+ *
+ * @param csv The CSV structure with the columns, whose selected cells are kept.
+ * @param keys The sort keys, from the most to the least significant.
+ * @param keyCount How many sort keys there are.
+ * @param memoryBudget How many bytes of rows to hold in memory before spilling.
+ * @param offset How many of the first rows of the order to skip.
+ * @param limit How many rows to write after the skipped ones, 0 for all of them.
+ * @return CsvSorter* The created sorter.
+ */
+CsvSorter *createSorter(
+    const Csv *csv,
+    const SortKey keys[],
+    size_t keyCount,
+    size_t memoryBudget,
+    size_t offset,
+    size_t limit);
+
+/**
+ * Add a row to a sorter, copying its selected cells and sort keys.
+ *
+ * @param sorter The sorter.
+ * @param cells Array with one view per cell of the row.
+ * @param cellCount How many cells the row has. Missing cells are empty.
+ */
+void addSortedRow(CsvSorter *sorter, const CellView cells[], size_t cellCount);
+
+/**
+ * Write the rows of a sorter to a sink in order, merging the spilled runs.
+ *
+ * @param sorter The sorter, which must not be added to afterwards.
+ * @param sink The sink the rows are written to.
+ */
+void printSortedRows(CsvSorter *sorter, CsvSink *sink);
+
+/**
+ * Free the memory and temporary files of a sorter.
+ *
+ * @param sorter The sorter to be freed.
+ */
+void freeSorter(CsvSorter *sorter);
+
+#endif
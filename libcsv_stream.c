@@ -0,0 +1,575 @@
+#define _GNU_SOURCE
+
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdbool.h>
+#include <errno.h>
+#include <unistd.h>
+#include <poll.h>
+#include <pthread.h>
+#include <zlib.h>
+#ifdef LIBCSV_ZSTD
+#include <zstd.h>
+#endif
+
+#include "libcsv_util.h"
+#include "libcsv_scan.h"
+#include "libcsv_stream.h"
+
+#define GZIP_MAGIC "\x1f\x8b"
+#define ZSTD_MAGIC "\x28\xb5\x2f\xfd"
+// Decode gzip members, skipping their header and checking their trailer
+#define GZIP_WINDOW_BITS (15 + 16)
+
+enum compression detectCompression(const char *data, size_t length)
+{
+  if (length >= strlen(GZIP_MAGIC) && memcmp(data, GZIP_MAGIC, strlen(GZIP_MAGIC)) == 0)
+    return GZIP_COMPRESSION;
+
+  if (length >= strlen(ZSTD_MAGIC) && memcmp(data, ZSTD_MAGIC, strlen(ZSTD_MAGIC)) == 0)
+    return ZSTD_COMPRESSION;
+
+  return NO_COMPRESSION;
+}
+
+/**
+ * Read the next bytes of a file, unless the stream is closed first. A pipe whose
+ * writer is idle can block a read for ever, so the file is polled along with the
+ * wake pipe of the stream.
+ *
+ * @param stream The stream.
+ * @param buffer The buffer the bytes are read into.
+ * @param capacity The size of the buffer.
+ * @return ssize_t How many bytes were read, 0 at the end of the file or once the
+ * stream is closed, -1 on error.
+ */
+static ssize_t readFile(InputStream *stream, char *buffer, size_t capacity)
+{
+  struct pollfd files[] = {{stream->fd, POLLIN, 0}, {stream->wakeFds[0], POLLIN, 0}};
+
+  while (true)
+  {
+    if (poll(files, 2, -1) < 0)
+    {
+      if (errno == EINTR)
+        continue;
+      return -1;
+    }
+
+    if (files[1].revents)
+    {
+      stream->isStopped = true;
+      return 0;
+    }
+
+    ssize_t length = read(stream->fd, buffer, capacity);
+
+    if (length >= 0 || errno != EINTR)
+      return length;
+  }
+}
+
+/**
+ * Read the next compressed bytes of a file, once the previous ones are used.
+ *
+ * @param stream The stream.
+ * @return bool Whether bytes were read, false at the end of the file or on error.
+ */
+static bool readInput(InputStream *stream)
+{
+  ssize_t length = readFile(stream, stream->input, STREAM_INPUT_SIZE);
+
+  if (length <= 0)
+  {
+    // The file must not end in the middle of a member or frame
+    stream->isInputEnded = true;
+    stream->hasInputError |= length < 0 || (!stream->isFrameEnded && !stream->isStopped);
+    return false;
+  }
+
+  stream->inputLength = length;
+  stream->inputPosition = 0;
+  return true;
+}
+
+/**
+ * Decompress the next bytes of a gzip file. Files made of several members, as
+ * written by concatenating gzip files, are decompressed one member after the other.
+ *
+ * @param stream The stream.
+ * @param output The buffer the bytes are decompressed into.
+ * @param capacity The size of the buffer.
+ * @return size_t How many bytes were decompressed, less than the capacity only at
+ * the end of the file or on error.
+ */
+static size_t inflateInput(InputStream *stream, char *output, size_t capacity)
+{
+  z_stream *inflater = (z_stream *)stream->decompressor;
+  inflater->next_out = (Bytef *)output;
+  inflater->avail_out = capacity;
+
+  while (inflater->avail_out)
+  {
+    if (stream->isFrameEnded)
+    {
+      if (stream->inputPosition == stream->inputLength && !readInput(stream))
+        break;
+
+      inflateReset(inflater);
+      stream->isFrameEnded = false;
+    }
+
+    inflater->next_in = (Bytef *)&stream->input[stream->inputPosition];
+    inflater->avail_in = stream->inputLength - stream->inputPosition;
+
+    // Output left from the previous call is flushed before reading more input
+    uInt outputLeft = inflater->avail_out;
+    int status = inflate(inflater, Z_NO_FLUSH);
+    stream->inputPosition = stream->inputLength - inflater->avail_in;
+
+    if (status == Z_STREAM_END)
+      stream->isFrameEnded = true;
+    else if (status != Z_OK && status != Z_BUF_ERROR)
+    {
+      stream->hasInputError = true;
+      break;
+    }
+    else if (inflater->avail_out == outputLeft &&
+             stream->inputPosition == stream->inputLength &&
+             !readInput(stream))
+      break;
+  }
+
+  return capacity - inflater->avail_out;
+}
+
+#ifdef LIBCSV_ZSTD
+/**
+ * Decompress the next bytes of a zstd file, whose frames follow each other.
+ *
+ * @param stream The stream.
+ * @param output The buffer the bytes are decompressed into.
+ * @param capacity The size of the buffer.
+ * @return size_t How many bytes were decompressed, less than the capacity only at
+ * the end of the file or on error.
+ */
+static size_t decompressZstdInput(InputStream *stream, char *output, size_t capacity)
+{
+  ZSTD_outBuffer outputBuffer = {output, capacity, 0};
+
+  while (outputBuffer.pos < outputBuffer.size)
+  {
+    ZSTD_inBuffer inputBuffer = {stream->input, stream->inputLength, stream->inputPosition};
+    size_t inputStart = inputBuffer.pos, outputStart = outputBuffer.pos;
+    size_t status = ZSTD_decompressStream(
+        (ZSTD_DStream *)stream->decompressor,
+        &outputBuffer,
+        &inputBuffer);
+    stream->inputPosition = inputBuffer.pos;
+
+    if (ZSTD_isError(status))
+    {
+      stream->hasInputError = true;
+      break;
+    }
+
+    // Calls without any input after a frame do not start the next one
+    if (status == 0 || inputBuffer.pos > inputStart || outputBuffer.pos > outputStart)
+      stream->isFrameEnded = status == 0;
+
+    // Output left from the previous call is flushed before reading more input
+    if (outputBuffer.pos == outputStart &&
+        stream->inputPosition == stream->inputLength &&
+        !readInput(stream))
+      break;
+  }
+
+  return outputBuffer.pos;
+}
+#endif
+
+/**
+ * Read the next bytes of an uncompressed file. Pipes hand over what was written to
+ * them so far, so that rows are not held back until a buffer is full.
+ *
+ * @param stream The stream.
+ * @param output The buffer the bytes are read into.
+ * @param capacity The size of the buffer.
+ * @return size_t How many bytes were read, 0 at the end of the file or on error.
+ */
+static size_t readPlainInput(InputStream *stream, char *output, size_t capacity)
+{
+  ssize_t length = readFile(stream, output, capacity);
+
+  if (length <= 0)
+  {
+    stream->isInputEnded = true;
+    stream->hasInputError |= length < 0;
+    return 0;
+  }
+
+  return length;
+}
+
+/**
+ * Read and decompress a file into the free buffers of its ring, until it ends or
+ * the stream is closed.
+ *
+ * @param arg The stream.
+ * @return void* NULL.
+ */
+static void *fillBuffers(void *arg)
+{
+  InputStream *stream = (InputStream *)arg;
+  bool isEnded = false;
+
+  while (!isEnded)
+  {
+    pthread_mutex_lock(&stream->lock);
+    while (stream->filledBuffers == STREAM_BUFFER_COUNT && !stream->isClosed)
+      pthread_cond_wait(&stream->bufferRead, &stream->lock);
+
+    StreamBuffer *buffer = &stream->buffers[(stream->readBuffer + stream->filledBuffers) %
+                                            STREAM_BUFFER_COUNT];
+    bool isClosed = stream->isClosed;
+    pthread_mutex_unlock(&stream->lock);
+
+    if (isClosed)
+      break;
+
+    size_t length;
+    if (stream->compression == NO_COMPRESSION)
+      length = readPlainInput(stream, buffer->data, STREAM_BUFFER_SIZE);
+#ifdef LIBCSV_ZSTD
+    else if (stream->compression == ZSTD_COMPRESSION)
+      length = decompressZstdInput(stream, buffer->data, STREAM_BUFFER_SIZE);
+#endif
+    else
+      length = inflateInput(stream, buffer->data, STREAM_BUFFER_SIZE);
+
+    isEnded = stream->isInputEnded || stream->hasInputError;
+
+    pthread_mutex_lock(&stream->lock);
+    buffer->length = length;
+    if (length)
+      stream->filledBuffers++;
+    stream->isEnded = isEnded;
+    stream->hasError = stream->hasInputError;
+    pthread_cond_signal(&stream->bufferFilled);
+    pthread_mutex_unlock(&stream->lock);
+  }
+
+  return NULL;
+}
+
+/**
+ * Take the next filled buffer of the ring, waiting for it to be filled.
+ *
+ * @param stream The stream.
+ * @return StreamBuffer* The buffer, or NULL at the end of the file.
+ */
+static StreamBuffer *acquireBuffer(InputStream *stream)
+{
+  StreamBuffer *buffer = NULL;
+
+  pthread_mutex_lock(&stream->lock);
+  while (stream->filledBuffers == stream->acquiredBuffers && !stream->isEnded)
+    pthread_cond_wait(&stream->bufferFilled, &stream->lock);
+
+  if (stream->filledBuffers > stream->acquiredBuffers)
+    buffer = &stream->buffers[(stream->readBuffer + stream->acquiredBuffers++) %
+                              STREAM_BUFFER_COUNT];
+  pthread_mutex_unlock(&stream->lock);
+
+  return buffer;
+}
+
+/**
+ * Hand the first acquired buffer back to the reading thread.
+ *
+ * @param stream The stream.
+ */
+static void releaseBuffer(InputStream *stream)
+{
+  pthread_mutex_lock(&stream->lock);
+  stream->readBuffer = (stream->readBuffer + 1) % STREAM_BUFFER_COUNT;
+  stream->filledBuffers--;
+  stream->acquiredBuffers--;
+  pthread_cond_signal(&stream->bufferRead);
+  pthread_mutex_unlock(&stream->lock);
+}
+
+/**
+ * Append bytes to the carry buffer of a stream, growing it as needed.
+ *
+ * @param stream The stream.
+ * @param data The bytes.
+ * @param length How many bytes there are.
+ */
+static void appendCarry(InputStream *stream, const char *data, size_t length)
+{
+  if (stream->carryLength + length > stream->carryCapacity)
+  {
+    stream->carryCapacity = (stream->carryLength + length) * 2;
+    stream->carry = (char *)realloc(stream->carry, stream->carryCapacity);
+  }
+
+  memcpy(&stream->carry[stream->carryLength], data, length);
+  stream->carryLength += length;
+}
+
+/**
+ * Find the end of the last complete row of a buffer, skipping line separators in
+ * quoted fields.
+ *
+ * @param data Pointer to the first row.
+ * @param length The length of the buffer.
+ * @param minRows The fewest complete rows to find.
+ * @return size_t Offset after the line separator of the last complete row, or 0
+ * if there are fewer than minRows complete rows.
+ */
+static size_t findRowsEnd(const char *data, size_t length, size_t minRows)
+{
+  size_t quotes = 0, rowCount = 0, offset = 0, end = 0;
+  bool isLastRowChecked = false;
+
+  while (offset < length)
+  {
+    // Once there are enough rows, the last line separator usually ends a row
+    if (rowCount >= minRows && !isLastRowChecked)
+    {
+      const char *lastRowEnd = memrchr(&data[offset], *LINE_SEPARATOR, length - offset);
+
+      if (lastRowEnd == NULL)
+        break;
+
+      size_t last = lastRowEnd - data;
+      if ((quotes + countQuotes(&data[offset], last - offset)) % 2 == 0)
+        return last + 1;
+
+      isLastRowChecked = true;
+    }
+
+    const char *rowEnd = memchr(&data[offset], *LINE_SEPARATOR, length - offset);
+
+    if (rowEnd == NULL)
+      break;
+
+    size_t next = rowEnd - data;
+    quotes += countQuotes(&data[offset], next - offset);
+    offset = next + 1;
+
+    if (quotes % 2 == 0)
+    {
+      end = offset;
+      rowCount++;
+    }
+  }
+
+  return rowCount >= minRows ? end : 0;
+}
+
+size_t readStreamRows(InputStream *stream, size_t minRows, const char **rows)
+{
+  while (true)
+  {
+    // The rows returned last, which the carried tail followed, are not used anymore
+    if (stream->isTailCarried)
+    {
+      memmove(stream->carry, stream->tail, stream->tailLength);
+      stream->tail = stream->carry;
+      stream->carryLength = stream->tailLength;
+    }
+
+    StreamBuffer *buffer = acquireBuffer(stream);
+
+    if (buffer == NULL)
+    {
+      // The last row may end without a line separator
+      size_t length = stream->tailLength;
+      *rows = stream->tail;
+      stream->tailLength = 0;
+      return length;
+    }
+
+    char *start;
+    size_t length;
+
+    if (stream->tailLength <= STREAM_BUFFER_HEADROOM)
+    {
+      start = buffer->data - stream->tailLength;
+      length = stream->tailLength + buffer->length;
+      if (stream->tailLength)
+        memcpy(start, stream->tail, stream->tailLength);
+
+      // Only the new buffer is still used
+      while (stream->acquiredBuffers > 1)
+        releaseBuffer(stream);
+      stream->isTailCarried = false;
+    }
+    else
+    {
+      if (!stream->isTailCarried)
+      {
+        stream->carryLength = 0;
+        appendCarry(stream, stream->tail, stream->tailLength);
+      }
+
+      appendCarry(stream, buffer->data, buffer->length);
+      while (stream->acquiredBuffers)
+        releaseBuffer(stream);
+
+      start = stream->carry;
+      length = stream->carryLength;
+      stream->isTailCarried = true;
+    }
+
+    size_t end = findRowsEnd(start, length, minRows);
+    stream->tail = &start[end];
+    stream->tailLength = length - end;
+
+    if (end)
+    {
+      *rows = start;
+      return end;
+    }
+  }
+}
+
+/**
+ * Free the decompressor of a stream.
+ *
+ * @param stream The stream.
+ */
+static void freeDecompressor(InputStream *stream)
+{
+  if (stream->decompressor == NULL)
+    return;
+
+#ifdef LIBCSV_ZSTD
+  if (stream->compression == ZSTD_COMPRESSION)
+  {
+    ZSTD_freeDStream((ZSTD_DStream *)stream->decompressor);
+    return;
+  }
+#endif
+
+  inflateEnd((z_stream *)stream->decompressor);
+  free(stream->decompressor);
+}
+
+/**
+ * Free a stream, but not its file descriptor.
+ *
+ * @param stream The stream, whose reading thread is not running.
+ */
+static void freeStream(InputStream *stream)
+{
+  freeDecompressor(stream);
+  for (size_t i = 0; i < STREAM_BUFFER_COUNT; i++)
+    free(stream->buffers[i].data - STREAM_BUFFER_HEADROOM);
+
+  free(stream->input);
+  free(stream->carry);
+  if (stream->wakeFds[0] >= 0)
+  {
+    close(stream->wakeFds[0]);
+    close(stream->wakeFds[1]);
+  }
+  pthread_mutex_destroy(&stream->lock);
+  pthread_cond_destroy(&stream->bufferFilled);
+  pthread_cond_destroy(&stream->bufferRead);
+  free(stream);
+}
+
+bool closeInputStream(InputStream *stream)
+{
+  pthread_mutex_lock(&stream->lock);
+  stream->isClosed = true;
+  pthread_cond_signal(&stream->bufferRead);
+  pthread_mutex_unlock(&stream->lock);
+
+  // The reading thread may be waiting for a pipe, which is not signaled
+  while (write(stream->wakeFds[1], "", 1) < 0 && errno == EINTR)
+    ;
+  pthread_join(stream->thread, NULL);
+
+  bool hasError = stream->hasError;
+  if (hasError)
+    fprintf(stderr, "Could not read the file\n");
+
+  close(stream->fd);
+  freeStream(stream);
+  return !hasError;
+}
+
+/**
+ * Create the decompressor of a compression.
+ *
+ * @param compression The compression.
+ * @param decompressor Will be set to the decompressor, NULL for uncompressed files.
+ * @return bool Whether the compression is supported.
+ */
+static bool createDecompressor(enum compression compression, void **decompressor)
+{
+  *decompressor = NULL;
+
+  if (compression == GZIP_COMPRESSION)
+  {
+    z_stream *inflater = (z_stream *)calloc(1, sizeof(z_stream));
+
+    if (inflateInit2(inflater, GZIP_WINDOW_BITS) == Z_OK)
+      *decompressor = inflater;
+    else
+      free(inflater);
+  }
+#ifdef LIBCSV_ZSTD
+  else if (compression == ZSTD_COMPRESSION)
+    *decompressor = ZSTD_createDStream();
+#endif
+
+  return compression == NO_COMPRESSION || *decompressor != NULL;
+}
+
+InputStream *openInputStream(int fd, enum compression compression)
+{
+  void *decompressor;
+  int wakeFds[2];
+
+  if (!createDecompressor(compression, &decompressor))
+  {
+    fprintf(stderr, "Compression not supported by this build\n");
+    return NULL;
+  }
+
+  InputStream *stream = (InputStream *)calloc(1, sizeof(InputStream));
+  stream->fd = fd;
+  stream->compression = compression;
+  stream->decompressor = decompressor;
+  stream->input = (char *)malloc(STREAM_INPUT_SIZE);
+  // Reading starts like right after a complete member or frame
+  stream->isFrameEnded = compression == GZIP_COMPRESSION;
+
+  for (size_t i = 0; i < STREAM_BUFFER_COUNT; i++)
+    stream->buffers[i].data = (char *)malloc(STREAM_BUFFER_HEADROOM + STREAM_BUFFER_SIZE) +
+                              STREAM_BUFFER_HEADROOM;
+  // Rows read from an empty file still point somewhere
+  stream->tail = stream->buffers[0].data;
+
+  pthread_mutex_init(&stream->lock, NULL);
+  pthread_cond_init(&stream->bufferFilled, NULL);
+  pthread_cond_init(&stream->bufferRead, NULL);
+
+  bool hasWakePipe = pipe(wakeFds) == 0;
+  stream->wakeFds[0] = hasWakePipe ? wakeFds[0] : -1;
+  stream->wakeFds[1] = hasWakePipe ? wakeFds[1] : -1;
+
+  if (!hasWakePipe || pthread_create(&stream->thread, NULL, fillBuffers, stream) != 0)
+  {
+    freeStream(stream);
+    return NULL;
+  }
+
+  return stream;
+}
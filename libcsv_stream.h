@@ -0,0 +1,116 @@
+#ifndef LIBCSV_STREAM_H
+#define LIBCSV_STREAM_H
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <pthread.h>
+
+#define STREAM_BUFFER_SIZE (1 << 20)
+#define STREAM_BUFFER_COUNT 4
+// Room before each buffer for the start of a row left over from the previous one
+#define STREAM_BUFFER_HEADROOM (64 << 10)
+#define STREAM_INPUT_SIZE (256 << 10)
+
+enum compression
+{
+  NO_COMPRESSION = 0,
+  GZIP_COMPRESSION = 1,
+  ZSTD_COMPRESSION = 2
+};
+
+typedef struct
+{
+  char *data;
+  size_t length;
+} StreamBuffer;
+
+/**
+ * Ring of buffers filled ahead by a thread reading, and decompressing if needed, a
+ * file, and drained in order by the thread parsing it. Buffers are only handed
+ * over under the lock, so each one is used by a single thread at a time.
+ */
+typedef struct
+{
+  int fd;
+  enum compression compression;
+  void *decompressor;
+  // Compressed bytes read from the file and not decompressed yet
+  char *input;
+  size_t inputLength;
+  size_t inputPosition;
+  // Whether the last gzip member or zstd frame was complete
+  bool isFrameEnded;
+  // Only used by the reading thread until they are published
+  bool isInputEnded;
+  bool hasInputError;
+  // Whether reading was stopped by closing the stream before the end of the file
+  bool isStopped;
+  // Pipe written to when the stream is closed, to wake a read waiting for input
+  int wakeFds[2];
+  StreamBuffer buffers[STREAM_BUFFER_COUNT];
+  // First buffer left to be parsed, how many buffers are filled from it on, and
+  // how many of those the parsing thread is using
+  size_t readBuffer;
+  size_t filledBuffers;
+  size_t acquiredBuffers;
+  bool isEnded;
+  bool hasError;
+  bool isClosed;
+  // Start of a row left incomplete at the end of the last rows, in the last
+  // acquired buffer, or in the carry buffer when longer than the headroom
+  const char *tail;
+  size_t tailLength;
+  bool isTailCarried;
+  char *carry;
+  size_t carryLength;
+  size_t carryCapacity;
+  pthread_t thread;
+  pthread_mutex_t lock;
+  pthread_cond_t bufferFilled;
+  pthread_cond_t bufferRead;
+} InputStream;
+
+/**
+ * Detect the compression of a file from its magic bytes.
+ *
+ * @param data The start of the file.
+ * @param length How many bytes of the file there are.
+ * @return enum compression The compression of the file, NO_COMPRESSION for text.
+ */
+enum compression detectCompression(const char *data, size_t length);
+
+/**
+ * Open a stream over a file, with a thread reading and decompressing it into a
+ * ring of STREAM_BUFFER_COUNT buffers ahead of the parsing.
+ *
+ * @param fd The file descriptor of the file, positioned at its start. It is closed
+ * along with the stream.
+ * @param compression The compression of the file.
+ * @return InputStream* The opened stream, or NULL if the compression is not
+ * supported by this build. The file descriptor is left open on failure.
+ */
+InputStream *openInputStream(int fd, enum compression compression);
+
+/**
+ * Read the next complete rows of a stream. Rows are returned in place in the
+ * buffers of the ring. Only the start of a row which spans two buffers is copied,
+ * in front of the next buffer, unless it is longer than STREAM_BUFFER_HEADROOM.
+ *
+ * @param stream The stream.
+ * @param minRows The fewest rows to return before the end of the file.
+ * @param rows Will be set to the first row, valid until the next read.
+ * @return size_t The length of the rows, ending with a line separator but at the
+ * end of the file, 0 when there are no rows left.
+ */
+size_t readStreamRows(InputStream *stream, size_t minRows, const char **rows);
+
+/**
+ * Stop the reading thread of a stream, even if the file was not read to its end,
+ * and free the stream along with its file descriptor.
+ *
+ * @param stream The stream.
+ * @return bool Whether the file could be read and decompressed.
+ */
+bool closeInputStream(InputStream *stream);
+
+#endif
@@ -0,0 +1,193 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+
+#include "libcsv.h"
+
+#define STRESS_ROWS 2000
+#define STRESS_RUNS_PER_CALLER 400
+#define STRESS_MAX_CALLERS 64
+#define STRESS_SELECTED_COLUMNS "id,name,price"
+#define STRESS_ROW_FILTERS "price:int>500\nday:date<2026-07-01\nname!=name7"
+
+typedef struct
+{
+  uint64_t hash;
+  size_t length;
+} OutputDigest;
+
+typedef struct
+{
+  const char *csv;
+  size_t runs;
+  OutputDigest expected;
+  bool isValid;
+} StressCaller;
+
+/**
+ * Sink callback folding the output into a FNV-1a hash.
+ */
+static bool digestOutput(const char data[], size_t length, void *context)
+{
+  OutputDigest *digest = (OutputDigest *)context;
+
+  for (size_t i = 0; i < length; i++)
+    digest->hash = (digest->hash ^ (unsigned char)data[i]) * 1099511628211ULL;
+
+  digest->length += length;
+  return true;
+}
+
+/**
+ * Process a CSV once, compiling the query from its text like a server handling an
+ * independent request would.
+ *
+ * @param csv The CSV data to be processed.
+ * @return OutputDigest The digest of the result.
+ */
+static OutputDigest processOnce(const char csv[])
+{
+  OutputDigest digest = {14695981039346656037ULL, 0};
+  CsvSink *sink = createCallbackSink(digestOutput, &digest);
+
+  processCsvToSink(csv, STRESS_SELECTED_COLUMNS, STRESS_ROW_FILTERS, sink);
+
+  freeSink(sink);
+  return digest;
+}
+
+/**
+ * Generate a deterministic CSV with a mix of text, integer and date columns.
+ *
+ * @return char* The generated CSV, which must be freed by the caller.
+ */
+static char *generateCsv()
+{
+  size_t capacity = 128 + STRESS_ROWS * 96;
+  char *csv = (char *)malloc(capacity);
+  size_t length = sprintf(csv, "id,name,price,day,comment\n");
+  uint64_t state = 42;
+
+  for (size_t i = 0; i < STRESS_ROWS; i++)
+  {
+    state = state * 6364136223846793005ULL + 1442695040888963407ULL;
+    unsigned value = (unsigned)(state >> 33);
+
+    length += sprintf(
+        &csv[length],
+        "%zu,name%u,%u,2026-%02u-%02u,comment %u\n",
+        i,
+        value % 10,
+        value % 1000,
+        value % 12 + 1,
+        value % 28 + 1,
+        value);
+  }
+
+  return csv;
+}
+
+/**
+ * Worker thread processing the same CSV many times and checking every result.
+ *
+ * @param arg Pointer to the StressCaller of the thread.
+ * @return void* Always NULL.
+ */
+static void *runCaller(void *arg)
+{
+  StressCaller *caller = (StressCaller *)arg;
+
+  for (size_t i = 0; i < caller->runs; i++)
+  {
+    OutputDigest digest = processOnce(caller->csv);
+
+    if (digest.hash != caller->expected.hash || digest.length != caller->expected.length)
+      caller->isValid = false;
+  }
+
+  return NULL;
+}
+
+/**
+ * Get the current time of a monotonic clock in seconds.
+ *
+ * @return double The current time.
+ */
+static double now()
+{
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return time.tv_sec + time.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+  long cpuCount = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t maxCallers = argc > 1 ? strtoul(argv[1], NULL, 10) : (size_t)(cpuCount > 0 ? cpuCount * 2 : 2);
+
+  if (maxCallers < 1 || maxCallers > STRESS_MAX_CALLERS)
+  {
+    fprintf(stderr, "usage: %s [callers, 1 to %d]\n", argv[0], STRESS_MAX_CALLERS);
+    return EXIT_FAILURE;
+  }
+
+  char *csv = generateCsv();
+  size_t csvLength = strlen(csv);
+  OutputDigest expected = processOnce(csv);
+  bool isValid = true;
+  double baseline = 0;
+
+  printf("%zu bytes, %d rows, %zu bytes of output per run, %ld online CPUs\n",
+         csvLength, STRESS_ROWS, expected.length, cpuCount);
+  printf("%8s %12s %10s %8s\n", "callers", "runs/s", "MB/s", "speedup");
+
+  for (size_t callerCount = 1; callerCount <= maxCallers; callerCount *= 2)
+  {
+    StressCaller callers[STRESS_MAX_CALLERS];
+    pthread_t threads[STRESS_MAX_CALLERS];
+
+    double start = now();
+
+    for (size_t i = 0; i < callerCount; i++)
+    {
+      callers[i].csv = csv;
+      callers[i].runs = STRESS_RUNS_PER_CALLER;
+      callers[i].expected = expected;
+      callers[i].isValid = true;
+      pthread_create(&threads[i], NULL, runCaller, &callers[i]);
+    }
+
+    for (size_t i = 0; i < callerCount; i++)
+    {
+      pthread_join(threads[i], NULL);
+      isValid = isValid && callers[i].isValid;
+    }
+
+    double elapsed = now() - start;
+    double runsPerSecond = callerCount * STRESS_RUNS_PER_CALLER / elapsed;
+
+    if (callerCount == 1)
+      baseline = runsPerSecond;
+
+    printf("%8zu %12.0f %10.1f %7.2fx\n",
+           callerCount,
+           runsPerSecond,
+           runsPerSecond * csvLength / 1e6,
+           runsPerSecond / baseline);
+  }
+
+  free(csv);
+
+  if (!isValid)
+  {
+    fprintf(stderr, "concurrent results differ from the single-threaded result\n");
+    return EXIT_FAILURE;
+  }
+
+  return EXIT_SUCCESS;
+}
@@ -1,11 +1,21 @@
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <err.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include <unistd.h>
 #include <CUnit/Basic.h>
+#include <zlib.h>
 
 #include "libcsv.h"
+#include "libcsv_columnar.h"
+#include "libcsv_scan.h"
+#include "libcsv_util.h"
 
 #define TEST_CSV "header1,header2,header3\n1,2,3\n4,5,6\n7,8,9"
+#define TEST_TYPED_CSV "id,price,day\n1,10,2026-09-30\n2,9.5,2026-10-01\n3,100,2026-10-02"
+#define TEST_CSV_FILE "test.csv"
 #define REDIRECT_FILE "test.txt"
 #define REOPEN_PATH "/dev/tty"
 
@@ -230,6 +240,1166 @@ void test_processCsv_invalid_filter(void)
   fclose(file);
 }
 
+void test_processCsv_non_first_column_selected(void)
+{
+  char buf[BUFSIZ];
+  char *expected = "header2\n2\n5\n8";
+  freopen(REDIRECT_FILE, "w+", stdout);
+  processCsv(TEST_CSV, "header2", "");
+  freopen(REOPEN_PATH, "w", stdout);
+  FILE *file = fopen(REDIRECT_FILE, "r");
+  fread(buf, sizeof(char), BUFSIZ, file);
+  CU_ASSERT(strncmp(buf, expected, strlen(expected) - 1) == 0);
+  fclose(file);
+}
+
+void test_processCsvFile_filter(void)
+{
+  char buf[BUFSIZ];
+  char *expected = "header1,header3\n4,6\n";
+  FILE *csvFile = fopen(TEST_CSV_FILE, "w");
+  fputs(TEST_CSV, csvFile);
+  fclose(csvFile);
+  freopen(REDIRECT_FILE, "w+", stdout);
+  processCsvFile(TEST_CSV_FILE, "header1,header3", "header1>1\nheader3<8");
+  freopen(REOPEN_PATH, "w", stdout);
+  FILE *file = fopen(REDIRECT_FILE, "r");
+  fread(buf, sizeof(char), BUFSIZ, file);
+  CU_ASSERT(strncmp(buf, expected, strlen(expected)) == 0);
+  fclose(file);
+}
+
+void test_processCsvFile_last_row_without_newline(void)
+{
+  char buf[BUFSIZ];
+  char *expected = "header1\n1\n4\n7\n";
+  FILE *csvFile = fopen(TEST_CSV_FILE, "w");
+  fputs(TEST_CSV, csvFile);
+  fclose(csvFile);
+  freopen(REDIRECT_FILE, "w+", stdout);
+  processCsvFile(TEST_CSV_FILE, "header1", "");
+  freopen(REOPEN_PATH, "w", stdout);
+  FILE *file = fopen(REDIRECT_FILE, "r");
+  fread(buf, sizeof(char), BUFSIZ, file);
+  CU_ASSERT(strncmp(buf, expected, strlen(expected)) == 0);
+  fclose(file);
+}
+
+void test_processCsvParallel_filter(void)
+{
+  char buf[BUFSIZ];
+  char *expected = "header1,header3\n4,6\n";
+  freopen(REDIRECT_FILE, "w+", stdout);
+  processCsvParallel(TEST_CSV, "header1,header3", "header1>1\nheader3<8", 4);
+  freopen(REOPEN_PATH, "w", stdout);
+  FILE *file = fopen(REDIRECT_FILE, "r");
+  fread(buf, sizeof(char), BUFSIZ, file);
+  CU_ASSERT(strncmp(buf, expected, strlen(expected)) == 0);
+  fclose(file);
+}
+
+void test_processCsvFileParallel_keeps_row_order(void)
+{
+  char buf[BUFSIZ];
+  char *expected = "header1\n1\n4\n7\n";
+  FILE *csvFile = fopen(TEST_CSV_FILE, "w");
+  fputs(TEST_CSV, csvFile);
+  fclose(csvFile);
+  freopen(REDIRECT_FILE, "w+", stdout);
+  processCsvFileParallel(TEST_CSV_FILE, "header1", "", 0);
+  freopen(REOPEN_PATH, "w", stdout);
+  FILE *file = fopen(REDIRECT_FILE, "r");
+  fread(buf, sizeof(char), BUFSIZ, file);
+  CU_ASSERT(strncmp(buf, expected, strlen(expected)) == 0);
+  fclose(file);
+}
+
+void test_processCsv_integer_filter(void)
+{
+  char buf[BUFSIZ];
+  char *expected = "id\n1\n3\n";
+  freopen(REDIRECT_FILE, "w+", stdout);
+  processCsv("id,price\n1,10\n2,9\n3,100", "id", "price:int>9");
+  freopen(REOPEN_PATH, "w", stdout);
+  FILE *file = fopen(REDIRECT_FILE, "r");
+  fread(buf, sizeof(char), BUFSIZ, file);
+  CU_ASSERT(strncmp(buf, expected, strlen(expected)) == 0);
+  fclose(file);
+}
+
+void test_processCsv_float_filter(void)
+{
+  char buf[BUFSIZ];
+  char *expected = "id\n1\n3\n";
+  freopen(REDIRECT_FILE, "w+", stdout);
+  processCsv(TEST_TYPED_CSV, "id", "price:float>=9.75");
+  freopen(REOPEN_PATH, "w", stdout);
+  FILE *file = fopen(REDIRECT_FILE, "r");
+  fread(buf, sizeof(char), BUFSIZ, file);
+  CU_ASSERT(strncmp(buf, expected, strlen(expected)) == 0);
+  fclose(file);
+}
+
+void test_processCsv_date_filter(void)
+{
+  char buf[BUFSIZ];
+  char *expected = "id\n2\n3\n";
+  freopen(REDIRECT_FILE, "w+", stdout);
+  processCsv(TEST_TYPED_CSV, "id", "day:date>=2026-10-01");
+  freopen(REOPEN_PATH, "w", stdout);
+  FILE *file = fopen(REDIRECT_FILE, "r");
+  fread(buf, sizeof(char), BUFSIZ, file);
+  CU_ASSERT(strncmp(buf, expected, strlen(expected)) == 0);
+  fclose(file);
+}
+
+void test_runCsvQuery_int64_limits(void)
+{
+  char buf[BUFSIZ];
+  const char csv[] = "id,v\n1,9223372036854775807\n2,5\n3,-9223372036854775808\n"
+                     "4,9223372036854775808\n";
+  char *expected = "id\n1\nid\n3\nid,v\n1,9223372036854775807\n2,5\n"
+                   "3,-9223372036854775808\n4,9223372036854775808\n";
+
+  // 19-digit integers are parsed, unless they overflow a long long
+  CsvQuery *query = createCsvQuery("id", "v:int>10");
+  CsvSink *sink = createMemorySink(buf, BUFSIZ);
+  CU_ASSERT(runCsvQuery(query, csv, sink));
+  freeCsvQuery(query);
+
+  query = createCsvQuery("id", "v:int=-9223372036854775808");
+  CU_ASSERT(runCsvQuery(query, csv, sink));
+  freeCsvQuery(query);
+
+  // Invalid cells come last
+  query = createCsvQuery("", "");
+  CU_ASSERT(setCsvQueryOrder(query, "v:int desc"));
+  CU_ASSERT(runCsvQuery(query, csv, sink));
+  freeCsvQuery(query);
+
+  CU_ASSERT(getSinkLength(sink) == strlen(expected));
+  CU_ASSERT(strncmp(buf, expected, strlen(expected)) == 0);
+  freeSink(sink);
+
+  freopen(REDIRECT_FILE, "w+", stderr);
+  CU_ASSERT(createCsvQuery("id", "v:int<9223372036854775808") == NULL);
+  CU_ASSERT(createCsvQuery("id", "v:int>-9223372036854775809") == NULL);
+  freopen(REOPEN_PATH, "w", stderr);
+}
+
+void test_runCsvQuery_long_float_and_impossible_dates(void)
+{
+  char buf[BUFSIZ];
+  char csv[256] = "id,price,day\n1,";
+  char *expected = "id\n1\n";
+
+  // Floats too long for the stack copy given to strtod are still parsed
+  for (int i = 0; i < 80; i++)
+    strcat(csv, i ? "0" : "1");
+  strcat(csv, ".5,2024-02-29\n2,1.5,2026-02-29\n3,2.5,2026-04-31\n");
+
+  CsvQuery *query = createCsvQuery("id", "price:float>2\nday:date>=2024-01-01");
+  CsvSink *sink = createMemorySink(buf, BUFSIZ);
+  CU_ASSERT(runCsvQuery(query, csv, sink));
+  CU_ASSERT(getSinkLength(sink) == strlen(expected));
+  CU_ASSERT(strncmp(buf, expected, strlen(expected)) == 0);
+  freeSink(sink);
+  freeCsvQuery(query);
+
+  freopen(REDIRECT_FILE, "w+", stderr);
+  CU_ASSERT(createCsvQuery("id", "day:date>=2026-02-31") == NULL);
+  CU_ASSERT(createCsvQuery("id", "day:date>=2100-02-29") == NULL);
+  freopen(REOPEN_PATH, "w", stderr);
+}
+
+void test_processCsvFile_inferred_type_filter(void)
+{
+  char buf[BUFSIZ];
+  char *expected = "id\n1\n3\n";
+  FILE *csvFile = fopen(TEST_CSV_FILE, "w");
+  fputs(TEST_TYPED_CSV, csvFile);
+  fclose(csvFile);
+  freopen(REDIRECT_FILE, "w+", stdout);
+  processCsvFile(TEST_CSV_FILE, "id", "price:auto>9.5");
+  freopen(REOPEN_PATH, "w", stdout);
+  FILE *file = fopen(REDIRECT_FILE, "r");
+  fread(buf, sizeof(char), BUFSIZ, file);
+  CU_ASSERT(strncmp(buf, expected, strlen(expected)) == 0);
+  fclose(file);
+}
+
+void test_processCsvFile_skips_unused_columns(void)
+{
+  char buf[BUFSIZ];
+  char *expected = "b\n2\n5\n";
+  FILE *csvFile = fopen(TEST_CSV_FILE, "w");
+  fputs("a,b,c\n1,2,3,", csvFile);
+  for (int i = 0; i < 100; i++)
+    fputs("filler,", csvFile);
+  fputs("\n4,5,6\n7,8", csvFile);
+  fclose(csvFile);
+  freopen(REDIRECT_FILE, "w+", stdout);
+  processCsvFile(TEST_CSV_FILE, "b", "a<7");
+  freopen(REOPEN_PATH, "w", stdout);
+  FILE *file = fopen(REDIRECT_FILE, "r");
+  fread(buf, sizeof(char), BUFSIZ, file);
+  CU_ASSERT(strncmp(buf, expected, strlen(expected)) == 0);
+  fclose(file);
+}
+
+void test_processCsvFile_crlf_and_quoted_newlines(void)
+{
+  char buf[BUFSIZ];
+  char *expected = "a,c\n1,3\n7,9\n";
+  FILE *csvFile = fopen(TEST_CSV_FILE, "w");
+  fputs("a,b,c\r\n1,\"x\r\n,y\",3\r\n4,5,6\r\n7,\"\",9\r\n", csvFile);
+  fclose(csvFile);
+  freopen(REDIRECT_FILE, "w+", stdout);
+  processCsvFile(TEST_CSV_FILE, "a,c", "c!=6");
+  freopen(REOPEN_PATH, "w", stdout);
+  FILE *file = fopen(REDIRECT_FILE, "r");
+  fread(buf, sizeof(char), BUFSIZ, file);
+  CU_ASSERT(strncmp(buf, expected, strlen(expected)) == 0);
+  fclose(file);
+}
+
+void test_processCsv_invalid_typed_value(void)
+{
+  char buf[BUFSIZ];
+  char *expected = "Invalid value for type: 'abc'";
+  freopen(REDIRECT_FILE, "w+", stderr);
+  processCsv(TEST_CSV, "", "header1:int>abc");
+  freopen(REOPEN_PATH, "w", stderr);
+  FILE *file = fopen(REDIRECT_FILE, "r");
+  fread(buf, sizeof(char), BUFSIZ, file);
+  CU_ASSERT(strncmp(buf, expected, strlen(expected) - 1) == 0);
+  fclose(file);
+}
+
+void test_processCsv_quoted_fields(void)
+{
+  char buf[BUFSIZ];
+  char *expected = "\"a,b\",c\n\"x, y\",\"say \"\"hi\"\"\"\n\"1\n2\",\"z\"\n";
+  CsvSink *sink = createMemorySink(buf, BUFSIZ);
+  processCsvToSink(
+      "\"a,b\",c\n\"x, y\",\"say \"\"hi\"\"\"\n\"1\n2\",\"z\"\nplain,alpha",
+      "",
+      "c>say",
+      sink);
+  CU_ASSERT(getSinkLength(sink) == strlen(expected));
+  CU_ASSERT(strncmp(buf, expected, strlen(expected)) == 0);
+  freeSink(sink);
+}
+
+void test_processCsvToSink_memory_sink(void)
+{
+  char buf[BUFSIZ];
+  char *expected = "header1,header3\n4,6\n";
+  CsvSink *sink = createMemorySink(buf, BUFSIZ);
+  processCsvToSink(TEST_CSV, "header1,header3", "header2=5", sink);
+  CU_ASSERT(getSinkLength(sink) == strlen(expected));
+  CU_ASSERT(strncmp(buf, expected, strlen(expected)) == 0);
+  CU_ASSERT(!hasSinkError(sink));
+  freeSink(sink);
+}
+
+void test_processCsvToSink_truncated_memory_sink(void)
+{
+  char buf[8];
+  CsvSink *sink = createMemorySink(buf, sizeof(buf));
+  processCsvToSink(TEST_CSV, "header1", "", sink);
+  CU_ASSERT(getSinkLength(sink) == sizeof(buf));
+  CU_ASSERT(strncmp(buf, "header1\n", sizeof(buf)) == 0);
+  CU_ASSERT(hasSinkError(sink));
+  freeSink(sink);
+}
+
+/**
+ * Sink callback appending the output to a NUL-terminated buffer of BUFSIZ bytes.
+ */
+static bool appendToBuffer(const char data[], size_t length, void *context)
+{
+  char *buf = (char *)context;
+  strncat(buf, data, length < BUFSIZ - strlen(buf) ? length : BUFSIZ - strlen(buf) - 1);
+  return true;
+}
+
+void test_processCsvFileToSink_callback_sink(void)
+{
+  char buf[BUFSIZ] = "";
+  char *expected = "header2\n2\n8\n";
+  FILE *csvFile = fopen(TEST_CSV_FILE, "w");
+  fputs(TEST_CSV, csvFile);
+  fclose(csvFile);
+  CsvSink *sink = createCallbackSink(appendToBuffer, buf);
+  processCsvFileToSink(TEST_CSV_FILE, "header2", "header1!=4", sink);
+  CU_ASSERT(flushSink(sink));
+  CU_ASSERT(strcmp(buf, expected) == 0);
+  freeSink(sink);
+}
+
+void test_runCsvQuery_reused_on_inputs(void)
+{
+  char buf[BUFSIZ];
+  char *expected = "header1,header3\n4,6\nheader1,header3\n10,12\n";
+  CsvQuery *query = createCsvQuery("header1,header3", "header2=5\nheader2=11");
+  CsvSink *sink = createMemorySink(buf, BUFSIZ);
+  CU_ASSERT(runCsvQuery(query, TEST_CSV, sink));
+  CU_ASSERT(runCsvQuery(query, "header1,header2,header3\n10,11,12\n13,14,15", sink));
+  CU_ASSERT(getSinkLength(sink) == strlen(expected));
+  CU_ASSERT(strncmp(buf, expected, strlen(expected)) == 0);
+  freeSink(sink);
+  freeCsvQuery(query);
+}
+
+void test_runCsvQuery_rebinds_changed_headers(void)
+{
+  char buf[BUFSIZ];
+  char *expected = "header1\n4\nheader1\n5\n";
+  CsvQuery *query = createCsvQuery("header1", "header2=5");
+  CsvSink *sink = createMemorySink(buf, BUFSIZ);
+  CU_ASSERT(runCsvQuery(query, TEST_CSV, sink));
+  CU_ASSERT(runCsvQuery(query, "header2,header1\n5,5\n6,6", sink));
+  CU_ASSERT(!runCsvQuery(query, "header1,other\n5,5", sink));
+  CU_ASSERT(getSinkLength(sink) == strlen(expected));
+  CU_ASSERT(strncmp(buf, expected, strlen(expected)) == 0);
+  freeSink(sink);
+  freeCsvQuery(query);
+}
+
+void test_runCsvQuery_exact_headers_many_columns(void)
+{
+  char buf[BUFSIZ];
+  char *expected = "c9999,id\n9999,2\n";
+  size_t capacity = 200000, length = 0;
+  char *csv = (char *)malloc(capacity);
+
+  // Headers are matched exactly, so id does not select user_id
+  length += sprintf(&csv[length], "user_id");
+  for (int i = 0; i < 10000; i++)
+    length += sprintf(&csv[length], ",c%d", i);
+  length += sprintf(&csv[length], ",id\n1");
+  for (int i = 0; i < 10000; i++)
+    length += sprintf(&csv[length], ",%d", i);
+  sprintf(&csv[length], ",2");
+
+  CsvQuery *query = createCsvQuery("id,c9999", "c5000:int=5000");
+  CsvSink *sink = createMemorySink(buf, BUFSIZ);
+  CU_ASSERT(runCsvQuery(query, csv, sink));
+  CU_ASSERT(getSinkLength(sink) == strlen(expected));
+  CU_ASSERT(strncmp(buf, expected, strlen(expected)) == 0);
+  freeCsvQuery(query);
+
+  freopen(REDIRECT_FILE, "w+", stderr);
+  query = createCsvQuery("c1", "_id=1");
+  CU_ASSERT(!runCsvQuery(query, csv, sink));
+  freeCsvQuery(query);
+  query = createCsvQuery("user", "");
+  CU_ASSERT(!runCsvQuery(query, csv, sink));
+  freopen(REOPEN_PATH, "w", stderr);
+
+  freeSink(sink);
+  freeCsvQuery(query);
+  free(csv);
+}
+
+void test_runCsvQuery_duplicate_headers(void)
+{
+  char buf[BUFSIZ];
+  const char csv[] = "id,name,id\n1,a,2\n2,b,1\n";
+  char *expected = "id,name\n2,b\n";
+
+  // A header naming several columns refers to the first of them
+  CsvQuery *query = createCsvQuery("id,name", "id=2");
+  CsvSink *sink = createMemorySink(buf, BUFSIZ);
+  CU_ASSERT(runCsvQuery(query, csv, sink));
+  CU_ASSERT(getSinkLength(sink) == strlen(expected));
+  CU_ASSERT(strncmp(buf, expected, strlen(expected)) == 0);
+
+  freeSink(sink);
+  freeCsvQuery(query);
+}
+
+void test_runCsvQuery_quoted_header_line_separator(void)
+{
+  char buf[BUFSIZ];
+  const char csv[] = "\"head\ner1\",header2\n1,2\n3,4\n";
+  char *expected = "\"head\ner1\",header2\n3,4\n";
+  FILE *csvFile = fopen(TEST_CSV_FILE, "w");
+  fputs(csv, csvFile);
+  fclose(csvFile);
+
+  // Every input path binds the same headers
+  CsvQuery *query = createCsvQuery("", "header2>2");
+  for (int i = 0; i < 4; i++)
+  {
+    CsvSink *sink = createMemorySink(buf, BUFSIZ);
+    setCsvQueryWorkerCount(query, i == 2 ? 2 : 1);
+    if (i == 0)
+      CU_ASSERT(runCsvQuery(query, csv, sink));
+    else if (i < 3)
+      CU_ASSERT(runCsvQueryFile(query, TEST_CSV_FILE, sink));
+    else
+    {
+      CU_ASSERT(convertCsvFileToColumnar(TEST_CSV_FILE, TEST_CSV_FILE ".col"));
+      CU_ASSERT(runCsvQueryFile(query, TEST_CSV_FILE ".col", sink));
+    }
+    CU_ASSERT(getSinkLength(sink) == strlen(expected));
+    CU_ASSERT(strncmp(buf, expected, strlen(expected)) == 0);
+    freeSink(sink);
+  }
+
+  size_t fieldCount;
+  CsvReader *reader = openCsvReader(query, csv, strlen(csv));
+  CU_ASSERT_FATAL(reader != NULL);
+  const CellView *fields = nextCsvRow(reader, &fieldCount);
+  CU_ASSERT(fields != NULL && fieldCount == 2 && fields[0].value[0] == '3');
+  closeCsvReader(reader);
+
+  remove(TEST_CSV_FILE ".col");
+  freeCsvQuery(query);
+}
+
+void test_createCsvQuery_invalid_filter(void)
+{
+  CU_ASSERT(createCsvQuery("header1", "header2") == NULL);
+}
+
+/**
+ * Thread processing TEST_CSV into the memory buffer given as argument.
+ */
+static void *processIntoBuffer(void *arg)
+{
+  char *buf = (char *)arg;
+
+  for (int i = 0; i < 100; i++)
+  {
+    CsvSink *sink = createMemorySink(buf, BUFSIZ);
+    processCsvToSink(TEST_CSV, "header1,header3", "header1>1\nheader3<8", sink);
+    buf[getSinkLength(sink)] = '\0';
+    freeSink(sink);
+  }
+
+  return NULL;
+}
+
+void test_processCsvToSink_concurrent_calls(void)
+{
+  char bufs[4][BUFSIZ + 1];
+  pthread_t threads[4];
+
+  for (int i = 0; i < 4; i++)
+    pthread_create(&threads[i], NULL, processIntoBuffer, bufs[i]);
+
+  for (int i = 0; i < 4; i++)
+  {
+    pthread_join(threads[i], NULL);
+    CU_ASSERT(strcmp(bufs[i], "header1,header3\n4,6\n") == 0);
+  }
+}
+
+void test_runCsvQuery_counts_stats(void)
+{
+  char buf[BUFSIZ];
+  CsvStats stats = {0};
+  CsvQuery *query = createCsvQuery("header1,header3", "header1>1\nheader3<9");
+  CsvSink *sink = createMemorySink(buf, BUFSIZ);
+  setCsvQueryStats(query, &stats);
+
+  CU_ASSERT(runCsvQuery(query, TEST_CSV, sink));
+  setCsvQueryWorkerCount(query, 2);
+  CU_ASSERT(runCsvQuery(query, TEST_CSV, sink));
+
+  CU_ASSERT(stats.bytesRead == 2 * strlen(TEST_CSV));
+  CU_ASSERT(stats.bytesWritten == getSinkLength(sink));
+  CU_ASSERT(stats.rowsScanned == 6);
+  CU_ASSERT(stats.rowsPassed == 2);
+  CU_ASSERT(stats.rowsRejected[0] == 2);
+  CU_ASSERT(stats.rowsRejected[1] == 2);
+  // Only the stored rows of the first run are copied, the parallel run prints views
+  CU_ASSERT(stats.cellsCopied == 2);
+  CU_ASSERT(stats.wallNanoseconds > 0);
+  CU_ASSERT(stats.rowsRejectedPastMaxFilters == 0);
+
+  // Ordered rows copy their selected cells into the sorter
+  CsvStats orderStats = {0};
+  setCsvQueryStats(query, &orderStats);
+  CU_ASSERT(setCsvQueryOrder(query, "header3"));
+  CU_ASSERT(runCsvQuery(query, TEST_CSV, sink));
+  CU_ASSERT(orderStats.rowsPassed == 1);
+  CU_ASSERT(orderStats.cellsCopied == 2);
+  freeCsvQuery(query);
+
+  // Columns first filtered past the per-filter counters share one counter
+  char filters[BUFSIZ] = "";
+  for (int i = 0; i < CSV_STATS_MAX_FILTERS; i++)
+    strcat(filters, "header1!=0\n");
+  strcat(filters, "header3<9");
+  CsvStats overflowStats = {0};
+  query = createCsvQuery("header1", filters);
+  setCsvQueryStats(query, &overflowStats);
+  CU_ASSERT(runCsvQuery(query, TEST_CSV, sink));
+  CU_ASSERT(overflowStats.rowsPassed == 2);
+  CU_ASSERT(overflowStats.rowsRejectedPastMaxFilters == 1);
+  freeSink(sink);
+  freeCsvQuery(query);
+}
+
+void test_runCsvQuery_order_by_columns(void)
+{
+  char buf[BUFSIZ];
+  char *expected = "id,price\n4,30\n2,9\n1,9\n3,x\n";
+  CsvQuery *query = createCsvQuery("id,price", "");
+  CsvSink *sink = createMemorySink(buf, BUFSIZ);
+  CU_ASSERT(setCsvQueryOrder(query, "price:int desc,id desc"));
+  CU_ASSERT(runCsvQuery(query, "id,price\n1,9\n2,9\n3,x\n4,30", sink));
+  CU_ASSERT(getSinkLength(sink) == strlen(expected));
+  CU_ASSERT(strncmp(buf, expected, strlen(expected)) == 0);
+  CU_ASSERT(!setCsvQueryOrder(query, "price:auto"));
+  freeSink(sink);
+  freeCsvQuery(query);
+}
+
+void test_runCsvQueryFile_order_spills_with_limit(void)
+{
+  char buf[BUFSIZ];
+  char *expected = "v\n999\n998\n997\n";
+  FILE *csvFile = fopen(TEST_CSV_FILE, "w");
+  fputs("k,v\n", csvFile);
+  for (int i = 0; i < 1000; i++)
+    fprintf(csvFile, "%d,%d\n", i * 7919 % 1000, i * 7919 % 1000);
+  fclose(csvFile);
+
+  CsvQuery *query = createCsvQuery("v", "");
+  CsvSink *sink = createMemorySink(buf, BUFSIZ);
+  CU_ASSERT(setCsvQueryOrder(query, "k:int desc"));
+  setCsvQuerySortMemory(query, 1024);
+
+  // Sorted runs are spilled and merged, with or without a bounded heap first
+  setCsvQueryLimit(query, 3);
+  CU_ASSERT(runCsvQueryFile(query, TEST_CSV_FILE, sink));
+  setCsvQueryLimit(query, 0);
+  CU_ASSERT(runCsvQueryFile(query, TEST_CSV_FILE, sink));
+  CU_ASSERT(strncmp(buf, expected, strlen(expected)) == 0);
+  CU_ASSERT(strncmp(&buf[strlen(expected)], expected, strlen(expected)) == 0);
+  // The header, then 2890 digits and 1000 line separators for the values 0 to 999
+  CU_ASSERT(getSinkLength(sink) == strlen(expected) + 2 + 3890);
+  CU_ASSERT(strncmp(&buf[getSinkLength(sink) - 5], "\n1\n0\n", 5) == 0);
+  freeSink(sink);
+  freeCsvQuery(query);
+}
+
+void test_runCsvQuery_limit_offset(void)
+{
+  char buf[BUFSIZ];
+  char *expected = "header1\n4\nheader1\n4\nheader1\n4\nheader1\n1\n";
+  size_t fieldCount;
+  CsvQuery *query = createCsvQuery("header1", "");
+  CsvSink *sink = createMemorySink(buf, BUFSIZ);
+  setCsvQueryOffset(query, 1);
+  setCsvQueryLimit(query, 1);
+
+  // Stored, parallel and ordered runs skip and limit the same rows
+  CU_ASSERT(runCsvQuery(query, TEST_CSV, sink));
+  setCsvQueryWorkerCount(query, 2);
+  CU_ASSERT(runCsvQuery(query, TEST_CSV, sink));
+  CU_ASSERT(setCsvQueryOrder(query, "header1:int"));
+  CU_ASSERT(runCsvQuery(query, TEST_CSV, sink));
+  CU_ASSERT(setCsvQueryOrder(query, "header1:int desc"));
+  setCsvQueryOffset(query, 2);
+  setCsvQueryLimit(query, 0);
+  CU_ASSERT(runCsvQuery(query, TEST_CSV, sink));
+  CU_ASSERT(getSinkLength(sink) == strlen(expected));
+  CU_ASSERT(strncmp(buf, expected, strlen(expected)) == 0);
+  CU_ASSERT(setCsvQueryOrder(query, ""));
+
+  CsvReader *reader = openCsvReader(query, TEST_CSV, strlen(TEST_CSV));
+  CU_ASSERT_FATAL(reader != NULL);
+  const CellView *fields = nextCsvRow(reader, &fieldCount);
+  CU_ASSERT_FATAL(fields != NULL);
+  CU_ASSERT(fields[0].length == 1 && fields[0].value[0] == '7');
+  CU_ASSERT(nextCsvRow(reader, &fieldCount) == NULL);
+  closeCsvReader(reader);
+
+  freeSink(sink);
+  freeCsvQuery(query);
+}
+
+void test_runCsvQuery_in_filters(void)
+{
+  char buf[BUFSIZ];
+  char *csv = "id,name\n1,a\n2,b\n3,\"c,d\"\n4,e\n";
+  char *expected = "id\n1\n3\nid\n2\n4\nid\n3\n";
+  CsvQuery *query = createCsvQuery("id", "");
+  CsvSink *sink = createMemorySink(buf, BUFSIZ);
+
+  // Quoted cells are looked up by their value, and a trailing line separator is ignored
+  CU_ASSERT(addCsvQueryInFilter(query, "name", "a\r\nc,d\nz\n", false));
+  CU_ASSERT(runCsvQuery(query, csv, sink));
+  freeCsvQuery(query);
+
+  query = createCsvQuery("id", "");
+  CU_ASSERT(addCsvQueryInFilter(query, "id:int", "01\n+3\n3\n\n", true));
+  CU_ASSERT(runCsvQuery(query, csv, sink));
+  CU_ASSERT(!addCsvQueryInFilter(query, "id:int", "1\nx", false));
+  freeCsvQuery(query);
+
+  FILE *valuesFile = fopen(TEST_CSV_FILE, "w");
+  for (int i = 3; i < 30000; i += 2)
+    fprintf(valuesFile, "%d\n", i);
+  fclose(valuesFile);
+
+  query = createCsvQuery("id", "id:auto>3");
+  CU_ASSERT(addCsvQueryInFilterFile(query, "id:auto", TEST_CSV_FILE, false));
+  CU_ASSERT(!addCsvQueryInFilterFile(query, "id", "missing.txt", false));
+  setCsvQueryLimit(query, 1);
+  CU_ASSERT(runCsvQuery(query, csv, sink));
+
+  CU_ASSERT(getSinkLength(sink) == strlen(expected));
+  CU_ASSERT(strncmp(buf, expected, strlen(expected)) == 0);
+  freeSink(sink);
+  freeCsvQuery(query);
+}
+
+void test_runCsvQuery_column_comparisons(void)
+{
+  char buf[BUFSIZ];
+  char *csv = "a,b\n1,2\n3,3\n5,4\n10,9\n12\n$b,$\n";
+  char *expected = "a\n5\n10\na\n5\n12\n$b\na\n$b\na\n1\n3\n5\n10\n12\n";
+  CsvQuery *query = createCsvQuery("a", "a:int>$b");
+  CsvSink *sink = createMemorySink(buf, BUFSIZ);
+
+  // A missing cell compares as empty, which is not a valid integer
+  CU_ASSERT(runCsvQuery(query, csv, sink));
+  freeCsvQuery(query);
+
+  // Without a type, cells are compared as text
+  query = createCsvQuery("a", "a>$b");
+  CU_ASSERT(runCsvQuery(query, csv, sink));
+  freeCsvQuery(query);
+
+  // A doubled $ starts a value, and a lone $ is a value
+  query = createCsvQuery("a", "a=$$b");
+  CU_ASSERT(runCsvQuery(query, csv, sink));
+  freeCsvQuery(query);
+
+  query = createCsvQuery("a", "b!=$");
+  CU_ASSERT(runCsvQuery(query, csv, sink));
+  freeCsvQuery(query);
+
+  query = createCsvQuery("a", "a>$c");
+  freopen(REDIRECT_FILE, "w+", stderr);
+  CU_ASSERT(!runCsvQuery(query, csv, sink));
+  freopen(REOPEN_PATH, "w", stderr);
+
+  CU_ASSERT(getSinkLength(sink) == strlen(expected));
+  CU_ASSERT(strncmp(buf, expected, strlen(expected)) == 0);
+  freeSink(sink);
+  freeCsvQuery(query);
+}
+
+void test_runCsvQuery_group_by(void)
+{
+  char buf[BUFSIZ];
+  char *csv = "city,price,qty\nparis,10,2\nrome,5,x\nparis,2.5,3\noslo,,1\nrome,7,4\n";
+  char *expected =
+      "city,count,sum(price),avg(qty),min(price:float),max(price),count_distinct(qty)\n"
+      "paris,2,12.5,2.5,2.5,2.5,2\n"
+      "rome,2,12,4,5,7,2\n"
+      "oslo,1,,1,,,1\n"
+      "count\n0\n";
+  CsvQuery *query = createCsvQuery("", "");
+  CsvSink *sink = createMemorySink(buf, BUFSIZ);
+
+  CU_ASSERT(setCsvQueryGroupBy(
+      query,
+      "city",
+      "count,sum(price),avg(qty),min(price:float),max(price),count_distinct(qty)"));
+  CU_ASSERT(runCsvQuery(query, csv, sink));
+  CU_ASSERT(!setCsvQueryGroupBy(query, "city", "median(price)"));
+  freeCsvQuery(query);
+
+  // Without group columns, every row is in a single group, even with no rows
+  query = createCsvQuery("", "price>z");
+  CU_ASSERT(setCsvQueryGroupBy(query, "", "count"));
+  CU_ASSERT(runCsvQuery(query, csv, sink));
+  CU_ASSERT(setCsvQueryOrder(query, "city"));
+  freopen(REDIRECT_FILE, "w+", stderr);
+  CU_ASSERT(!runCsvQuery(query, csv, sink));
+  freopen(REOPEN_PATH, "w", stderr);
+
+  CU_ASSERT(getSinkLength(sink) == strlen(expected));
+  CU_ASSERT(strncmp(buf, expected, strlen(expected)) == 0);
+  freeSink(sink);
+  freeCsvQuery(query);
+}
+
+void test_runCsvQuery_group_by_parallel(void)
+{
+  size_t length = 0;
+  char *csv = (char *)malloc(1 << 20);
+  length += sprintf(csv, "id,key,value\n");
+  for (int i = 0; i < 20000; i++)
+    length += sprintf(csv + length, "%d,k%d,%d\n", i, (i * 7) % 13, i % 100);
+
+  char sequentialRows[BUFSIZ], parallelRows[BUFSIZ];
+  CsvSink *sequential = createMemorySink(sequentialRows, BUFSIZ);
+  CsvSink *parallel = createMemorySink(parallelRows, BUFSIZ);
+  CsvQuery *query = createCsvQuery("", "value<90");
+  CU_ASSERT(setCsvQueryGroupBy(
+      query,
+      "key",
+      "count,sum(value:int),min(id:int),max(value:int),count_distinct(value)"));
+  setCsvQueryOffset(query, 2);
+  setCsvQueryLimit(query, 8);
+  CU_ASSERT(runCsvQuery(query, csv, sequential));
+  setCsvQueryWorkerCount(query, 2);
+  CU_ASSERT(runCsvQuery(query, csv, parallel));
+
+  // The groups keep the order of their first row however the chunks were split
+  size_t sequentialLength = getSinkLength(sequential);
+  CU_ASSERT(getSinkLength(parallel) == sequentialLength);
+  CU_ASSERT(memcmp(sequentialRows, parallelRows, sequentialLength) == 0);
+  CU_ASSERT(strncmp(sequentialRows, "key,count,", 10) == 0);
+  CU_ASSERT(strncmp(strchr(sequentialRows, '\n') + 1, "k1,1385,", 8) == 0);
+
+  freeSink(sequential);
+  freeSink(parallel);
+  freeCsvQuery(query);
+  free(csv);
+}
+
+void test_buildCsvFileIndex_skips_blocks(void)
+{
+  char buf[BUFSIZ];
+  CsvStats stats = {0};
+  FILE *csvFile = fopen(TEST_CSV_FILE, "w");
+  fputs("id,day,name\n", csvFile);
+  for (int i = 0; i < 5000; i++)
+    fprintf(csvFile, "%d,2026-%02d-%02d,\"n%d\"\n", i, i / 500 + 1, i % 28 + 1, i % 10);
+  fclose(csvFile);
+
+  CU_ASSERT(buildCsvFileIndex(TEST_CSV_FILE, 1024));
+  CU_ASSERT(!buildCsvFileIndex("missing.csv", 0));
+
+  CsvQuery *query = createCsvQuery("id", "id:int>=4990\nname=n9");
+  CsvSink *sink = createMemorySink(buf, BUFSIZ);
+  setCsvQueryStats(query, &stats);
+
+  CU_ASSERT(runCsvQueryFile(query, TEST_CSV_FILE, sink));
+  CU_ASSERT(stats.bytesRead > 0 && stats.bytesRead < 10000);
+  CU_ASSERT(getSinkLength(sink) == strlen("id\n4999\n"));
+  CU_ASSERT(strncmp(buf, "id\n4999\n", getSinkLength(sink)) == 0);
+
+  // The index is ignored once the file changes
+  csvFile = fopen(TEST_CSV_FILE, "a");
+  fputs("5000,2026-10-28,n9\n", csvFile);
+  fclose(csvFile);
+
+  freeSink(sink);
+  sink = createMemorySink(buf, BUFSIZ);
+  CU_ASSERT(runCsvQueryFile(query, TEST_CSV_FILE, sink));
+  CU_ASSERT(getSinkLength(sink) == strlen("id\n4999\n5000\n"));
+  CU_ASSERT(strncmp(buf, "id\n4999\n5000\n", getSinkLength(sink)) == 0);
+
+  remove(TEST_CSV_FILE ".idx");
+  freeSink(sink);
+  freeCsvQuery(query);
+}
+
+void test_convertCsvFileToColumnar_same_output(void)
+{
+  FILE *csvFile = fopen(TEST_CSV_FILE, "w");
+  fputs("id,city,price,note\n", csvFile);
+  for (int i = 0; i < 400; i++)
+    if (i % 97 == 5)
+      fputs("\n", csvFile);
+    else if (i % 50 == 7)
+      fprintf(csvFile, "%d,oslo\n", i);
+    else
+      fprintf(csvFile, "%d,%s,%d.5,\"n,%d\"\n", i, i % 3 ? "paris" : "\"rome\"", i % 40, i);
+  fclose(csvFile);
+
+  CU_ASSERT(convertCsvFileToColumnar(TEST_CSV_FILE, TEST_CSV_FILE ".col"));
+  CU_ASSERT(!convertCsvFileToColumnar("missing.csv", TEST_CSV_FILE ".col"));
+
+  const char *queries[][4] = {
+      {"", "", "", ""},
+      {"note,id", "city=rome\nprice:float<3", "", ""},
+      {"id,note", "price:auto>=35\nnote=n,399", "", ""},
+      {"city", "", "price:float,id:int", ""},
+      {"", "id:int>=100", "city", "count,sum(price),max(id:int)"},
+  };
+
+  for (size_t i = 0; i < sizeof(queries) / sizeof(queries[0]); i++)
+  {
+    char csvRows[1 << 15], columnarRows[1 << 15];
+    CsvSink *csvSink = createMemorySink(csvRows, sizeof(csvRows));
+    CsvSink *columnarSink = createMemorySink(columnarRows, sizeof(columnarRows));
+    CsvQuery *query = createCsvQuery(queries[i][0], queries[i][1]);
+
+    // The third column orders the rows, or groups them with the aggregates of the last
+    if (*queries[i][3])
+      CU_ASSERT(setCsvQueryGroupBy(query, queries[i][2], queries[i][3]));
+    else if (*queries[i][2])
+      CU_ASSERT(setCsvQueryOrder(query, queries[i][2]));
+    setCsvQueryOffset(query, i);
+    setCsvQueryLimit(query, i == 3 ? 0 : 300);
+
+    CU_ASSERT(runCsvQueryFile(query, TEST_CSV_FILE, csvSink));
+    CU_ASSERT(runCsvQueryFile(query, TEST_CSV_FILE ".col", columnarSink));
+    CU_ASSERT(getSinkLength(csvSink) > strlen("id\n"));
+    CU_ASSERT(getSinkLength(columnarSink) == getSinkLength(csvSink));
+    CU_ASSERT(memcmp(columnarRows, csvRows, getSinkLength(csvSink)) == 0);
+
+    freeSink(csvSink);
+    freeSink(columnarSink);
+    freeCsvQuery(query);
+  }
+
+  // A dictionary too short for the codes of its column makes the file invalid
+  size_t entryCount = 1;
+  FILE *columnarFile = fopen(TEST_CSV_FILE ".col", "r+");
+  fseek(
+      columnarFile,
+      sizeof(ColumnarHeader) + sizeof(ColumnarColumn) + offsetof(ColumnarColumn, entryCount),
+      SEEK_SET);
+  fwrite(&entryCount, sizeof(entryCount), 1, columnarFile);
+  fclose(columnarFile);
+
+  char rows[BUFSIZ];
+  CsvQuery *query = createCsvQuery("city", "city=rome");
+  CsvSink *sink = createMemorySink(rows, BUFSIZ);
+  freopen(REDIRECT_FILE, "w+", stderr);
+  CU_ASSERT(!runCsvQueryFile(query, TEST_CSV_FILE ".col", sink));
+  freopen(REOPEN_PATH, "w", stderr);
+  freeSink(sink);
+  freeCsvQuery(query);
+
+  remove(TEST_CSV_FILE ".col");
+}
+
+void test_runCsvQueryFile_gzip_compressed(void)
+{
+  char csvRows[BUFSIZ], gzipRows[BUFSIZ];
+  FILE *csvFile = fopen(TEST_CSV_FILE, "w");
+  fputs("id,name\n", csvFile);
+
+  // Concatenated gzip files are read one member after the other
+  gzFile gzipFile = gzopen(TEST_CSV_FILE ".gz", "wb");
+  gzputs(gzipFile, "id,name\n");
+  for (int i = 0; i < 100000; i++)
+  {
+    if (i == 50000)
+    {
+      gzclose(gzipFile);
+      gzipFile = gzopen(TEST_CSV_FILE ".gz", "ab");
+    }
+
+    fprintf(csvFile, "%d,\"n,%d\"\n", i, i % 7);
+    gzprintf(gzipFile, "%d,\"n,%d\"\n", i, i % 7);
+  }
+  fclose(csvFile);
+  gzclose(gzipFile);
+
+  CsvQuery *query = createCsvQuery("name", "id:int>=99990");
+  CsvSink *csvSink = createMemorySink(csvRows, BUFSIZ);
+  CsvSink *gzipSink = createMemorySink(gzipRows, BUFSIZ);
+
+  CU_ASSERT(runCsvQueryFile(query, TEST_CSV_FILE, csvSink));
+  CU_ASSERT(runCsvQueryFile(query, TEST_CSV_FILE ".gz", gzipSink));
+  CU_ASSERT(getSinkLength(csvSink) == strlen("name\n") + 10 * strlen("\"n,0\"\n"));
+  CU_ASSERT(getSinkLength(gzipSink) == getSinkLength(csvSink));
+  CU_ASSERT(memcmp(gzipRows, csvRows, getSinkLength(csvSink)) == 0);
+
+  size_t fieldCount, rowCount = 0;
+  CsvReader *reader = openCsvFileReader(query, TEST_CSV_FILE ".gz");
+  CU_ASSERT_FATAL(reader != NULL);
+  while (nextCsvRow(reader, &fieldCount) != NULL)
+    rowCount++;
+  CU_ASSERT(rowCount == 10);
+  closeCsvReader(reader);
+
+  freopen(REDIRECT_FILE, "w+", stderr);
+  CU_ASSERT(!buildCsvFileIndex(TEST_CSV_FILE ".gz", 0));
+  freopen(REOPEN_PATH, "w", stderr);
+
+  remove(TEST_CSV_FILE ".gz");
+  freeSink(csvSink);
+  freeSink(gzipSink);
+  freeCsvQuery(query);
+}
+
+/**
+ * Thread copying TEST_CSV_FILE into the FIFO given as argument.
+ */
+static void *writeFifo(void *arg)
+{
+  char buf[BUFSIZ];
+  size_t length;
+  FILE *csvFile = fopen(TEST_CSV_FILE, "r");
+  FILE *fifo = fopen((const char *)arg, "w");
+
+  while ((length = fread(buf, 1, BUFSIZ, csvFile)) > 0)
+    fwrite(buf, 1, length, fifo);
+
+  fclose(fifo);
+  fclose(csvFile);
+  return NULL;
+}
+
+void test_runCsvQueryFile_fifo_long_rows(void)
+{
+  char csvRows[BUFSIZ], fifoRows[BUFSIZ];
+  char *expected = "id,group\n2,2\n5,2\n8,2\n11,2\n14,2\n17,2\n20,2\n23,2\n26,2\n29,2\n"
+                   "32,2\n35,2\n38,2\n40,2\n";
+  char *field = (char *)malloc(3 << 20);
+  FILE *csvFile = fopen(TEST_CSV_FILE, "w");
+  fputs("id,text,group\n", csvFile);
+
+  // Quoted fields longer than the read buffers, with line separators, span
+  // several of them
+  for (int i = 0; i < 40; i++)
+  {
+    size_t length = (size_t)1 << (i % 22);
+    memset(field, 'x', length);
+    field[length / 2] = '\n';
+    fprintf(csvFile, "%d,\"%.*s\",%d\n", i, (int)length, field, i % 3);
+  }
+  fputs("40,\"last\",2", csvFile);
+  fclose(csvFile);
+  free(field);
+
+  remove(TEST_CSV_FILE ".fifo");
+  CU_ASSERT_FATAL(mkfifo(TEST_CSV_FILE ".fifo", 0600) == 0);
+
+  CsvQuery *query = createCsvQuery("id,group", "group:int>1");
+  CsvSink *csvSink = createMemorySink(csvRows, BUFSIZ);
+  CsvSink *fifoSink = createMemorySink(fifoRows, BUFSIZ);
+
+  pthread_t writer;
+  pthread_create(&writer, NULL, writeFifo, TEST_CSV_FILE ".fifo");
+  CU_ASSERT(runCsvQueryFile(query, TEST_CSV_FILE ".fifo", fifoSink));
+  pthread_join(writer, NULL);
+
+  CU_ASSERT(runCsvQueryFile(query, TEST_CSV_FILE, csvSink));
+  CU_ASSERT(getSinkLength(csvSink) == strlen(expected));
+  CU_ASSERT(strncmp(csvRows, expected, strlen(expected)) == 0);
+  CU_ASSERT(getSinkLength(fifoSink) == getSinkLength(csvSink));
+  CU_ASSERT(memcmp(fifoRows, csvRows, getSinkLength(csvSink)) == 0);
+
+  // Readers pull their rows from the same buffers
+  size_t fieldCount, rowCount = 0;
+  pthread_create(&writer, NULL, writeFifo, TEST_CSV_FILE ".fifo");
+  CsvReader *reader = openCsvFileReader(query, TEST_CSV_FILE ".fifo");
+  CU_ASSERT_FATAL(reader != NULL);
+  while (nextCsvRow(reader, &fieldCount) != NULL)
+    rowCount++;
+  closeCsvReader(reader);
+  pthread_join(writer, NULL);
+  CU_ASSERT(rowCount == 14);
+
+  remove(TEST_CSV_FILE ".fifo");
+  freeSink(csvSink);
+  freeSink(fifoSink);
+  freeCsvQuery(query);
+}
+
+void test_runCsvQueryFile_limit_on_idle_pipe(void)
+{
+  char buf[BUFSIZ], pipePath[64];
+  char *expected = "header1\n1\n4\n";
+  int pipeFds[2];
+  CU_ASSERT_FATAL(pipe(pipeFds) == 0);
+  snprintf(pipePath, sizeof(pipePath), "/dev/fd/%d", pipeFds[0]);
+
+  // The writer keeps the pipe open, so the limit must stop the query without
+  // waiting for the end of the file
+  write(pipeFds[1], TEST_CSV "\n", strlen(TEST_CSV "\n"));
+
+  CsvQuery *query = createCsvQuery("header1", "");
+  CsvSink *sink = createMemorySink(buf, BUFSIZ);
+  setCsvQueryLimit(query, 2);
+  CU_ASSERT(runCsvQueryFile(query, pipePath, sink));
+  CU_ASSERT(getSinkLength(sink) == strlen(expected));
+  CU_ASSERT(strncmp(buf, expected, strlen(expected)) == 0);
+
+  close(pipeFds[0]);
+  close(pipeFds[1]);
+  freeSink(sink);
+  freeCsvQuery(query);
+}
+
+void test_nextCsvRow_filtered_views(void)
+{
+  // Fields are checked to point into this very array
+  static const char csv[] = TEST_CSV;
+  size_t fieldCount;
+  CsvQuery *query = createCsvQuery("header1,header3", "header2>2");
+  CsvReader *reader = openCsvReader(query, csv, strlen(csv));
+  CU_ASSERT_FATAL(reader != NULL);
+
+  const CellView *headers = getCsvReaderHeaders(reader, &fieldCount);
+  CU_ASSERT(fieldCount == 2);
+  CU_ASSERT(strncmp(headers[1].value, "header3", headers[1].length) == 0);
+
+  const CellView *fields = nextCsvRow(reader, &fieldCount);
+  CU_ASSERT_FATAL(fields != NULL);
+  CU_ASSERT(fieldCount == 2);
+  CU_ASSERT(fields[0].length == 1 && fields[0].value[0] == '4');
+  CU_ASSERT(fields[1].length == 1 && fields[1].value[0] == '6');
+  CU_ASSERT(fields[1].value >= csv && fields[1].value < csv + strlen(csv));
+
+  fields = nextCsvRow(reader, &fieldCount);
+  CU_ASSERT_FATAL(fields != NULL);
+  CU_ASSERT(fields[0].value[0] == '7' && fields[1].value[0] == '9');
+
+  CU_ASSERT(nextCsvRow(reader, &fieldCount) == NULL);
+  closeCsvReader(reader);
+  freeCsvQuery(query);
+}
+
+void test_openCsvFileReader_missing_header(void)
+{
+  FILE *csvFile = fopen(TEST_CSV_FILE, "w");
+  fputs(TEST_CSV, csvFile);
+  fclose(csvFile);
+  CsvQuery *query = createCsvQuery("header4", "");
+  freopen(REDIRECT_FILE, "w+", stderr);
+  CU_ASSERT(openCsvFileReader(query, TEST_CSV_FILE) == NULL);
+  freopen(REOPEN_PATH, "w", stderr);
+  freeCsvQuery(query);
+}
+
+void test_getCsvArenaBytes_rows_and_rollback(void)
+{
+  size_t reserved;
+  char header[300];
+  Csv *csv = createSizedCsv(256);
+  CU_ASSERT(getCsvArenaBytes(csv, &reserved) == 0);
+  CU_ASSERT(reserved == 0);
+
+  // Columns and their headers share a block, each column aligned after a header
+  addColumn(csv, "a", true);
+  addColumn(csv, "b", true);
+  size_t used = getCsvArenaBytes(csv, &reserved);
+  CU_ASSERT(used == 2 * sizeof(Column) + sizeof(void *) + 2);
+  CU_ASSERT(reserved == 256);
+
+  // Cells live in their columns, and deleting the last row gives its bytes back
+  addRow(csv);
+  setCell(csv, 0, 0, "1");
+  addRow(csv);
+  setCell(csv, 1, 1, "22");
+  deleteRow(csv, 1);
+  CU_ASSERT(csv->rowCount == 1);
+  CU_ASSERT(csv->columns[1]->byteCount == 0);
+  CU_ASSERT(strcmp(getCell(csv, 0, 0), "1") == 0);
+  CU_ASSERT(getCsvArenaBytes(csv, NULL) == used);
+
+  // Rolling back releases the bytes and the blocks allocated after the mark
+  ArenaMark mark = arenaMark(&csv->arena);
+  memset(header, 'h', sizeof(header) - 1);
+  arenaStrndup(&csv->arena, header, sizeof(header) - 1);
+  arenaAlloc(&csv->arena, 8);
+  CU_ASSERT(getCsvArenaBytes(csv, &reserved) == used + sizeof(header) + 8);
+  // The oversized string gets a block of its own, full, so 8 more bytes need another
+  CU_ASSERT(reserved == 2 * 256 + sizeof(header));
+  arenaRollback(&csv->arena, mark);
+  CU_ASSERT(getCsvArenaBytes(csv, &reserved) == used);
+  CU_ASSERT(reserved == 256);
+
+  freeCsv(csv);
+}
+
+/**
+ * Scan the structural positions of a buffer with a given block mask.
+ */
+static size_t scanStructurals(
+    const char *data,
+    size_t length,
+    BlockMask blockMask,
+    size_t positions[])
+{
+  CsvScanner scanner;
+  size_t count = 0, position;
+
+  // Reload the first block, which initScanner loaded with the selected block mask
+  initScanner(&scanner, data, length);
+  scanner.blockMask = blockMask;
+  scanner.quoteCarry = 0;
+  scanner.mask = loadBlockMask(&scanner);
+
+  while ((position = nextStructural(&scanner)) < length)
+    positions[count++] = position;
+
+  return count;
+}
+
+void test_listBlockMasks_match_scalar(void)
+{
+  BlockMask blockMasks[MAX_BLOCK_MASKS];
+  size_t blockMaskCount = listBlockMasks(blockMasks);
+  char data[3 * SCAN_BLOCK_SIZE + 1];
+  size_t expected[] = {0, 66, 131, 191}, positions[sizeof(data)], scalarPositions[sizeof(data)];
+
+  // Quoted separators at bits 63 and 64, and an escaped quote split across bits 63
+  // and 64 of the next block, are carried over the block boundaries
+  memset(data, 'x', sizeof(data));
+  data[0] = ',';
+  data[62] = '"';
+  data[63] = ',';
+  data[64] = '\n';
+  data[65] = '"';
+  data[66] = ',';
+  data[100] = '"';
+  data[127] = '"';
+  data[128] = '"';
+  data[129] = ',';
+  data[130] = '"';
+  data[131] = ',';
+  data[191] = '\n';
+
+  CU_ASSERT(blockMaskCount >= 1);
+  for (size_t i = 0; i < blockMaskCount; i++)
+  {
+    size_t count = scanStructurals(data, 3 * SCAN_BLOCK_SIZE, blockMasks[i], positions);
+    CU_ASSERT(count == sizeof(expected) / sizeof(expected[0]));
+    CU_ASSERT(memcmp(positions, expected, sizeof(expected)) == 0);
+  }
+
+  // Random blocks, at every alignment, give the masks and positions of the scalar scan
+  unsigned int seed = 1;
+  for (int round = 0; round < 200; round++)
+  {
+    for (size_t j = 0; j < sizeof(data); j++)
+    {
+      seed = seed * 1103515245 + 12345;
+      data[j] = ",\n\"xxxxx"[(seed >> 16) % 8];
+    }
+
+    size_t start = round % SCAN_BLOCK_SIZE;
+    size_t length = sizeof(data) - start;
+    size_t scalarCount = scanStructurals(
+        &data[start],
+        length,
+        blockMasks[blockMaskCount - 1],
+        scalarPositions);
+
+    for (size_t i = 0; i < blockMaskCount; i++)
+    {
+      uint64_t quotes, scalarQuotes;
+      uint64_t mask = blockMasks[i](&data[start], &quotes);
+      CU_ASSERT(mask == scalarBlockMask(&data[start], SCAN_BLOCK_SIZE, &scalarQuotes));
+      CU_ASSERT(quotes == scalarQuotes);
+
+      size_t count = scanStructurals(&data[start], length, blockMasks[i], positions);
+      CU_ASSERT(count == scalarCount);
+      CU_ASSERT(memcmp(positions, scalarPositions, count * sizeof(size_t)) == 0);
+    }
+  }
+}
+
 int main()
 {
   if (CU_initialize_registry() != CUE_SUCCESS)
@@ -307,10 +1477,203 @@ int main()
               "processCsv_invalid_filter",
               test_processCsv_invalid_filter);
 
+  CU_add_test(processCsvSuite,
+              "processCsv_non_first_column_selected",
+              test_processCsv_non_first_column_selected);
+
+  CU_add_test(processCsvSuite,
+              "processCsv_integer_filter",
+              test_processCsv_integer_filter);
+
+  CU_add_test(processCsvSuite,
+              "processCsv_float_filter",
+              test_processCsv_float_filter);
+
+  CU_add_test(processCsvSuite,
+              "processCsv_date_filter",
+              test_processCsv_date_filter);
+
+  CU_add_test(processCsvSuite,
+              "processCsv_invalid_typed_value",
+              test_processCsv_invalid_typed_value);
+
+  CU_add_test(processCsvSuite,
+              "processCsv_quoted_fields",
+              test_processCsv_quoted_fields);
+
+  CU_pSuite processCsvFileSuite = CU_add_suite("processCsvFile", NULL, NULL);
+  if (CU_get_error() != CUE_SUCCESS)
+    errx(EXIT_FAILURE, "%s", CU_get_error_msg());
+
+  CU_add_test(processCsvFileSuite,
+              "processCsvFile_filter",
+              test_processCsvFile_filter);
+
+  CU_add_test(processCsvFileSuite,
+              "processCsvFile_last_row_without_newline",
+              test_processCsvFile_last_row_without_newline);
+
+  CU_add_test(processCsvFileSuite,
+              "processCsvFile_inferred_type_filter",
+              test_processCsvFile_inferred_type_filter);
+
+  CU_add_test(processCsvFileSuite,
+              "processCsvFile_skips_unused_columns",
+              test_processCsvFile_skips_unused_columns);
+
+  CU_add_test(processCsvFileSuite,
+              "processCsvFile_crlf_and_quoted_newlines",
+              test_processCsvFile_crlf_and_quoted_newlines);
+
+  CU_pSuite parallelSuite = CU_add_suite("parallel", NULL, NULL);
+  if (CU_get_error() != CUE_SUCCESS)
+    errx(EXIT_FAILURE, "%s", CU_get_error_msg());
+
+  CU_add_test(parallelSuite,
+              "processCsvParallel_filter",
+              test_processCsvParallel_filter);
+
+  CU_add_test(parallelSuite,
+              "processCsvFileParallel_keeps_row_order",
+              test_processCsvFileParallel_keeps_row_order);
+
+  CU_pSuite sinkSuite = CU_add_suite("sink", NULL, NULL);
+  if (CU_get_error() != CUE_SUCCESS)
+    errx(EXIT_FAILURE, "%s", CU_get_error_msg());
+
+  CU_add_test(sinkSuite,
+              "processCsvToSink_memory_sink",
+              test_processCsvToSink_memory_sink);
+
+  CU_add_test(sinkSuite,
+              "processCsvToSink_truncated_memory_sink",
+              test_processCsvToSink_truncated_memory_sink);
+
+  CU_add_test(sinkSuite,
+              "processCsvFileToSink_callback_sink",
+              test_processCsvFileToSink_callback_sink);
+
+  CU_pSuite querySuite = CU_add_suite("query", NULL, NULL);
+  if (CU_get_error() != CUE_SUCCESS)
+    errx(EXIT_FAILURE, "%s", CU_get_error_msg());
+
+  CU_add_test(querySuite,
+              "runCsvQuery_reused_on_inputs",
+              test_runCsvQuery_reused_on_inputs);
+
+  CU_add_test(querySuite,
+              "runCsvQuery_rebinds_changed_headers",
+              test_runCsvQuery_rebinds_changed_headers);
+
+  CU_add_test(querySuite,
+              "runCsvQuery_exact_headers_many_columns",
+              test_runCsvQuery_exact_headers_many_columns);
+
+  CU_add_test(querySuite,
+              "runCsvQuery_duplicate_headers",
+              test_runCsvQuery_duplicate_headers);
+
+  CU_add_test(querySuite,
+              "runCsvQuery_quoted_header_line_separator",
+              test_runCsvQuery_quoted_header_line_separator);
+
+  CU_add_test(querySuite,
+              "runCsvQuery_int64_limits",
+              test_runCsvQuery_int64_limits);
+
+  CU_add_test(querySuite,
+              "runCsvQuery_long_float_and_impossible_dates",
+              test_runCsvQuery_long_float_and_impossible_dates);
+
+  CU_add_test(querySuite,
+              "createCsvQuery_invalid_filter",
+              test_createCsvQuery_invalid_filter);
+
+  CU_add_test(querySuite,
+              "processCsvToSink_concurrent_calls",
+              test_processCsvToSink_concurrent_calls);
+
+  CU_add_test(querySuite,
+              "runCsvQuery_counts_stats",
+              test_runCsvQuery_counts_stats);
+
+  CU_add_test(querySuite,
+              "runCsvQuery_order_by_columns",
+              test_runCsvQuery_order_by_columns);
+
+  CU_add_test(querySuite,
+              "runCsvQueryFile_order_spills_with_limit",
+              test_runCsvQueryFile_order_spills_with_limit);
+
+  CU_add_test(querySuite,
+              "runCsvQuery_limit_offset",
+              test_runCsvQuery_limit_offset);
+
+  CU_add_test(querySuite,
+              "runCsvQuery_in_filters",
+              test_runCsvQuery_in_filters);
+
+  CU_add_test(querySuite,
+              "runCsvQuery_column_comparisons",
+              test_runCsvQuery_column_comparisons);
+
+  CU_add_test(querySuite,
+              "runCsvQuery_group_by",
+              test_runCsvQuery_group_by);
+
+  CU_add_test(querySuite,
+              "runCsvQuery_group_by_parallel",
+              test_runCsvQuery_group_by_parallel);
+
+  CU_add_test(querySuite,
+              "buildCsvFileIndex_skips_blocks",
+              test_buildCsvFileIndex_skips_blocks);
+
+  CU_add_test(querySuite,
+              "convertCsvFileToColumnar_same_output",
+              test_convertCsvFileToColumnar_same_output);
+
+  CU_add_test(querySuite,
+              "runCsvQueryFile_gzip_compressed",
+              test_runCsvQueryFile_gzip_compressed);
+
+  CU_add_test(querySuite,
+              "runCsvQueryFile_fifo_long_rows",
+              test_runCsvQueryFile_fifo_long_rows);
+
+  CU_add_test(querySuite,
+              "runCsvQueryFile_limit_on_idle_pipe",
+              test_runCsvQueryFile_limit_on_idle_pipe);
+
+  CU_pSuite readerSuite = CU_add_suite("reader", NULL, NULL);
+  if (CU_get_error() != CUE_SUCCESS)
+    errx(EXIT_FAILURE, "%s", CU_get_error_msg());
+
+  CU_add_test(readerSuite,
+              "nextCsvRow_filtered_views",
+              test_nextCsvRow_filtered_views);
+
+  CU_add_test(readerSuite,
+              "openCsvFileReader_missing_header",
+              test_openCsvFileReader_missing_header);
+
+  CU_pSuite csvSuite = CU_add_suite("csv", NULL, NULL);
+  if (CU_get_error() != CUE_SUCCESS)
+    errx(EXIT_FAILURE, "%s", CU_get_error_msg());
+
+  CU_add_test(csvSuite,
+              "getCsvArenaBytes_rows_and_rollback",
+              test_getCsvArenaBytes_rows_and_rollback);
+
+  CU_add_test(csvSuite,
+              "listBlockMasks_match_scalar",
+              test_listBlockMasks_match_scalar);
+
   CU_basic_run_tests();
   CU_cleanup_registry();
 
   remove(REDIRECT_FILE);
+  remove(TEST_CSV_FILE);
 
   return EXIT_SUCCESS;
 }
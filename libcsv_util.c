@@ -1,48 +1,267 @@
+#include <limits.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <stdbool.h>
 #include "libcsv_util.h"
 
+void initArena(Arena *arena, size_t blockSize)
+{
+  arena->blocks = NULL;
+  arena->blockSize = blockSize;
+  arena->bytesUsed = 0;
+  arena->bytesReserved = 0;
+}
+
+/**
+ * Allocate memory from an arena with a given alignment.
+ *
+ * @param arena The arena to allocate from.
+ * @param size How many bytes to allocate.
+ * @param alignment The alignment of the memory, must be a power of two.
+ * @return void* The allocated memory.
+ */
+static void *arenaAllocAligned(Arena *arena, size_t size, size_t alignment)
+{
+  ArenaBlock *block = arena->blocks;
+
+  if (block != NULL)
+  {
+    size_t start = (block->used + alignment - 1) & ~(alignment - 1);
+    if (start + size <= block->size)
+    {
+      arena->bytesUsed += start + size - block->used;
+      block->used = start + size;
+      return &block->data[start];
+    }
+  }
+
+  size_t blockSize = size > arena->blockSize ? size : arena->blockSize;
+  block = (ArenaBlock *)malloc(sizeof(ArenaBlock) + blockSize);
+  block->next = arena->blocks;
+  block->size = blockSize;
+  block->used = size;
+  arena->blocks = block;
+  arena->bytesUsed += size;
+  arena->bytesReserved += blockSize;
+
+  return block->data;
+}
+
+void *arenaAlloc(Arena *arena, size_t size)
+{
+  return arenaAllocAligned(arena, size, sizeof(void *));
+}
+
+char *arenaStrndup(Arena *arena, const char value[], size_t length)
+{
+  char *copy = (char *)arenaAllocAligned(arena, length + 1, 1);
+  memcpy(copy, value, length);
+  copy[length] = '\0';
+  return copy;
+}
+
+ArenaMark arenaMark(const Arena *arena)
+{
+  ArenaMark mark = {
+      arena->blocks,
+      arena->blocks != NULL ? arena->blocks->used : 0,
+      arena->bytesUsed};
+  return mark;
+}
+
+void arenaRollback(Arena *arena, ArenaMark mark)
+{
+  while (arena->blocks != mark.block)
+  {
+    ArenaBlock *block = arena->blocks;
+    arena->blocks = block->next;
+    arena->bytesReserved -= block->size;
+    free(block);
+  }
+
+  if (mark.block != NULL)
+    mark.block->used = mark.used;
+  arena->bytesUsed = mark.bytesUsed;
+}
+
+void freeArena(Arena *arena)
+{
+  while (arena->blocks != NULL)
+  {
+    ArenaBlock *block = arena->blocks;
+    arena->blocks = block->next;
+    free(block);
+  }
+
+  arena->bytesUsed = 0;
+  arena->bytesReserved = 0;
+}
+
 Csv *createCsv()
+{
+  return createSizedCsv(ARENA_BLOCK_SIZE);
+}
+
+Csv *createSizedCsv(size_t arenaBlockSize)
 {
   Csv *csv = (Csv *)malloc(sizeof(Csv));
-  csv->cells = NULL;
   csv->columns = NULL;
   csv->rowCount = 0;
+  csv->rowCapacity = 0;
   csv->colCount = 0;
+  csv->colCapacity = 0;
+  csv->headerSlots = NULL;
+  csv->headerSlotMask = 0;
+  csv->allocations = 0;
+  csv->cellsCopied = 0;
+  initArena(&csv->arena, arenaBlockSize);
 
   return csv;
 }
 
+size_t getCsvArenaBytes(const Csv *csv, size_t *bytesReserved)
+{
+  if (bytesReserved != NULL)
+    *bytesReserved = csv->arena.bytesReserved;
+
+  return csv->arena.bytesUsed;
+}
+
+/**
+ * Find the slot of a header in the hash table of a CSV.
+ *
+ * @param csv The CSV, with at least one empty slot.
+ * @param header The header.
+ * @param hash The hash of the header.
+ * @return HeaderSlot* The slot of the first column with the header, or the empty
+ * slot where it belongs.
+ */
+static HeaderSlot *findHeaderSlot(const Csv *csv, const char header[], uint64_t hash)
+{
+  for (size_t i = hash & csv->headerSlotMask;; i = (i + 1) & csv->headerSlotMask)
+  {
+    HeaderSlot *slot = &csv->headerSlots[i];
+
+    if (!slot->hash ||
+        (slot->hash == hash && strcmp(csv->columns[slot->column]->header, header) == 0))
+      return slot;
+  }
+}
+
+/**
+ * Add a column to the hash table of the headers of a CSV, unless an earlier column
+ * has the same header.
+ *
+ * @param csv The CSV, with a free slot in its hash table.
+ * @param column The index of the column.
+ */
+static void addHeaderSlot(Csv *csv, size_t column)
+{
+  const char *header = csv->columns[column]->header;
+  uint64_t hash = hashBytes(header, strlen(header));
+  HeaderSlot *slot = findHeaderSlot(csv, header, hash);
+
+  if (!slot->hash)
+  {
+    slot->hash = hash;
+    slot->column = column;
+  }
+}
+
+size_t findColumn(const Csv *csv, const char header[])
+{
+  if (csv->headerSlots == NULL)
+    return NO_CELL;
+
+  HeaderSlot *slot = findHeaderSlot(csv, header, hashBytes(header, strlen(header)));
+  return slot->hash ? slot->column : NO_CELL;
+}
+
 void addColumn(Csv *csv, const char header[], const bool isSelected)
 {
-  csv->columns = (Column **)realloc(csv->columns, (csv->colCount + 1) * sizeof(Column *));
-  Column *column = (Column *)malloc(sizeof(Column));
-  column->header = strdup(header);
+  if (csv->colCount == csv->colCapacity)
+  {
+    csv->colCapacity = csv->colCapacity ? csv->colCapacity * 2 : 16;
+    csv->columns = (Column **)realloc(csv->columns, csv->colCapacity * sizeof(Column *));
+
+    // The table is kept at most half full
+    free(csv->headerSlots);
+    csv->headerSlots = (HeaderSlot *)calloc(csv->colCapacity * 2, sizeof(HeaderSlot));
+    csv->headerSlotMask = csv->colCapacity * 2 - 1;
+    for (size_t i = 0; i < csv->colCount; i++)
+      addHeaderSlot(csv, i);
+  }
+
+  Column *column = (Column *)arenaAlloc(&csv->arena, sizeof(Column));
+  column->header = arenaStrndup(&csv->arena, header, strlen(header));
   column->isSelected = isSelected;
-  csv->columns[csv->colCount++] = column;
+  column->bytes = NULL;
+  column->byteCount = 0;
+  column->byteCapacity = 0;
+  column->offsets = NULL;
+  csv->columns[csv->colCount] = column;
+  addHeaderSlot(csv, csv->colCount++);
 }
 
 void addRow(Csv *csv)
 {
-  csv->cells = (char ***)realloc(csv->cells, (csv->rowCount + 1) * sizeof(char **));
+  if (csv->rowCount == csv->rowCapacity)
+  {
+    csv->rowCapacity = csv->rowCapacity ? csv->rowCapacity * 2 : 64;
 
-  csv->cells[csv->rowCount] = (char **)malloc(csv->colCount * sizeof(char *));
-  char **row = csv->cells[csv->rowCount];
+    for (size_t i = 0; i < csv->colCount; i++)
+      if (csv->columns[i]->offsets != NULL)
+      {
+        csv->columns[i]->offsets = (size_t *)realloc(
+            csv->columns[i]->offsets,
+            csv->rowCapacity * sizeof(size_t));
+        csv->allocations++;
+      }
+  }
 
   for (size_t i = 0; i < csv->colCount; i++)
-    row[i] = NULL;
+    if (csv->columns[i]->offsets != NULL)
+      csv->columns[i]->offsets[csv->rowCount] = NO_CELL;
 
   csv->rowCount++;
 }
 
 void setCell(Csv *csv, size_t row, size_t col, const char value[])
+{
+  CellView cell = {value, strlen(value)};
+  setCellView(csv, row, col, &cell);
+}
+
+void setCellView(Csv *csv, size_t row, size_t col, const CellView *cell)
 {
   if (row >= csv->rowCount || col >= csv->colCount)
     return;
 
-  csv->cells[row][col] = strdup(value);
+  Column *column = csv->columns[col];
+  size_t length = cell->length + 1;
+
+  if (column->offsets == NULL)
+  {
+    column->offsets = (size_t *)malloc(csv->rowCapacity * sizeof(size_t));
+    csv->allocations++;
+    for (size_t i = 0; i < csv->rowCount; i++)
+      column->offsets[i] = NO_CELL;
+  }
+
+  if (column->byteCount + length > column->byteCapacity)
+  {
+    while (column->byteCount + length > column->byteCapacity)
+      column->byteCapacity = column->byteCapacity ? column->byteCapacity * 2 : 256;
+    column->bytes = (char *)realloc(column->bytes, column->byteCapacity);
+    csv->allocations++;
+  }
+
+  memcpy(&column->bytes[column->byteCount], cell->value, cell->length);
+  csv->cellsCopied++;
+  column->bytes[column->byteCount + cell->length] = '\0';
+  column->offsets[row] = column->byteCount;
+  column->byteCount += length;
 }
 
 char *getCell(Csv *csv, size_t row, size_t col)
@@ -50,7 +269,12 @@ char *getCell(Csv *csv, size_t row, size_t col)
   if (row >= csv->rowCount || col >= csv->colCount)
     return NULL;
 
-  return csv->cells[row][col];
+  Column *column = csv->columns[col];
+
+  if (column->offsets == NULL || column->offsets[row] == NO_CELL)
+    return NULL;
+
+  return &column->bytes[column->offsets[row]];
 }
 
 void deleteRow(Csv *csv, size_t row)
@@ -58,65 +282,127 @@ void deleteRow(Csv *csv, size_t row)
   if (row >= csv->rowCount)
     return;
 
-  char **rowData = csv->cells[row];
+  csv->rowCount--;
 
   for (size_t i = 0; i < csv->colCount; i++)
-    if (rowData[i] != NULL)
-      free(rowData[i]);
+  {
+    Column *column = csv->columns[i];
 
-  free(rowData);
-  csv->rowCount--;
+    if (column->offsets == NULL)
+      continue;
+
+    size_t offset = column->offsets[row];
+
+    if (offset != NO_CELL &&
+        offset + strlen(&column->bytes[offset]) + 1 == column->byteCount)
+      column->byteCount = offset;
+
+    memmove(
+        &column->offsets[row],
+        &column->offsets[row + 1],
+        (csv->rowCount - row) * sizeof(size_t));
+  }
+}
 
-  for (size_t i = row + 1; i < csv->rowCount; i++)
-    csv->cells[i] = csv->cells[i + 1];
+void clearRows(Csv *csv)
+{
+  for (size_t i = 0; i < csv->colCount; i++)
+    csv->columns[i]->byteCount = 0;
 
-  csv->cells = (char ***)realloc(csv->cells, csv->rowCount * sizeof(char **));
+  csv->rowCount = 0;
 }
 
 void freeCsv(Csv *csv)
 {
   for (size_t i = 0; i < csv->colCount; i++)
-    free(csv->columns[i]);
+  {
+    free(csv->columns[i]->bytes);
+    free(csv->columns[i]->offsets);
+  }
 
   free(csv->columns);
+  free(csv->headerSlots);
+  freeArena(&csv->arena);
+  free(csv);
+}
 
-  for (size_t i = 0; i < csv->rowCount; i++)
+/**
+ * Write a header to a sink, quoting it if it contains separators or quotes.
+ *
+ * @param sink The sink.
+ * @param header The header.
+ */
+static void writeHeader(CsvSink *sink, const char header[])
+{
+  if (strpbrk(header, VALUE_SEPARATOR LINE_SEPARATOR QUOTE "\r") == NULL)
   {
-    for (size_t j = 0; j < csv->colCount; j++)
-      free(csv->cells[i][j]);
+    writeSink(sink, header, strlen(header));
+    return;
+  }
 
-    free(csv->cells[i]);
+  putSink(sink, *QUOTE);
+  for (const char *c = header; *c; c++)
+  {
+    if (*c == *QUOTE)
+      putSink(sink, *QUOTE);
+    putSink(sink, *c);
   }
+  putSink(sink, *QUOTE);
+}
 
-  free(csv->cells);
-  free(csv);
+void printHeaders(const Csv *csv, CsvSink *sink)
+{
+  bool first = true;
+  for (size_t i = 0; i < csv->colCount; i++)
+  {
+    if (!csv->columns[i]->isSelected)
+      continue;
+
+    if (!first)
+      putSink(sink, *VALUE_SEPARATOR);
+    writeHeader(sink, csv->columns[i]->header);
+    first = false;
+  }
+  putSink(sink, *LINE_SEPARATOR);
 }
 
-void printCsv(Csv *csv)
+void printRow(const Csv *csv, const CellView cells[], CsvSink *sink)
 {
+  bool first = true;
   for (size_t i = 0; i < csv->colCount; i++)
   {
     if (!csv->columns[i]->isSelected)
       continue;
 
-    if (i)
-      printf(",");
-    printf("%s", csv->columns[i]->header);
+    if (!first)
+      putSink(sink, *VALUE_SEPARATOR);
+    writeSink(sink, cells[i].value, cells[i].length);
+    first = false;
   }
-  printf("\n");
+  putSink(sink, *LINE_SEPARATOR);
+}
+
+void printCsv(Csv *csv, CsvSink *sink)
+{
+  printHeaders(csv, sink);
 
   for (size_t i = 0; i < csv->rowCount; i++)
   {
+    bool first = true;
     for (size_t j = 0; j < csv->colCount; j++)
     {
       if (!csv->columns[j]->isSelected)
         continue;
 
-      if (j)
-        printf(",");
-      printf("%s", csv->cells[i][j]);
+      char *cell = getCell(csv, i, j);
+
+      if (!first)
+        putSink(sink, *VALUE_SEPARATOR);
+      if (cell != NULL)
+        writeSink(sink, cell, strlen(cell));
+      first = false;
     }
-    printf("\n");
+    putSink(sink, *LINE_SEPARATOR);
   }
 }
 
@@ -126,5 +412,700 @@ RowFilter *createRowFilter(size_t column, enum operator op, const char *value)
   rowFilter->column = column;
   rowFilter->op = op;
   rowFilter->value = strdup(value);
+  rowFilter->valueLength = strlen(value);
+  rowFilter->type = TEXT;
+  rowFilter->integerValue = 0;
+  rowFilter->floatValue = 0;
+  rowFilter->valueSet = NULL;
+  rowFilter->otherColumn = NO_CELL;
   return rowFilter;
 }
+
+RowFilter *copyRowFilter(const RowFilter *rowFilter)
+{
+  RowFilter *copy = (RowFilter *)malloc(sizeof(RowFilter));
+  *copy = *rowFilter;
+  copy->value = strdup(rowFilter->value);
+  copy->valueSet = rowFilter->valueSet != NULL ? copyValueSet(rowFilter->valueSet) : NULL;
+  return copy;
+}
+
+void freeRowFilter(RowFilter *rowFilter)
+{
+  if (rowFilter->valueSet != NULL)
+    freeValueSet(rowFilter->valueSet);
+  free(rowFilter->value);
+  free(rowFilter);
+}
+
+bool parseCellType(const char name[], size_t length, enum cellType *type)
+{
+  static const struct
+  {
+    const char *name;
+    enum cellType type;
+  } cellTypes[] = {
+      {"text", TEXT},
+      {"int", INTEGER},
+      {"float", FLOAT},
+      {"date", DATE},
+      {"auto", AUTO}};
+
+  for (size_t i = 0; i < sizeof(cellTypes) / sizeof(cellTypes[0]); i++)
+    if (strlen(cellTypes[i].name) == length && memcmp(cellTypes[i].name, name, length) == 0)
+    {
+      *type = cellTypes[i].type;
+      return true;
+    }
+
+  return false;
+}
+
+bool setRowFilterType(RowFilter *rowFilter, enum cellType type)
+{
+  CellView value = {rowFilter->value, rowFilter->valueLength};
+  bool isValid;
+
+  if (rowFilter->valueSet != NULL)
+  {
+    isValid = setValueSetType(rowFilter->valueSet, type);
+    if (isValid)
+      rowFilter->type = type;
+    return isValid;
+  }
+
+  // Cells of the other column are parsed along with the filtered ones
+  if (rowFilter->otherColumn != NO_CELL)
+  {
+    rowFilter->type = type;
+    return true;
+  }
+
+  switch (type)
+  {
+  case INTEGER:
+    isValid = parseInteger(&value, &rowFilter->integerValue);
+    break;
+  case FLOAT:
+    isValid = parseFloat(&value, &rowFilter->floatValue);
+    break;
+  case DATE:
+    isValid = parseDate(&value, &rowFilter->integerValue);
+    break;
+  default:
+    isValid = true;
+  }
+
+  if (isValid)
+    rowFilter->type = type;
+
+  return isValid;
+}
+
+bool parseInteger(const CellView *cell, long long *value)
+{
+  const char *digit = cell->value;
+  const char *end = cell->value + cell->length;
+  bool isNegative = digit < end && *digit == '-';
+
+  if (digit < end && (*digit == '-' || *digit == '+'))
+    digit++;
+
+  if (digit == end || end - digit > 19)
+    return false;
+
+  // 19 digits always fit in an unsigned long long, but may not fit in a long long
+  unsigned long long result = 0;
+  for (; digit < end; digit++)
+  {
+    unsigned char digitValue = (unsigned char)(*digit - '0');
+    if (digitValue > 9)
+      return false;
+    result = result * 10 + digitValue;
+  }
+
+  if (result > (unsigned long long)LLONG_MAX + isNegative)
+    return false;
+
+  // Converted before being negated, since LLONG_MIN has no positive counterpart
+  *value = isNegative && result ? -(long long)(result - 1) - 1 : (long long)result;
+  return true;
+}
+
+bool parseFloat(const CellView *cell, double *value)
+{
+  static const double powersOf10[] = {
+      1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9, 1e10, 1e11,
+      1e12, 1e13, 1e14, 1e15, 1e16, 1e17, 1e18, 1e19, 1e20, 1e21, 1e22};
+
+  const char *digit = cell->value;
+  const char *end = cell->value + cell->length;
+  bool isNegative = digit < end && *digit == '-';
+
+  if (digit < end && (*digit == '-' || *digit == '+'))
+    digit++;
+
+  unsigned long long mantissa = 0;
+  int digitCount = 0;
+  int exponent = 0;
+
+  for (; digit < end && (unsigned char)(*digit - '0') <= 9; digit++, digitCount++)
+    mantissa = mantissa * 10 + (*digit - '0');
+
+  if (digit < end && *digit == '.')
+    for (digit++; digit < end && (unsigned char)(*digit - '0') <= 9; digit++, digitCount++)
+    {
+      mantissa = mantissa * 10 + (*digit - '0');
+      exponent--;
+    }
+
+  if (digitCount == 0)
+    return false;
+
+  if (digit < end && (*digit == 'e' || *digit == 'E'))
+  {
+    CellView exponentCell = {digit + 1, end - digit - 1};
+    long long exponentValue;
+
+    if (!parseInteger(&exponentCell, &exponentValue) ||
+        exponentValue > 1000 ||
+        exponentValue < -1000)
+      return false;
+
+    exponent += (int)exponentValue;
+    digit = end;
+  }
+
+  if (digit != end)
+    return false;
+
+  // Exact when the mantissa and the power of 10 are both exact doubles
+  if (digitCount <= 15 && exponent >= -22 && exponent <= 22)
+  {
+    double result = (double)mantissa;
+    result = exponent < 0 ? result / powersOf10[-exponent] : result * powersOf10[exponent];
+    *value = isNegative ? -result : result;
+    return true;
+  }
+
+  // strtod needs a terminated copy, on the heap for unusually long numbers
+  char stackBuffer[64];
+  char *buffer = cell->length < sizeof(stackBuffer)
+                     ? stackBuffer
+                     : (char *)malloc(cell->length + 1);
+  if (buffer == NULL)
+    return false;
+
+  memcpy(buffer, cell->value, cell->length);
+  buffer[cell->length] = '\0';
+  *value = strtod(buffer, NULL);
+
+  if (buffer != stackBuffer)
+    free(buffer);
+  return true;
+}
+
+bool parseDate(const CellView *cell, long long *value)
+{
+  const char *date = cell->value;
+
+  if (cell->length != 10 || date[4] != '-' || date[7] != '-')
+    return false;
+
+  long long result = 0;
+  for (size_t i = 0; i < 10; i++)
+  {
+    if (i == 4 || i == 7)
+      continue;
+
+    unsigned char digitValue = (unsigned char)(date[i] - '0');
+    if (digitValue > 9)
+      return false;
+    result = result * 10 + digitValue;
+  }
+
+  static const int monthDays[] = {31, 29, 31, 30, 31, 30, 31, 31, 30, 31, 30, 31};
+
+  long long year = result / 10000;
+  long long month = result / 100 % 100;
+  long long day = result % 100;
+  if (month < 1 || month > 12 || day < 1 || day > monthDays[month - 1])
+    return false;
+
+  bool isLeapYear = (year % 4 == 0 && year % 100 != 0) || year % 400 == 0;
+  if (month == 2 && day == 29 && !isLeapYear)
+    return false;
+
+  *value = result;
+  return true;
+}
+
+enum cellType inferCellType(const CellView cells[], size_t cellCount)
+{
+  bool isInteger = true, isFloat = true, isDate = true, isEmpty = true;
+
+  for (size_t i = 0; i < cellCount; i++)
+  {
+    long long integerValue;
+    double floatValue;
+
+    if (!cells[i].length)
+      continue;
+
+    isEmpty = false;
+    isInteger = isInteger && parseInteger(&cells[i], &integerValue);
+    isFloat = isFloat && parseFloat(&cells[i], &floatValue);
+    isDate = isDate && parseDate(&cells[i], &integerValue);
+  }
+
+  if (isEmpty)
+    return TEXT;
+  if (isInteger)
+    return INTEGER;
+  if (isFloat)
+    return FLOAT;
+  if (isDate)
+    return DATE;
+  return TEXT;
+}
+
+int compareCell(const CellView *cell, const char value[], size_t valueLength)
+{
+  size_t length = cell->length < valueLength ? cell->length : valueLength;
+  int comparison = memcmp(cell->value, value, length);
+
+  if (comparison != 0 || cell->length == valueLength)
+    return comparison;
+
+  return cell->length < valueLength ? -1 : 1;
+}
+
+size_t unquoteCell(const CellView *cell, char value[])
+{
+  size_t length = 0;
+
+  for (size_t i = 1; i < cell->length; i++)
+  {
+    if (cell->value[i] == *QUOTE)
+    {
+      // A lone quote closes the field, anything after it is kept as is
+      if (i + 1 >= cell->length || cell->value[i + 1] != *QUOTE)
+      {
+        memmove(&value[length], &cell->value[i + 1], cell->length - i - 1);
+        return length + cell->length - i - 1;
+      }
+      i++;
+    }
+
+    value[length++] = cell->value[i];
+  }
+
+  return length;
+}
+
+uint64_t hashBytes(const char key[], size_t length)
+{
+  uint64_t hash = 0x9e3779b97f4a7c15ULL ^ length;
+  uint64_t word;
+
+  for (; length >= sizeof(word); key += sizeof(word), length -= sizeof(word))
+  {
+    memcpy(&word, key, sizeof(word));
+    hash = (hash ^ word) * 0xff51afd7ed558ccdULL;
+    hash ^= hash >> 32;
+  }
+
+  word = 0;
+  memcpy(&word, key, length);
+  hash = (hash ^ word) * 0xc4ceb9fe1a85ec53ULL;
+  hash ^= hash >> 29;
+
+  return hash ? hash : 1;
+}
+
+/**
+ * Find the slot of a key in a hash set.
+ *
+ * @param valueSet The set.
+ * @param key The key, does not need to be NUL-terminated.
+ * @param length The length of the key.
+ * @param hash The hash of the key.
+ * @return ValueSetSlot* The slot with the key, or the empty slot where it belongs.
+ */
+static ValueSetSlot *findSlot(
+    const ValueSet *valueSet,
+    const char key[],
+    size_t length,
+    uint64_t hash)
+{
+  for (size_t i = hash & valueSet->slotMask;; i = (i + 1) & valueSet->slotMask)
+  {
+    ValueSetSlot *slot = &valueSet->slots[i];
+
+    if (!slot->hash ||
+        (slot->hash == hash &&
+         slot->length == length &&
+         memcmp(&valueSet->keys[slot->offset], key, length) == 0))
+      return slot;
+  }
+}
+
+/**
+ * Get the key of a value in a type other than text.
+ *
+ * @param cell The value.
+ * @param type The type of the key.
+ * @param key Will contain the 8 bytes of the parsed value.
+ * @return bool Whether the value is valid for the type.
+ */
+static bool getTypedKey(const CellView *cell, enum cellType type, char key[8])
+{
+  long long integerValue;
+  double floatValue;
+
+  switch (type)
+  {
+  case INTEGER:
+    if (!parseInteger(cell, &integerValue))
+      return false;
+    memcpy(key, &integerValue, sizeof(integerValue));
+    return true;
+  case DATE:
+    if (!parseDate(cell, &integerValue))
+      return false;
+    memcpy(key, &integerValue, sizeof(integerValue));
+    return true;
+  default:
+    if (!parseFloat(cell, &floatValue))
+      return false;
+    // -0 and 0 are equal, so they must have the same key
+    floatValue += 0.0;
+    memcpy(key, &floatValue, sizeof(floatValue));
+    return true;
+  }
+}
+
+/**
+ * Hash the keys of a hash set into a new table, leaving out duplicates.
+ *
+ * @param valueSet The set, with its keys already set.
+ * @param offsets The offset of each key in the keys of the set.
+ * @param lengths The length of each key.
+ * @param keyCount How many keys there are.
+ */
+static void hashKeys(
+    ValueSet *valueSet,
+    const size_t offsets[],
+    const size_t lengths[],
+    size_t keyCount)
+{
+  size_t slotCount = 8;
+  while (slotCount < keyCount * 2)
+    slotCount *= 2;
+
+  free(valueSet->slots);
+  valueSet->slots = (ValueSetSlot *)calloc(slotCount, sizeof(ValueSetSlot));
+  valueSet->slotMask = slotCount - 1;
+
+  for (size_t i = 0; i < keyCount; i++)
+  {
+    const char *key = &valueSet->keys[offsets[i]];
+    uint64_t hash = hashBytes(key, lengths[i]);
+    ValueSetSlot *slot = findSlot(valueSet, key, lengths[i], hash);
+
+    if (!slot->hash)
+    {
+      slot->hash = hash;
+      slot->offset = offsets[i];
+      slot->length = lengths[i];
+    }
+  }
+}
+
+ValueSet *createValueSet(const char values[], size_t length)
+{
+  ValueSet *valueSet = (ValueSet *)malloc(sizeof(ValueSet));
+  valueSet->values = (char *)malloc(length + 1);
+  valueSet->valuesLength = 0;
+  valueSet->valueCount = 0;
+  valueSet->type = AUTO;
+  valueSet->keys = NULL;
+  valueSet->slots = NULL;
+
+  size_t start = 0;
+  while (start < length)
+  {
+    const char *lineEnd = memchr(&values[start], *LINE_SEPARATOR, length - start);
+    size_t end = lineEnd != NULL ? (size_t)(lineEnd - values) : length;
+    size_t valueLength = end - start;
+
+    if (lineEnd != NULL && valueLength && values[end - 1] == '\r')
+      valueLength--;
+
+    memcpy(&valueSet->values[valueSet->valuesLength], &values[start], valueLength);
+    valueSet->valuesLength += valueLength;
+    valueSet->values[valueSet->valuesLength++] = '\0';
+    valueSet->valueCount++;
+    start = end + 1;
+  }
+
+  setValueSetType(valueSet, TEXT);
+  return valueSet;
+}
+
+ValueSet *copyValueSet(const ValueSet *valueSet)
+{
+  ValueSet *copy = (ValueSet *)malloc(sizeof(ValueSet));
+  *copy = *valueSet;
+  copy->values = (char *)malloc(valueSet->valuesLength + 1);
+  memcpy(copy->values, valueSet->values, valueSet->valuesLength);
+
+  if (valueSet->keys == valueSet->values)
+    copy->keys = copy->values;
+  else
+  {
+    size_t keysLength = valueSet->valueCount * sizeof(long long);
+    copy->keys = (char *)malloc(keysLength + 1);
+    memcpy(copy->keys, valueSet->keys, keysLength);
+  }
+
+  size_t slotsSize = (valueSet->slotMask + 1) * sizeof(ValueSetSlot);
+  copy->slots = (ValueSetSlot *)malloc(slotsSize);
+  memcpy(copy->slots, valueSet->slots, slotsSize);
+  return copy;
+}
+
+bool setValueSetType(ValueSet *valueSet, enum cellType type)
+{
+  if (type == valueSet->type)
+    return true;
+
+  size_t *offsets = (size_t *)malloc((valueSet->valueCount + 1) * sizeof(size_t));
+  size_t *lengths = (size_t *)malloc((valueSet->valueCount + 1) * sizeof(size_t));
+  char *keys = type == TEXT
+                   ? valueSet->values
+                   : (char *)malloc(valueSet->valueCount * sizeof(long long) + 1);
+  size_t keyCount = 0;
+  const char *value = valueSet->values;
+  bool isValid = true;
+
+  for (size_t i = 0; i < valueSet->valueCount && isValid; i++)
+  {
+    CellView cell = {value, strlen(value)};
+
+    if (type == TEXT)
+    {
+      offsets[keyCount] = value - valueSet->values;
+      lengths[keyCount++] = cell.length;
+    }
+    else if (cell.length)
+    {
+      offsets[keyCount] = keyCount * sizeof(long long);
+      lengths[keyCount] = sizeof(long long);
+      isValid = getTypedKey(&cell, type, &keys[offsets[keyCount++]]);
+    }
+
+    value += cell.length + 1;
+  }
+
+  if (isValid)
+  {
+    if (valueSet->keys != valueSet->values)
+      free(valueSet->keys);
+    valueSet->keys = keys;
+    valueSet->type = type;
+    hashKeys(valueSet, offsets, lengths, keyCount);
+  }
+  else
+    free(keys);
+
+  free(offsets);
+  free(lengths);
+  return isValid;
+}
+
+bool findValue(const ValueSet *valueSet, const CellView *cell, bool *isFound)
+{
+  const char *key = cell->value;
+  size_t length = cell->length;
+  char typedKey[sizeof(long long)];
+
+  if (valueSet->type != TEXT)
+  {
+    if (!getTypedKey(cell, valueSet->type, typedKey))
+      return false;
+    key = typedKey;
+    length = sizeof(typedKey);
+  }
+
+  *isFound = findSlot(valueSet, key, length, hashBytes(key, length))->hash != 0;
+  return true;
+}
+
+void freeValueSet(ValueSet *valueSet)
+{
+  if (valueSet->keys != valueSet->values)
+    free(valueSet->keys);
+  free(valueSet->values);
+  free(valueSet->slots);
+  free(valueSet);
+}
+
+/**
+ * Estimate how likely a filter is to accept a cell.
+ *
+ * @param rowFilter The filter.
+ * @return double The estimated fraction of cells accepted.
+ */
+static double estimateSelectivity(const RowFilter *rowFilter)
+{
+  switch (rowFilter->op)
+  {
+  case EQUAL:
+    return 0.01;
+  case NOT_EQUAL:
+    return 0.99;
+  case IN:
+    return rowFilter->valueSet->valueCount < 50 ? 0.01 * rowFilter->valueSet->valueCount : 0.5;
+  case NOT_IN:
+    return rowFilter->valueSet->valueCount < 50 ? 1 - 0.01 * rowFilter->valueSet->valueCount : 0.5;
+  default:
+    return 0.5;
+  }
+}
+
+/**
+ * Estimate how likely a column filter is to accept a cell.
+ *
+ * @param columnFilter The column filter.
+ * @return double The estimated fraction of cells accepted.
+ */
+static double estimateColumnSelectivity(const ColumnFilter *columnFilter)
+{
+  double selectivity = 0;
+
+  for (size_t i = 0; i < columnFilter->totalRowFilters; i++)
+    selectivity += estimateSelectivity(columnFilter->rowFilters[i]);
+
+  return selectivity < 1 ? selectivity : 1;
+}
+
+/**
+ * Order row filters from the most to the least likely to accept a cell.
+ */
+static int compareRowFilters(const void *a, const void *b)
+{
+  double selectivityA = estimateSelectivity(*(RowFilter *const *)a);
+  double selectivityB = estimateSelectivity(*(RowFilter *const *)b);
+
+  return (selectivityA < selectivityB) - (selectivityA > selectivityB);
+}
+
+/**
+ * Order column filters from the most to the least selective, then by column.
+ */
+static int compareColumnFilters(const void *a, const void *b)
+{
+  const ColumnFilter *columnFilterA = (const ColumnFilter *)a;
+  const ColumnFilter *columnFilterB = (const ColumnFilter *)b;
+  double selectivityA = estimateColumnSelectivity(columnFilterA);
+  double selectivityB = estimateColumnSelectivity(columnFilterB);
+
+  if (selectivityA != selectivityB)
+    return selectivityA < selectivityB ? -1 : 1;
+
+  return (columnFilterA->column > columnFilterB->column) -
+         (columnFilterA->column < columnFilterB->column);
+}
+
+/**
+ * A row filter along with its index in the filters given to createFilterPlan.
+ */
+typedef struct
+{
+  RowFilter *rowFilter;
+  size_t index;
+} IndexedRowFilter;
+
+/**
+ * Order row filters by column, then by their original index.
+ */
+static int compareIndexedRowFilters(const void *a, const void *b)
+{
+  const IndexedRowFilter *filterA = (const IndexedRowFilter *)a;
+  const IndexedRowFilter *filterB = (const IndexedRowFilter *)b;
+
+  if (filterA->rowFilter->column != filterB->rowFilter->column)
+    return filterA->rowFilter->column < filterB->rowFilter->column ? -1 : 1;
+
+  return (filterA->index > filterB->index) - (filterA->index < filterB->index);
+}
+
+FilterPlan *createFilterPlan(RowFilter *rowFilters[], size_t totalRowFilters)
+{
+  FilterPlan *filterPlan = (FilterPlan *)malloc(sizeof(FilterPlan));
+  filterPlan->rowFilters = (RowFilter **)malloc(totalRowFilters * sizeof(RowFilter *));
+  filterPlan->totalRowFilters = totalRowFilters;
+  filterPlan->columnFilters = (ColumnFilter *)malloc(totalRowFilters * sizeof(ColumnFilter));
+  filterPlan->totalColumnFilters = 0;
+  filterPlan->scanColumns = 0;
+
+  // Sorting by column makes the filters of each column contiguous in rowFilters
+  IndexedRowFilter *sorted = (IndexedRowFilter *)malloc(
+      totalRowFilters * sizeof(IndexedRowFilter));
+  for (size_t i = 0; i < totalRowFilters; i++)
+  {
+    sorted[i].rowFilter = rowFilters[i];
+    sorted[i].index = i;
+  }
+  qsort(sorted, totalRowFilters, sizeof(IndexedRowFilter), compareIndexedRowFilters);
+
+  for (size_t i = 0; i < totalRowFilters; i++)
+  {
+    RowFilter *rowFilter = sorted[i].rowFilter;
+    filterPlan->rowFilters[i] = rowFilter;
+
+    if (rowFilter->otherColumn != NO_CELL && rowFilter->otherColumn >= filterPlan->scanColumns)
+      filterPlan->scanColumns = rowFilter->otherColumn + 1;
+
+    if (i && rowFilter->column == sorted[i - 1].rowFilter->column)
+    {
+      filterPlan->columnFilters[filterPlan->totalColumnFilters - 1].totalRowFilters++;
+      continue;
+    }
+
+    ColumnFilter *columnFilter = &filterPlan->columnFilters[filterPlan->totalColumnFilters++];
+    columnFilter->column = rowFilter->column;
+    columnFilter->firstRowFilter = sorted[i].index;
+    if (columnFilter->column >= filterPlan->scanColumns)
+      filterPlan->scanColumns = columnFilter->column + 1;
+    columnFilter->rowFilters = &filterPlan->rowFilters[i];
+    columnFilter->totalRowFilters = 1;
+  }
+  free(sorted);
+
+  for (size_t i = 0; i < filterPlan->totalColumnFilters; i++)
+    qsort(
+        filterPlan->columnFilters[i].rowFilters,
+        filterPlan->columnFilters[i].totalRowFilters,
+        sizeof(RowFilter *),
+        compareRowFilters);
+
+  qsort(
+      filterPlan->columnFilters,
+      filterPlan->totalColumnFilters,
+      sizeof(ColumnFilter),
+      compareColumnFilters);
+
+  return filterPlan;
+}
+
+void freeFilterPlan(FilterPlan *filterPlan)
+{
+  for (size_t i = 0; i < filterPlan->totalRowFilters; i++)
+    freeRowFilter(filterPlan->rowFilters[i]);
+
+  free(filterPlan->rowFilters);
+  free(filterPlan->columnFilters);
+  free(filterPlan);
+}
@@ -1,21 +1,78 @@
+#ifndef LIBCSV_UTIL_H
+#define LIBCSV_UTIL_H
+
 #include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <time.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#include "libcsv_sink.h"
 
-#define MAX_CSV_COLS 256
 #define VALUE_SEPARATOR ","
 #define LINE_SEPARATOR "\n"
+#define QUOTE "\""
+#define ARENA_BLOCK_SIZE 65536
+#define NO_CELL ((size_t)-1)
+#define TYPE_SEPARATOR ":"
+#define COLUMN_REFERENCE "$"
+#define INFER_SAMPLE_ROWS 64
 
 typedef struct
 {
   char *header;
   bool isSelected;
+  char *bytes;
+  size_t byteCount;
+  size_t byteCapacity;
+  size_t *offsets;
 } Column;
 
+typedef struct ArenaBlock
+{
+  struct ArenaBlock *next;
+  size_t size;
+  size_t used;
+  char data[];
+} ArenaBlock;
+
+typedef struct
+{
+  ArenaBlock *blocks;
+  size_t blockSize;
+  size_t bytesUsed;
+  size_t bytesReserved;
+} Arena;
+
+typedef struct
+{
+  ArenaBlock *block;
+  size_t used;
+  size_t bytesUsed;
+} ArenaMark;
+
+typedef struct
+{
+  uint64_t hash;
+  size_t column;
+} HeaderSlot;
+
 typedef struct
 {
   Column **columns;
   size_t colCount;
-  char ***cells;
+  size_t colCapacity;
+  // Open-addressing table from the hash of each header to its first column
+  HeaderSlot *headerSlots;
+  size_t headerSlotMask;
   size_t rowCount;
+  size_t rowCapacity;
+  size_t allocations;
+  // Cells copied into the columns by setCellView
+  size_t cellsCopied;
+  Arena arena;
 } Csv;
 
 enum operator
@@ -25,27 +82,159 @@ enum operator
   GREATER = 3,
   NOT_EQUAL = 4,
   LESS_EQUAL = 5,
-  GREATER_EQUAL = 6
+  GREATER_EQUAL = 6,
+  IN = 7,
+  NOT_IN = 8
+};
+
+enum cellType
+{
+  TEXT = 0,
+  INTEGER = 1,
+  FLOAT = 2,
+  DATE = 3,
+  AUTO = 4
 };
 
+typedef struct
+{
+  uint64_t hash;
+  size_t offset;
+  size_t length;
+} ValueSetSlot;
+
+/**
+ * Hash set of the values of an IN filter. The values are kept as given, and their
+ * keys for the type of the set are hashed into an open-addressing table: the text
+ * itself for text, or the 8 bytes of the parsed value for the other types.
+ */
+typedef struct
+{
+  char *values;
+  size_t valuesLength;
+  size_t valueCount;
+  enum cellType type;
+  char *keys;
+  ValueSetSlot *slots;
+  size_t slotMask;
+} ValueSet;
+
 typedef struct
 {
   size_t column;
   enum operator op;
   char *value;
+  size_t valueLength;
+  enum cellType type;
+  long long integerValue;
+  double floatValue;
+  // The values of IN and NOT_IN filters, NULL for the other operators
+  ValueSet *valueSet;
+  // The column compared with cells instead of the value, NO_CELL if none
+  size_t otherColumn;
 } RowFilter;
 
+typedef struct
+{
+  size_t column;
+  RowFilter **rowFilters;
+  size_t totalRowFilters;
+  size_t firstRowFilter;
+} ColumnFilter;
+
+typedef struct
+{
+  ColumnFilter *columnFilters;
+  size_t totalColumnFilters;
+  RowFilter **rowFilters;
+  size_t totalRowFilters;
+  size_t scanColumns;
+} FilterPlan;
+
 /**
- * Create and allocate memory to a new CSV data structure.
+ * Initialize an arena, which hands out memory from large blocks that are only
+ * released all at once by freeArena.
+ *
+ * @param arena The arena to be initialized.
+ * @param blockSize The minimum size of each block allocated by the arena.
+ */
+void initArena(Arena *arena, size_t blockSize);
+
+/**
+ * Allocate memory from an arena, aligned for any pointer type.
  *
- * @param colCount How many columns are to be allocated.
+ * @param arena The arena to allocate from.
+ * @param size How many bytes to allocate.
+ * @return void* The allocated memory.
+ */
+void *arenaAlloc(Arena *arena, size_t size);
+
+/**
+ * Copy a string into memory allocated from an arena.
+ *
+ * @param arena The arena to allocate from.
+ * @param value The string to be copied. Does not need to be NUL-terminated.
+ * @param length The length of the string.
+ * @return char* The NUL-terminated copy.
+ */
+char *arenaStrndup(Arena *arena, const char value[], size_t length);
+
+/**
+ * Save the current position of an arena.
+ *
+ * @param arena The arena.
+ * @return ArenaMark The current position of the arena.
+ */
+ArenaMark arenaMark(const Arena *arena);
+
+/**
+ * Release everything allocated from an arena after a saved position.
+ *
+ * @param arena The arena.
+ * @param mark A position previously returned by arenaMark.
+ */
+void arenaRollback(Arena *arena, ArenaMark mark);
+
+/**
+ * Release all the blocks of an arena.
+ *
+ * @param arena The arena to be freed.
+ */
+void freeArena(Arena *arena);
+
+/**
+ * Create and allocate memory to a new CSV data structure, backed by an arena with
+ * the default block size.
+ *
+ * Cells are stored by column: each column keeps its values in one contiguous buffer
+ * of NUL-terminated strings, plus the offset of each row's value in that buffer.
+ * Columns in which no cell was ever set do not allocate any storage.
  *
  * @return Csv* The created CSV structure.
  */
 Csv *createCsv();
 
 /**
- * Allocate memory to a new column in the CSV.
+ * Create and allocate memory to a new CSV data structure.
+ *
+ * @param arenaBlockSize The block size of the arena holding the columns and headers.
+ *
+ * @return Csv* The created CSV structure.
+ */
+Csv *createSizedCsv(size_t arenaBlockSize);
+
+/**
+ * Get how many bytes were allocated from the arena of a CSV, to help sizing it.
+ *
+ * @param csv The CSV structure.
+ * @param bytesReserved If not NULL, will be set to the total size of the arena blocks.
+ * @return size_t How many bytes of the arena are in use.
+ */
+size_t getCsvArenaBytes(const Csv *csv, size_t *bytesReserved);
+
+/**
+ * Allocate memory to a new column in the CSV. Columns and the hash table of their
+ * headers grow geometrically, so there is no limit to the number of columns.
  *
  * @param csv The CSV in which a new column will be allocated.
  * @param header The header of the new column.
@@ -54,7 +243,18 @@ Csv *createCsv();
 void addColumn(Csv *csv, const char header[], const bool isSelected);
 
 /**
- * Allocate memory to a new row in the CSV.
+ * Find the first column of a CSV with a header, looking it up in a hash table of
+ * the headers.
+ *
+ * @param csv The CSV containing the columns.
+ * @param header The header to be searched for.
+ * @return size_t The index of the column, NO_CELL if no column has the header.
+ */
+size_t findColumn(const Csv *csv, const char header[]);
+
+/**
+ * Allocate memory to a new row in the CSV. Row storage grows geometrically, so
+ * appending rows takes amortized constant time.
  *
  * @param csv The CSV in which a new row will be allocated.
  */
@@ -71,7 +271,18 @@ void addRow(Csv *csv);
 void setCell(Csv *csv, size_t row, size_t col, const char value[]);
 
 /**
- * Get the value of a CSV cell.
+ * Set the value of CSV cell from a view, which does not need to be NUL-terminated.
+ *
+ * @param csv The CSV containing the cell.
+ * @param row The row index of the cell.
+ * @param col The column index of the cell.
+ * @param cell View of the new value of the cell.
+ */
+void setCellView(Csv *csv, size_t row, size_t col, const CellView *cell);
+
+/**
+ * Get the value of a CSV cell. The pointer is only valid until another cell of the
+ * same column is set.
  *
  * @param csv The CSV containing the cell.
  * @param row The row index of the cell.
@@ -82,13 +293,22 @@ void setCell(Csv *csv, size_t row, size_t col, const char value[]);
 char *getCell(Csv *csv, size_t row, size_t col);
 
 /**
- * Remove and free a row of a CSV.
+ * Remove a row of a CSV. The values of the last row are returned to the column
+ * buffers, values of other rows are only released when the CSV is freed.
  *
  * @param csv The CSV containing the row.
  * @param row The index of the row to be deleted.
  */
 void deleteRow(Csv *csv, size_t row);
 
+/**
+ * Remove every row of a CSV, keeping its columns and the memory of its cells so
+ * it can be filled again.
+ *
+ * @param csv The CSV to be cleared.
+ */
+void clearRows(Csv *csv);
+
 /**
  * Free the memory allocated for a CSV.
  *
@@ -97,11 +317,32 @@ void deleteRow(Csv *csv, size_t row);
 void freeCsv(Csv *csv);
 
 /**
- * Print a CSV to stdout.
+ * Write the selected headers of a CSV to a sink.
+ *
+ * @param csv The CSV containing the headers.
+ * @param sink The sink the headers are written to.
+ */
+void printHeaders(const Csv *csv, CsvSink *sink);
+
+/**
+ * Print the selected cells of a single row.
+ *
+ * The row does not need to be stored in the CSV, so rows can be printed as soon as
+ * they are read. Cells are views into the row and do not need to be NUL-terminated.
+ *
+ * @param csv The CSV containing the columns of the row.
+ * @param cells Array with one cell view per column of the CSV.
+ * @param sink The sink the row is written to.
+ */
+void printRow(const Csv *csv, const CellView cells[], CsvSink *sink);
+
+/**
+ * Write a CSV to a sink.
  *
  * @param csv The CSV to be printed.
+ * @param sink The sink the CSV is written to.
  */
-void printCsv(Csv *csv);
+void printCsv(Csv *csv, CsvSink *sink);
 
 /**
  * Create and allocate memory for a RowFilter structure.
@@ -112,3 +353,210 @@ void printCsv(Csv *csv);
  * @return RowFilter* The created RowFilter structure.
  */
 RowFilter *createRowFilter(size_t column, enum operator op, const char *value);
+
+/**
+ * Copy a RowFilter structure, including its parsed value.
+ *
+ * @param rowFilter The filter to be copied.
+ * @return RowFilter* The created copy.
+ */
+RowFilter *copyRowFilter(const RowFilter *rowFilter);
+
+/**
+ * Free a RowFilter structure.
+ *
+ * @param rowFilter The filter to be freed.
+ */
+void freeRowFilter(RowFilter *rowFilter);
+
+/**
+ * Get the cell type with a given name (int, float, date or auto).
+ *
+ * @param name The name of the type, does not need to be NUL-terminated.
+ * @param length The length of the name.
+ * @param type Will be set to the type with the name, if there is one.
+ * @return bool Whether a type with the name exists.
+ */
+bool parseCellType(const char name[], size_t length, enum cellType *type);
+
+/**
+ * Set the type in which a filter compares cells, parsing its value only once.
+ *
+ * @param rowFilter The filter.
+ * @param type The type of the filtered column, other than AUTO.
+ * @return bool Whether the value of the filter is valid for the type.
+ */
+bool setRowFilterType(RowFilter *rowFilter, enum cellType type);
+
+/**
+ * Parse an integer cell, made of an optional sign followed by up to 19 digits,
+ * within the range of a long long.
+ *
+ * @param cell The cell to be parsed.
+ * @param value Will be set to the value of the cell.
+ * @return bool Whether the cell is a valid integer.
+ */
+bool parseInteger(const CellView *cell, long long *value);
+
+/**
+ * Parse a decimal number cell, with optional sign, fraction and exponent.
+ *
+ * @param cell The cell to be parsed.
+ * @param value Will be set to the value of the cell.
+ * @return bool Whether the cell is a valid number.
+ */
+bool parseFloat(const CellView *cell, double *value);
+
+/**
+ * Parse a YYYY-MM-DD date cell into a sortable integer (YYYYMMDD). The day must
+ * exist in its month, taking leap years into account.
+ *
+ * @param cell The cell to be parsed.
+ * @param value Will be set to the value of the cell.
+ * @return bool Whether the cell is a valid date.
+ */
+bool parseDate(const CellView *cell, long long *value);
+
+/**
+ * Infer the type of a column from a sample of its cells. Empty cells are ignored,
+ * and the most specific type that all the other cells are valid for is chosen.
+ *
+ * @param cells The sample of cells.
+ * @param cellCount How many cells there are in the sample.
+ * @return enum cellType The inferred type, TEXT if no other type fits.
+ */
+enum cellType inferCellType(const CellView cells[], size_t cellCount);
+
+/**
+ * Compare a cell view with a NUL-terminated value, with the same ordering as strcmp.
+ *
+ * @param cell The cell to be compared.
+ * @param value The value the cell is compared to.
+ * @param valueLength The length of the value.
+ * @return int Negative, zero or positive if the cell is less, equal or greater.
+ */
+int compareCell(const CellView *cell, const char value[], size_t valueLength);
+
+/**
+ * Get the value of a quoted cell, without its enclosing quotes and with its
+ * escaped quotes ("") unescaped.
+ *
+ * @param cell The cell as it appears in the CSV, starting with a quote.
+ * @param value Buffer with room for the length of the cell, will contain the value.
+ * It may be the cell itself, which is then unquoted in place.
+ * @return size_t The length of the value.
+ */
+size_t unquoteCell(const CellView *cell, char value[]);
+
+/**
+ * Hash a key of a hash table, 8 bytes at a time.
+ *
+ * @param key The key, does not need to be NUL-terminated.
+ * @param length The length of the key.
+ * @return uint64_t The hash of the key, never 0 so it can mark empty slots.
+ */
+uint64_t hashBytes(const char key[], size_t length);
+
+/**
+ * Create a hash set of text values, one per line. A line separator at the end of
+ * the values does not start another value, and line separators may end with '\r'.
+ *
+ * @param values The values, does not need to be NUL-terminated.
+ * @param length The length of the values.
+ * @return ValueSet* The created set.
+ */
+ValueSet *createValueSet(const char values[], size_t length);
+
+/**
+ * Copy a hash set, including its keys.
+ *
+ * @param valueSet The set to be copied.
+ * @return ValueSet* The created copy.
+ */
+ValueSet *copyValueSet(const ValueSet *valueSet);
+
+/**
+ * Set the type in which a hash set compares cells, parsing each value only once.
+ * Empty values are left out of typed sets.
+ *
+ * @param valueSet The set.
+ * @param type The type of the filtered column, other than AUTO.
+ * @return bool Whether every value is valid for the type. Otherwise the set is
+ * left unchanged.
+ */
+bool setValueSetType(ValueSet *valueSet, enum cellType type);
+
+/**
+ * Look up a cell in a hash set, in the type of the set.
+ *
+ * @param valueSet The set.
+ * @param cell The cell to be looked up.
+ * @param isFound Will be set to whether the set contains the value of the cell.
+ * @return bool Whether the cell is valid for the type of the set.
+ */
+bool findValue(const ValueSet *valueSet, const CellView *cell, bool *isFound);
+
+/**
+ * Free a hash set.
+ *
+ * @param valueSet The set to be freed.
+ */
+void freeValueSet(ValueSet *valueSet);
+
+/**
+ * Compile row filters into a plan grouped by column.
+ *
+ * Filters of the same column form one ColumnFilter (OR), and a row is only valid if
+ * every ColumnFilter (AND) accepts it. Column filters are ordered from the most to
+ * the least selective, so rows are rejected as early as possible, and filters
+ * inside a column are ordered from the most to the least likely to accept a cell.
+ *
+ * firstRowFilter is the index in rowFilters of the first filter of each column.
+ *
+ * scanColumns starts as the number of leading columns needed by the filters, so
+ * rows do not have to be split past the last of them.
+ *
+ * @param rowFilters Array with the row filters, which will be owned by the plan.
+ * @param totalRowFilters How many row filters there are in the array.
+ * @return FilterPlan* The compiled plan.
+ */
+FilterPlan *createFilterPlan(RowFilter *rowFilters[], size_t totalRowFilters);
+
+/**
+ * Free a filter plan and the row filters it owns.
+ *
+ * @param filterPlan The plan to be freed.
+ */
+void freeFilterPlan(FilterPlan *filterPlan);
+
+/**
+ * Read a fast, monotonic tick counter used to time processing stages.
+ *
+ * @return uint64_t Cycles of the time stamp counter on x86, nanoseconds elsewhere.
+ */
+static inline uint64_t readTicks()
+{
+#if defined(__x86_64__) || defined(__i386__)
+  return __rdtsc();
+#else
+  struct timespec time;
+  clock_gettime(CLOCK_MONOTONIC, &time);
+  return (uint64_t)time.tv_sec * 1000000000 + time.tv_nsec;
+#endif
+}
+
+/**
+ * Add the ticks elapsed since a start to a stage counter.
+ *
+ * @param stage The stage counter.
+ * @param start The ticks when the stage started.
+ * @return uint64_t The current ticks, so the next stage can start from them.
+ */
+static inline uint64_t lapTicks(uint64_t *stage, uint64_t start)
+{
+  uint64_t ticks = readTicks();
+  *stage += ticks - start;
+  return ticks;
+}
+
+#endif